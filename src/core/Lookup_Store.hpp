@@ -11,6 +11,7 @@
 #include "util/Matrix.hpp"
 #include "util/maps.hpp"
 #include "util/Range.hpp"
+#include "util/Char_Span.hpp"
 
 constexpr size_t INVALID = std::numeric_limits<size_t>::max();
 
@@ -26,6 +27,8 @@ class Lookup_Store
  * char_to_posish: maps ascii char to a column in a lookup_matrix. This also normalizes the input!
  *                 meaning: map upper and lowercase to the same CLV site, different variants of
  *                 GAP (-?Xx etc.) and ANY (N), U into T (RNA support) and defines invalid chars
+ * shared_: optional per branch pointer to an externally owned lookup_matrix of identical layout
+ *          (for example in a shared memory segment, see io/Shared_Store.hpp). Takes precedence over store_
  */
 public:
   using lookup_type = Matrix<double>;
@@ -33,6 +36,7 @@ public:
   Lookup_Store(const size_t num_branches, const size_t num_states) 
     : branch_(num_branches)
     , store_(num_branches)
+    , shared_(num_branches, nullptr)
     , char_map_size_((num_states == 4) ? NT_MAP_SIZE : AA_MAP_SIZE)
     , char_map_((num_states == 4) ? NT_MAP : AA_MAP)
   {
@@ -82,14 +86,41 @@ public:
     }
   }
 
+  // from a row major (site, char) table, as laid out by branch_data
+  void init_branch(const size_t branch_id, double const * const data, const size_t sites)
+  {
+    store_[branch_id] = Matrix<double>(sites, char_map_size_);
+
+    for(size_t site = 0; site < sites; ++site) {
+      for(size_t ch = 0; ch < char_map_size_; ++ch) {
+        store_[branch_id](site, ch) = data[site * char_map_size_ + ch];
+      }
+    }
+  }
+
   std::mutex& get_mutex(const size_t branch_id)
   {
     return branch_[branch_id];
   }
 
+  void attach_branch(const size_t branch_id, double const * const data)
+  {
+    shared_[branch_id] = data;
+  }
+
   bool has_branch(const size_t branch_id) 
   {
-    return store_[branch_id].size() != 0; 
+    return shared_[branch_id] or store_[branch_id].size() != 0; 
+  }
+
+  double const * branch_data(const size_t branch_id) const
+  {
+    return shared_[branch_id] ? shared_[branch_id] : store_[branch_id].get_array().data();
+  }
+
+  size_t num_branches() const
+  {
+    return store_.size();
   }
 
   lookup_type& operator[](const size_t branch_id)
@@ -124,13 +155,13 @@ public:
     return pos;
   }
 
-  double sum_precomputed_sitelk(const size_t branch_id, const std::string& seq, const Range& range) const
+  double sum_precomputed_sitelk(const size_t branch_id, const Char_Span seq, const Range& range) const
   {
-    assert(seq.length() == store_[branch_id].rows());
+    assert(shared_[branch_id] or seq.length() == store_[branch_id].rows());
     
     double sum = 0;
-    const auto& lookup_matrix = store_[branch_id];
-    const auto& lookup = lookup_matrix.get_array();
+    const auto lookup = branch_data(branch_id);
+    const size_t cols = char_map_size_;
 
     // unrolled loop
     size_t site = range.begin;
@@ -139,12 +170,12 @@ public:
     const size_t stride = 4;
     for (; site + stride-1u < end; site+=stride) {
       double sum_one =
-      lookup[lookup_matrix.coord(site, char_to_posish_[seq[site]])]
-      + lookup[lookup_matrix.coord(site+1u, char_to_posish_[seq[site+1u]])];
+      lookup[site * cols + char_to_posish_[seq[site]]]
+      + lookup[(site+1u) * cols + char_to_posish_[seq[site+1u]]];
       
       double sum_two =
-      lookup[lookup_matrix.coord(site+2u, char_to_posish_[seq[site+2u]])]
-      + lookup[lookup_matrix.coord(site+3u, char_to_posish_[seq[site+3u]])];
+      lookup[(site+2u) * cols + char_to_posish_[seq[site+2u]]]
+      + lookup[(site+3u) * cols + char_to_posish_[seq[site+3u]]];
 
       sum_one += sum_two;
 
@@ -153,7 +184,7 @@ public:
 
     // rest of the horizontal add
     while (site < end) {
-      sum += lookup[lookup_matrix.coord(site, char_to_posish_[seq[site]])];
+      sum += lookup[site * cols + char_to_posish_[seq[site]]];
       ++site;
     }
     return sum;
@@ -162,6 +193,7 @@ public:
 private:
   std::vector<std::mutex> branch_;
   std::vector<lookup_type> store_;
+  std::vector<double const *> shared_;
   const size_t char_map_size_;
   const unsigned char * char_map_;
   std::array<size_t, 128> char_to_posish_;
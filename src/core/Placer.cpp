@@ -0,0 +1,169 @@
+#include "core/Placer.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+
+#include "core/place.hpp"
+#include "core/pll/pll_util.hpp"
+#include "io/file_io.hpp"
+#include "seq/abundance.hpp"
+#include "util/logging.hpp"
+
+Placer::Placer( const std::string& tree_file,
+                const std::string& reference_file,
+                const raxml::Model& model,
+                const Options& options)
+  : model_(model)
+  , options_(options)
+{
+  auto ref_info = make_msa_info(reference_file);
+  auto ref_msa = build_MSA_from_file(reference_file, ref_info, options_.premasking);
+  if (ref_msa.size() == 0 or ref_msa.num_sites() == 0 ) {
+    throw std::runtime_error{std::string("Something went wrong reading the reference file: ") + reference_file};
+  }
+
+  owned_tree_ = std::make_unique<Tree>(tree_file, ref_msa, model_, options_);
+  tree_ = owned_tree_.get();
+  if (options_.premasking) {
+    gap_mask_ = ref_info.gap_mask();
+  }
+  init_();
+}
+
+/**
+  Loads the reference from a binary file. If it is a snapshot, queries are masked
+  with the mask stored alongside.
+*/
+Placer::Placer( const std::string& binary_file,
+                const raxml::Model& model,
+                const Options& options)
+  : model_(model)
+  , options_(options)
+{
+  options_.load_binary_mode = true;
+  owned_tree_ = std::make_unique<Tree>(binary_file, model_, options_);
+  tree_ = owned_tree_.get();
+  if (options_.premasking and tree_->binary().is_snapshot()) {
+    gap_mask_ = tree_->binary().load_gap_mask();
+  }
+  init_();
+}
+
+Placer::Placer( Tree& reference_tree,
+                const MSA_Info::mask_type& gap_mask,
+                const Options& options)
+  : tree_(&reference_tree)
+  , model_(reference_tree.model())
+  , options_(options)
+  , gap_mask_(options.premasking ? gap_mask : MSA_Info::mask_type())
+{
+  init_();
+}
+
+void Placer::init_()
+{
+  newick_ = get_numbered_newick_string( tree_->tree(),
+                                        tree_->mapper(),
+                                        options_.precision );
+
+  const auto num_branches = tree_->nums().branches;
+  branches_ = std::vector<pll_unode_t *>(num_branches);
+  auto num_traversed_branches = utree_query_branches(tree_->tree(), &branches_[0]);
+  if (num_traversed_branches != num_branches) {
+    throw std::runtime_error{"Traversing the utree went wrong during placer setup!"};
+  }
+
+  // lookups are filled lazily, and then kept for all following calls
+  lookups_ = make_lookup_store(*tree_);
+}
+
+/**
+  Checks that the queries are aligned against the reference and masks them like it,
+  unless they already are. Abundance annotations are split off the headers here as well,
+  such that invalid ones are reported before anything is placed.
+*/
+MSA Placer::prepare(MSA::const_iterator begin, MSA::const_iterator end) const
+{
+  MSA result;
+  prepare_(begin, end, result);
+  return result;
+}
+
+/**
+  Prepares the queries into the result, reusing its storage (see MSA::clear).
+*/
+void Placer::prepare_(MSA::const_iterator begin,
+                      MSA::const_iterator end,
+                      MSA& result) const
+{
+  const size_t sites = tree_->partition()->sites;
+  const bool masking = gap_mask_.size() > 0;
+
+  result.clear();
+  result.num_sites(sites);
+  const auto number = static_cast<size_t>(std::distance(begin, end));
+  result.reserve(number);
+  result.add_rows(number);
+
+  size_t i = 0;
+  for (auto it = begin; it != end; ++it, ++i) {
+    const auto length = it->sequence().length();
+    if (masking and length == gap_mask_.size()) {
+      subset_sequence(it->sequence(), gap_mask_, result.row(i));
+    } else if (length == sites) {
+      std::copy(it->sequence().begin(), it->sequence().end(), result.row(i));
+    } else {
+      result.clear();
+      throw std::runtime_error{std::string("Query sequence '") + it->header().str()
+        + "' has " + std::to_string(length) + " sites, expected "
+        + std::to_string(masking ? gap_mask_.size() : sites)
+        + ". Is it aligned against the reference?"};
+    }
+    result.header(i, it->header());
+    (result.begin() + i)->abundance(it->abundance());
+  }
+
+  if (options_.abundances) {
+    split_abundances(result);
+  }
+}
+
+Sample<Placement> Placer::place(const MSA& queries)
+{
+  return place(queries.begin(), queries.end());
+}
+
+/**
+  Places the given queries. The sequence ids of the resulting pqueries are the
+  indices of the sequences in the given range, and the pqueries are ordered by them.
+*/
+Sample<Placement> Placer::place(MSA::const_iterator begin, MSA::const_iterator end)
+{
+  Sample<Placement> result(newick_);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // the storage of the previous chunk is prepared into
+    prepare_(begin, end, chunk_);
+    if (chunk_.size() == 0) {
+      return result;
+    }
+
+    auto sample = place_chunk(chunk_,
+                              *tree_,
+                              branches_,
+                              lookups_,
+                              preplace_,
+                              options_);
+    result.insert(std::make_move_iterator(std::begin(sample)),
+                  std::make_move_iterator(std::end(sample)));
+  }
+
+  std::sort(std::begin(result), std::end(result),
+    [](const PQuery<Placement>& lhs, const PQuery<Placement>& rhs) {
+      return lhs.sequence_id() < rhs.sequence_id();
+    });
+
+  return result;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include "tree/Tree.hpp"
+#include "seq/MSA.hpp"
+#include "seq/MSA_Info.hpp"
+#include "sample/Sample.hpp"
+#include "core/Lookup_Store.hpp"
+#include "core/raxml/Model.hpp"
+#include "core/pll/rtree_mapper.hpp"
+#include "util/Options.hpp"
+
+/**
+ * Entry point for using epa-ng as a library: sets up a reference once, then places
+ * any number of query batches, returning the results in memory.
+ *
+ * Queries may be passed either at the full alignment width of the reference MSA, in which
+ * case they are masked like the reference, or already masked. Lookup tables are kept
+ * between calls. place() may be called from multiple threads, however calls are serialized,
+ * as each already uses all threads specified in the options.
+ */
+class Placer
+{
+public:
+  Placer( const std::string& tree_file,
+          const std::string& reference_file,
+          const raxml::Model& model,
+          const Options& options);
+  Placer( const std::string& binary_file,
+          const raxml::Model& model,
+          const Options& options);
+  Placer( Tree& reference_tree,
+          const MSA_Info::mask_type& gap_mask,
+          const Options& options);
+  Placer()  = delete;
+  ~Placer() = default;
+
+  Placer(Placer const& other) = delete;
+  Placer(Placer&& other)      = delete;
+
+  Placer& operator= (Placer const& other) = delete;
+  Placer& operator= (Placer && other)     = delete;
+
+  Sample<Placement> place(const MSA& queries);
+  Sample<Placement> place(MSA::const_iterator begin, MSA::const_iterator end);
+
+  MSA prepare(MSA::const_iterator begin, MSA::const_iterator end) const;
+
+  // member access
+  Tree& tree() { return *tree_; }
+  const Options& options() const { return options_; }
+  const MSA_Info::mask_type& gap_mask() const { return gap_mask_; }
+  const rtree_mapper& mapper() { return tree_->mapper(); }
+  const std::string& newick() const { return newick_; }
+
+private:
+  void init_();
+  void prepare_(MSA::const_iterator begin,
+                MSA::const_iterator end,
+                MSA& result) const;
+
+  std::unique_ptr<Tree> owned_tree_;
+  Tree * tree_ = nullptr;
+  raxml::Model model_;
+  Options options_;
+  MSA_Info::mask_type gap_mask_;
+  std::string newick_;
+  std::vector<pll_unode_t *> branches_;
+  std::shared_ptr<Lookup_Store> lookups_;
+  // reused across calls, guarded by mutex_
+  Sample<Placement> preplace_;
+  MSA chunk_;
+  std::mutex mutex_;
+};
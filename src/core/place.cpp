@@ -5,6 +5,7 @@
 #include <memory>
 #include <functional>
 #include <limits>
+#include <algorithm>
 
 #ifdef __OMP
 #include <omp.h>
@@ -15,14 +16,19 @@
 #include "io/msa_reader.hpp"
 #include "io/Binary_Fasta.hpp"
 #include "io/jplace_writer.hpp"
+#include "io/Checkpoint.hpp"
+#include "io/Placement_Cache.hpp"
 #include "util/stringify.hpp"
 #include "util/logging.hpp"
 #include "util/Timer.hpp"
 #include "tree/Tiny_Tree.hpp"
+#include "tree/CLV_Prefetcher.hpp"
 #include "net/mpihead.hpp"
 #include "pipeline/schedule.hpp"
 #include "pipeline/Pipeline.hpp"
 #include "seq/MSA.hpp"
+#include "seq/Duplicate_Filter.hpp"
+#include "seq/abundance.hpp"
 #include "core/pll/pll_util.hpp"
 #include "core/pll/epa_pll_util.hpp"
 #include "core/Work.hpp"
@@ -179,7 +185,7 @@ static void place_thorough(const Work& to_place,
     }
 
     if (seq_lookup.count( seq_id ) == 0) {
-      auto const new_idx = local_sample.add_pquery( seq_id_offset + seq_id, seq.header() );
+      auto const new_idx = local_sample.add_pquery( seq_id_offset + seq_id, seq.header(), seq.abundance() );
       seq_lookup[ seq_id ] = new_idx;
     }
     assert( seq_lookup.count( seq_id ) > 0 );
@@ -195,6 +201,146 @@ static void place_thorough(const Work& to_place,
   collapse(sample);
 }
 
+/**
+  Precomputes the per-site lookup tables of every branch up front, as opposed
+  to lazily during the preplacement. Used to publish a complete reference.
+*/
+std::shared_ptr<Lookup_Store> build_lookup_store(Tree& reference_tree,
+                                                 const Options& options)
+{
+  const auto num_branches = reference_tree.nums().branches;
+
+  std::vector<pll_unode_t *> branches(num_branches);
+  auto num_traversed_branches = utree_query_branches(reference_tree.tree(), &branches[0]);
+  if (num_traversed_branches != num_branches) {
+    throw std::runtime_error{"Traversing the utree went wrong during lookup precomputation!"};
+  }
+
+  auto lookups =
+    std::make_shared<Lookup_Store>(num_branches, reference_tree.partition()->states);
+
+#ifdef __OMP
+  const unsigned int num_threads  = options.num_threads
+                                  ? options.num_threads
+                                  : omp_get_max_threads();
+  omp_set_num_threads(num_threads);
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (size_t branch_id = 0; branch_id < num_branches; ++branch_id) {
+    // constructing the tiny tree in non-blo mode fills the lookup for this branch
+    Tiny_Tree branch(branches[branch_id],
+                     branch_id,
+                     reference_tree,
+                     false,
+                     options,
+                     lookups);
+  }
+
+  return lookups;
+}
+
+/**
+  Creates the lookup store for the given reference, attaching to the precomputed
+  tables of a shared memory segment or snapshot if there are any.
+*/
+std::shared_ptr<Lookup_Store> make_lookup_store(Tree& reference_tree)
+{
+  auto lookups = std::make_shared<Lookup_Store>(reference_tree.nums().branches,
+                                                reference_tree.partition()->states);
+
+  if (reference_tree.shared_store()) {
+    reference_tree.shared_store()->assign(*lookups);
+  } else if (reference_tree.binary().is_snapshot()) {
+    reference_tree.binary().load_lookups(*lookups);
+  }
+
+  return lookups;
+}
+
+/**
+  Places one chunk of query sequences: preplacement on all branches to select candidates
+  (if prescoring is enabled), then thorough insertion into the candidate branches.
+  Returns the result with computed and filtered LWRs.
+  The preplacement results go to the given sample, which is only reallocated when the size
+  of the chunk changes, such that callers can reuse it across chunks.
+*/
+Sample<Placement> place_chunk(MSA& chunk,
+                              Tree& reference_tree,
+                              const std::vector<pll_unode_t *>& branches,
+                              std::shared_ptr<Lookup_Store>& lookups,
+                              Sample<Placement>& preplace,
+                              const Options& options,
+                              const size_t seq_id_offset,
+                              CLV_Prefetcher* prefetcher)
+{
+  const auto num_sequences = chunk.size();
+  const auto num_branches = branches.size();
+
+  Work blo_work;
+
+  if (options.prescoring) {
+
+    // preplacement only needs the CLVs of branches whose lookup table is not yet built,
+    // visiting them roughly in order of their id
+    if (prefetcher) {
+      std::vector<pll_unode_t *> missing;
+      for (size_t branch_id = 0; branch_id < num_branches; ++branch_id) {
+        if (not lookups->has_branch(branch_id)) {
+          missing.push_back(branches[branch_id]);
+        }
+      }
+      if (not missing.empty()) {
+        prefetcher->schedule(std::move(missing));
+      }
+    }
+
+    if (preplace.size() != num_sequences
+        or (num_sequences and preplace[0].size() != num_branches)) {
+      preplace = Sample<Placement>(num_sequences, num_branches);
+    }
+
+    LOG_DBG << "Preplacement." << std::endl;
+    place(chunk,
+          reference_tree,
+          branches,
+          preplace,
+          options,
+          lookups);
+
+    LOG_DBG << "Selecting candidates." << std::endl;
+
+    blo_work = apply_heuristic(preplace, options);
+
+  } else {
+    blo_work = Work(std::make_pair(0, num_branches), std::make_pair(0, num_sequences));
+  }
+
+  if (prefetcher) {
+    std::vector<pll_unode_t *> blo_branches;
+    for (auto it = blo_work.bin_cbegin(); it != blo_work.bin_cend(); ++it) {
+      blo_branches.push_back(branches[it->first]);
+    }
+    prefetcher->schedule(std::move(blo_branches));
+  }
+
+  Sample<Placement> blo_sample;
+
+  LOG_DBG << "BLO Placement." << std::endl;
+  place_thorough( blo_work,
+                  chunk,
+                  reference_tree,
+                  branches,
+                  blo_sample,
+                  options,
+                  lookups,
+                  seq_id_offset);
+
+  compute_and_set_lwr(blo_sample);
+  filter(blo_sample, options);
+
+  return blo_sample;
+}
+
 void simple_mpi(Tree& reference_tree,
                 const std::string& query_file,
                 const MSA_Info& msa_info,
@@ -211,23 +357,37 @@ void simple_mpi(Tree& reference_tree,
     throw std::runtime_error{"Traversing the utree went wrong during pipeline startup!"};
   }
 
-  auto lookups =
-    std::make_shared<Lookup_Store>(num_branches, reference_tree.partition()->states);
+  auto lookups = make_lookup_store(reference_tree);
 
   auto reader = make_msa_reader(query_file,
                                 msa_info,
                                 options.premasking,
-                                true);
+                                true,
+                                options.read_ahead);
 
   size_t num_sequences = 0;
-  Work all_work(std::make_pair(0, num_branches), std::make_pair(0, options.chunk_size));
 
-  Work blo_work;
-
-  using Sample = Sample<Placement>;
   MSA chunk;
   size_t sequences_done = 0; // not just for info output!
 
+  Checkpoint checkpoint;
+  if (options.checkpointing) {
+    Checkpoint run(outdir + "epa_checkpoint");
+    run.chunk_size = options.chunk_size;
+    run.num_sequences = reader->num_sequences();
+    run.identify(query_file, reference_tree, options);
+
+    checkpoint = run;
+    if (checkpoint.load()) {
+      checkpoint.validate(run);
+      LOG_INFO << "Resuming from checkpoint after " << checkpoint.chunks_done << " completed chunks";
+      // under MPI, every rank completed this many chunks of its own part
+      sequences_done = std::min(checkpoint.chunks_done * options.chunk_size,
+                                reader->num_sequences() - reader->local_seq_offset());
+      reader->skip_to_sequence(sequences_done);
+    }
+  }
+
   // prepare output file
   LOG_INFO << "Output file: " << outdir + "epa_result.jplace";
   jplace_writer jplace( outdir, "epa_result.jplace",
@@ -235,10 +395,25 @@ void simple_mpi(Tree& reference_tree,
                                                     reference_tree.mapper(),
                                                     options.precision ),
                         invocation,
-                        reference_tree.mapper());
+                        reference_tree.mapper(),
+                        checkpoint);
   jplace.set_precision( options.precision );
+  jplace.set_abundances( options.abundances );
 
-  Sample preplace(options.chunk_size, num_branches);
+  // in binary mode: load the CLVs of upcoming branches in the background
+  CLV_Prefetcher prefetcher(reference_tree);
+
+  // identical queries are placed once (see --dedup)
+  Duplicate_Filter duplicates(options.dedup_memory_limit);
+
+  Sample<Placement> preplace;
+
+  // results of previous runs (see --cache)
+  std::unique_ptr<Placement_Cache> cache;
+  if (not options.cache_dir.empty()) {
+    cache = std::make_unique<Placement_Cache>(options.cache_dir,
+                                              Placement_Cache::make_context(reference_tree, options));
+  }
 
   while ( (num_sequences = reader->read_next(chunk, options.chunk_size)) ) {
 
@@ -248,44 +423,37 @@ void simple_mpi(Tree& reference_tree,
 
     size_t const seq_id_offset = sequences_done + reader->local_seq_offset();
 
-    if (num_sequences < options.chunk_size) {
-      all_work = Work(std::make_pair(0, num_branches), std::make_pair(0, num_sequences));
-      preplace = Sample(num_sequences, num_branches);
+    if (options.abundances) {
+      split_abundances(chunk);
     }
-
-    if (options.prescoring) {
-
-      LOG_DBG << "Preplacement." << std::endl;
-      place(chunk,
-            reference_tree,
-            branches,
-            preplace,
-            options,
-            lookups);
-
-      LOG_DBG << "Selecting candidates." << std::endl;
-
-      blo_work = apply_heuristic(preplace, options);
-
-    } else {
-      blo_work = all_work;
+    if (cache) {
+      cache->filter(chunk);
+    }
+    if (options.dedup) {
+      duplicates.filter(chunk);
     }
 
-    Sample blo_sample;
-
-    LOG_DBG << "BLO Placement." << std::endl;
-    place_thorough( blo_work,
-                    chunk,
-                    reference_tree,
-                    branches,
-                    blo_sample,
-                    options,
-                    lookups,
-                    seq_id_offset);
+    // filtered chunks are placed with ids local to the chunk, remapped on expansion
+    bool const filtered = cache or options.dedup;
+
+    Sample<Placement> blo_sample;
+    if (chunk.size()) {
+      blo_sample = place_chunk(chunk,
+                               reference_tree,
+                               branches,
+                               lookups,
+                               preplace,
+                               options,
+                               filtered ? 0 : seq_id_offset,
+                               &prefetcher);
+    }
 
-    // Output
-    compute_and_set_lwr(blo_sample);
-    filter(blo_sample, options);
+    if (options.dedup) {
+      duplicates.expand(blo_sample, chunk, cache ? 0 : seq_id_offset);
+    }
+    if (cache) {
+      cache->expand(blo_sample, seq_id_offset);
+    }
 
     // pass the result chunk to the writer
     jplace.write( blo_sample );
@@ -294,7 +462,38 @@ void simple_mpi(Tree& reference_tree,
     LOG_INFO << sequences_done  << " Sequences done!";
   }
 
-  jplace.wait();
+  prefetcher.cancel();
+
+  if (options.dedup) {
+    LOG_INFO << "Duplicate queries: " << duplicates.num_duplicates() << " (placed "
+             << duplicates.num_unique() << " unique sequences)";
+    if (duplicates.num_forgotten()) {
+      LOG_INFO << "Forgot the placements of " << duplicates.num_forgotten()
+               << " sequences due to the memory limit of --dedup";
+    }
+  }
+
+  if (cache) {
+    auto const lookups_done = cache->hits() + cache->misses();
+    LOG_INFO << "Placement cache: " << cache->hits() << " hits, " << cache->misses() << " misses ("
+             << (lookups_done ? 100.0 * cache->hits() / lookups_done : 0.0) << "% hit rate)";
+  }
+
+  auto const read_stats = reader->stats();
+  if (read_stats.chunks) {
+    LOG_DBG << "Query reading: waited for " << read_stats.stalls << " of " << read_stats.chunks
+            << " chunks (" << read_stats.stall_seconds << "s), "
+            << static_cast<double>(read_stats.queued) / read_stats.chunks << " chunks ready on average";
+  }
+
+  if (options.load_binary_mode) {
+    auto const& stats = reference_tree.clv_stats();
+    LOG_DBG << "CLV prefetching: " << stats.prefetched << " prefetched, "
+            << stats.prefetch_hits << " hits, " << stats.stalls << " stalls";
+  }
+
+  // the run is complete, so its checkpoint is removed
+  jplace.close();
 
   MPI_BARRIER(MPI_COMM_WORLD);
 }
@@ -5,8 +5,14 @@
 #include "util/Options.hpp"
 #include "tree/Tree.hpp"
 #include "core/raxml/Model.hpp"
+#include "core/Lookup_Store.hpp"
+#include "sample/Sample.hpp"
 
 #include <string>
+#include <vector>
+#include <memory>
+
+class CLV_Prefetcher;
 
 void simple_mpi(Tree& tree,
                 const std::string& query_file,
@@ -15,3 +21,16 @@ void simple_mpi(Tree& tree,
                 const Options& options,
                 const std::string& invocation);
 
+std::shared_ptr<Lookup_Store> build_lookup_store(Tree& tree,
+                                                 const Options& options);
+
+std::shared_ptr<Lookup_Store> make_lookup_store(Tree& tree);
+
+Sample<Placement> place_chunk(MSA& chunk,
+                              Tree& tree,
+                              const std::vector<pll_unode_t *>& branches,
+                              std::shared_ptr<Lookup_Store>& lookups,
+                              Sample<Placement>& preplace,
+                              const Options& options,
+                              const size_t seq_id_offset=0,
+                              CLV_Prefetcher* prefetcher=nullptr);
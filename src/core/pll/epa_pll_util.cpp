@@ -2,6 +2,7 @@
 
 #include <unordered_map>
 #include <algorithm>
+#include <iterator>
 
 #include "core/pll/pll_util.hpp"
 #include "core/pll/optimize.hpp"
@@ -62,65 +63,152 @@ void link_tree_msa( pll_utree_t * tree,
   raxml::assign(partition, model);
 }
 
+/**
+  Computes all directional CLVs of the reference tree.
+
+  The CLV of every inner node record depends on the CLVs of the two subtrees behind it.
+  These dependencies are resolved in waves: each wave holds the operations whose children
+  are tips or were computed in an earlier wave, meaning all operations of a wave are
+  independent and are executed in parallel, except where pll_update_partials writes to buffers
+  shared across the partition:
+  - with site repeats, any operation may, so in that case the waves are executed sequentially
+  - with tip patterns, operations on two tips rebuild the tip-tip lookup table (ttlookup)
+    before reading it, so those are executed sequentially, ahead of the rest of their wave
+*/
 void precompute_clvs( pll_utree_t const * const tree,
                       pll_partition_t * partition,
                       const Tree_Numbers& nums)
 {
-  /* various buffers for creating a postorder traversal and operations structures */
-  std::vector<unsigned int> param_indices(partition->rate_cats, 0);
-  std::vector<pll_unode_t*> travbuffer(nums.nodes);
-  std::vector<double> branch_lengths(nums.branches);
-  std::vector<unsigned int> matrix_indices(nums.branches);
-  std::vector<pll_operation_t> operations(nums.nodes);
-
   const auto root = get_root(tree);
 
   utree_free_node_data(root);
 
-  for( size_t i = 0; i < tree->tip_count; ++i ) {
+  // all branches need their matrices before any CLV can be computed
+  precompute_pmatrices(tree, partition, nums);
+
+  const size_t num_clvs = partition->tips + partition->clv_buffers;
+  const auto is_inner = [](pll_unode_t const * const node) { return node->next != nullptr; };
+
+  // collect every inner node record, i.e. every CLV that needs computing
+  std::vector<pll_unode_t*> records;
+  records.reserve(3 * nums.inner_nodes);
+  for (size_t i = tree->tip_count; i < tree->tip_count + tree->inner_count; ++i) {
     const auto node = tree->nodes[i];
-    /* perform a partial postorder traversal of the unrooted tree  starting at the current tip
-      and returning every node whose clv in the direction of the tip hasn't been calculated yet*/
-    unsigned int traversal_size = 0;
-    unsigned int num_matrices = 0;
-    unsigned int num_ops = 0;
-    if( pll_utree_traverse( node->back,
-                            PLL_TREE_TRAVERSE_POSTORDER,
-                            cb_partial_traversal,
-                            &travbuffer[0],
-                            &traversal_size)
-                != PLL_SUCCESS ) {
-      throw std::runtime_error{"Function pll_unode_traverse() requires inner nodes as parameters"};
+    records.push_back(node);
+    records.push_back(node->next);
+    records.push_back(node->next->next);
+  }
+
+  // build the dependency graph, indexed by clv_index
+  std::vector<unsigned int> pending(num_clvs, 0);
+  std::vector<std::vector<pll_unode_t*>> dependents(num_clvs);
+  std::vector<pll_unode_t*> wave;
+
+  for (auto const record : records) {
+    for (auto const child : {record->next->back, record->next->next->back}) {
+      if (is_inner(child)) {
+        dependents[child->clv_index].push_back(record);
+        ++pending[record->clv_index];
+      }
+    }
+    if (not pending[record->clv_index]) {
+      wave.push_back(record);
+    }
+  }
+
+  const bool use_repeats = partition->attributes & PLL_ATTRIB_SITE_REPEATS;
+  const bool use_tipchars = partition->attributes & PLL_ATTRIB_PATTERN_TIP;
+  const auto is_tip_tip = [partition](const pll_operation_t& op) {
+    return op.child1_clv_index < partition->tips and op.child2_clv_index < partition->tips;
+  };
+  std::vector<pll_operation_t> operations;
+  size_t num_done = 0;
+
+  while (not wave.empty()) {
+    operations.resize(wave.size());
+    for (size_t i = 0; i < wave.size(); ++i) {
+      const auto node = wave[i];
+      auto& op = operations[i];
+      op.parent_clv_index     = node->clv_index;
+      op.parent_scaler_index  = node->scaler_index;
+      op.child1_clv_index     = node->next->back->clv_index;
+      op.child1_scaler_index  = node->next->back->scaler_index;
+      op.child1_matrix_index  = node->next->back->pmatrix_index;
+      op.child2_clv_index     = node->next->next->back->clv_index;
+      op.child2_scaler_index  = node->next->next->back->scaler_index;
+      op.child2_matrix_index  = node->next->next->back->pmatrix_index;
     }
 
-    /* given the computed traversal descriptor, generate the operations
-       structure, and the corresponding probability matrix indices that
-       may need recomputing */
-    pll_utree_create_operations(&travbuffer[0],
-                                traversal_size,
-                                &branch_lengths[0],
-                                &matrix_indices[0],
-                                &operations[0],
-                                &num_matrices,
-                                &num_ops);
-
-    if( not pll_update_prob_matrices(
-            partition,
-            &param_indices[ 0 ], // use model 0
-            &matrix_indices[ 0 ], // matrices to update
-            &branch_lengths[ 0 ],
-            num_matrices ) // how many should be updated
-    ) {
-      throw std::runtime_error { std::string( pll_errmsg ) };
+    if (use_repeats) {
+      pll_update_partials(partition, &operations[0], operations.size());
+    } else {
+      size_t num_serial = 0;
+      if (use_tipchars) {
+        const auto tip_tip_end = std::stable_partition(operations.begin(), operations.end(), is_tip_tip);
+        num_serial = std::distance(operations.begin(), tip_tip_end);
+        if (num_serial) {
+          pll_update_partials(partition, &operations[0], num_serial);
+        }
+      }
+#ifdef __OMP
+      #pragma omp parallel for schedule(dynamic)
+#endif
+      for (size_t i = num_serial; i < operations.size(); ++i) {
+        pll_update_partials(partition, &operations[i], 1);
+      }
     }
+    num_done += wave.size();
 
-    /* use the operations array to compute all num_ops inner CLVs. Operations
-       will be carried out sequentially starting from operation 0 towrds num_ops-1 */
-    pll_update_partials(partition, &operations[0], num_ops);
+    // release the operations that only waited on this wave
+    std::vector<pll_unode_t*> next_wave;
+    for (auto const node : wave) {
+      for (auto const dependent : dependents[node->clv_index]) {
+        if (not --pending[dependent->clv_index]) {
+          next_wave.push_back(dependent);
+        }
+      }
+    }
+    wave = std::move(next_wave);
+  }
+
+  if (num_done != records.size()) {
+    throw std::runtime_error{"Could not resolve the CLV dependencies of the reference tree."};
   }
+
   utree_free_node_data(root);
 }
 
+/**
+  Computes the probability matrices of all branches, without touching any CLV.
+  Used when the CLVs themselves come from elsewhere (see io/Shared_Store.hpp).
+*/
+void precompute_pmatrices(pll_utree_t const * const tree,
+                          pll_partition_t * partition,
+                          const Tree_Numbers& nums)
+{
+  std::vector<unsigned int> param_indices(partition->rate_cats, 0);
+  std::vector<pll_unode_t*> branches(nums.branches);
+  std::vector<double> branch_lengths(nums.branches);
+  std::vector<unsigned int> matrix_indices(nums.branches);
+
+  const auto num_branches = utree_query_branches(tree, &branches[0]);
+
+  for (size_t i = 0; i < num_branches; ++i) {
+    branch_lengths[i] = branches[i]->length;
+    matrix_indices[i] = branches[i]->pmatrix_index;
+  }
+
+  if( not pll_update_prob_matrices(
+          partition,
+          &param_indices[ 0 ],
+          &matrix_indices[ 0 ],
+          &branch_lengths[ 0 ],
+          num_branches )
+  ) {
+    throw std::runtime_error { std::string( pll_errmsg ) };
+  }
+}
+
 void split_combined_msa(MSA& source,
                         MSA& target,
                         Tree& tree)
@@ -19,6 +19,9 @@ void link_tree_msa( pll_utree_t * tree,
 void precompute_clvs( pll_utree_t const * const tree, 
                       pll_partition_t * partition, 
                       const Tree_Numbers& nums);
+void precompute_pmatrices(pll_utree_t const * const tree,
+                          pll_partition_t * partition,
+                          const Tree_Numbers& nums);
 void split_combined_msa(MSA& source, 
                         MSA& target, 
                         Tree& tree);
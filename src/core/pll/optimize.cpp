@@ -7,6 +7,13 @@
 #include <stdexcept>
 #include <limits>
 #include <algorithm>
+#include <numeric>
+#include <iterator>
+#include <string>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
 
 #include "core/pll/pll_util.hpp"
 #include "util/constants.hpp"
@@ -310,8 +317,657 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
   return loglikelihood;
 }
 
-#include <sstream>
-#include <iterator>
+// the site ranges handed to the threads should not get too small to be worth the overhead
+constexpr unsigned int MIN_SITES_PER_THREAD = 500;
+
+/**
+ * Likelihood evaluation on the full reference tree, split by site ranges across threads.
+ *
+ * Each range is a partition of its own that shares the model parameters with the full
+ * partition and points into its CLV, tip and scaler buffers (see shift_partition_focus),
+ * but has its own probability matrices and lookup tables, such that the ranges can be
+ * computed concurrently. The per-range log-likelihoods are then summed up.
+ *
+ * Falls back to using the full partition as the only range if it can't be split
+ * (site repeats, per-rate scalers, ascertainment bias) or there is only one thread.
+ *
+ * As the topology does not change during optimization, the traversal is only computed once.
+ */
+class Site_Parallel_Likelihood
+{
+public:
+  Site_Parallel_Likelihood( pll_partition_t * partition,
+                            pll_utree_t const * const tree,
+                            const Tree_Numbers& nums);
+  ~Site_Parallel_Likelihood();
+
+  Site_Parallel_Likelihood(Site_Parallel_Likelihood const& other) = delete;
+  Site_Parallel_Likelihood& operator= (Site_Parallel_Likelihood const& other) = delete;
+
+  pll_partition_t * partition() { return partition_; }
+  pll_unode_t * root() { return root_; }
+  size_t num_ranges() const { return ranges_.size(); }
+
+  double compute_all();
+  double edge_loglh(pll_unode_t const * const node);
+  void update_partial(pll_unode_t const * const node);
+  void set_branch_length(pll_unode_t * node, const double length);
+  void prepare_sumtable(pll_unode_t const * const node);
+  void derivatives( pll_unode_t const * const node,
+                    const double length,
+                    double * df,
+                    double * ddf);
+
+private:
+  template <class Func>
+  double sum_over_ranges_(Func func);
+  void update_pmatrices_( unsigned int const * const matrix_indices,
+                          double const * const branch_lengths,
+                          const unsigned int num_matrices);
+  pll_partition_t * make_range_( const unsigned int begin, const unsigned int span);
+  void destroy_range_(pll_partition_t * range);
+
+  pll_partition_t * partition_;
+  pll_unode_t * root_;
+  bool split_ = false;
+  std::vector<pll_partition_t*> ranges_;
+  std::vector<double*> sumtables_;
+  std::vector<unsigned int> param_indices_;
+  std::vector<pll_unode_t*> branches_;
+  std::vector<pll_operation_t> operations_;
+};
+
+Site_Parallel_Likelihood::Site_Parallel_Likelihood( pll_partition_t * partition,
+                                                    pll_utree_t const * const tree,
+                                                    const Tree_Numbers& nums)
+  : partition_(partition)
+  , root_(get_root(tree))
+  , param_indices_(partition->rate_cats, 0)
+  , branches_(nums.branches)
+{
+  unsigned int num_threads = 1;
+#ifdef __OMP
+  num_threads = omp_get_max_threads();
+#endif
+  num_threads = std::max(1u, std::min(num_threads, partition_->sites / MIN_SITES_PER_THREAD));
+
+  split_ = num_threads > 1
+      and not (partition_->attributes & PLL_ATTRIB_SITE_REPEATS)
+      and not (partition_->attributes & PLL_ATTRIB_RATE_SCALERS)
+      and not (partition_->attributes & PLL_ATTRIB_AB_FLAG);
+
+  if (split_) {
+    const unsigned int sites = partition_->sites;
+    for (unsigned int i = 0; i < num_threads; ++i) {
+      const unsigned int begin  = (sites * i) / num_threads;
+      const unsigned int end    = (sites * (i + 1)) / num_threads;
+      ranges_.push_back(make_range_(begin, end - begin));
+    }
+  } else {
+    ranges_.push_back(partition_);
+  }
+
+  for (auto const range : ranges_) {
+    auto sites_alloc = range->sites;
+    if (range->attributes & PLL_ATTRIB_AB_FLAG) {
+      sites_alloc += range->states;
+    }
+    auto sumtable = static_cast<double *>(
+      pll_aligned_alloc(sites_alloc * range->rate_cats * range->states_padded * sizeof(double),
+                        range->alignment));
+    if (sumtable == nullptr) {
+      throw std::runtime_error{"Cannot allocate memory for bl opt variables"};
+    }
+    sumtables_.push_back(sumtable);
+  }
+
+  // compute the traversal once
+  const auto num_branches = utree_query_branches(tree, &branches_[0]);
+  branches_.resize(num_branches);
+
+  std::vector<pll_unode_t*> travbuffer(nums.nodes);
+  std::vector<double> branch_lengths(nums.branches);
+  std::vector<unsigned int> matrix_indices(nums.branches);
+  operations_.resize(nums.nodes);
+  unsigned int traversal_size = 0;
+  unsigned int num_matrices = 0;
+  unsigned int num_ops = 0;
+
+  if (pll_utree_traverse( root_,
+                          PLL_TREE_TRAVERSE_POSTORDER,
+                          cb_full_traversal,
+                          &travbuffer[0],
+                          &traversal_size) != PLL_SUCCESS) {
+    throw std::runtime_error{"Function pll_unode_traverse() requires inner nodes as parameters"};
+  }
+
+  pll_utree_create_operations(&travbuffer[0],
+                              traversal_size,
+                              &branch_lengths[0],
+                              &matrix_indices[0],
+                              &operations_[0],
+                              &num_matrices,
+                              &num_ops);
+  operations_.resize(num_ops);
+}
+
+Site_Parallel_Likelihood::~Site_Parallel_Likelihood()
+{
+  for (auto sumtable : sumtables_) {
+    pll_aligned_free(sumtable);
+  }
+  if (split_) {
+    for (auto range : ranges_) {
+      destroy_range_(range);
+    }
+  }
+}
+
+pll_partition_t * Site_Parallel_Likelihood::make_range_(const unsigned int begin,
+                                                        const unsigned int span)
+{
+  const auto full = partition_;
+
+  pll_partition_t * range = pll_partition_create(
+    full->tips,
+    full->clv_buffers,
+    full->states,
+    span,
+    full->rate_matrices,
+    full->prob_matrices,
+    full->rate_cats,
+    full->scale_buffers,
+    full->attributes);
+
+  if( not range ) {
+    throw std::runtime_error { std::string( pll_errmsg ) };
+  }
+
+  // set up the tip char map the same way as in the full partition
+  const bool use_tipchars = full->attributes & PLL_ATTRIB_PATTERN_TIP;
+  if (use_tipchars) {
+    std::string sequence(span, 'A');
+    if( pll_set_tip_states(range, 0, get_char_map(full), sequence.c_str()) == PLL_FAILURE) {
+      throw std::runtime_error{"Error setting tip state"};
+    }
+  }
+
+  // shallow copy the model parameters
+  unsigned int i;
+  free(range->rates);
+  range->rates = full->rates;
+  free(range->rate_weights);
+  range->rate_weights = full->rate_weights;
+  for (i = 0; i < range->rate_matrices; ++i) {
+    pll_aligned_free(range->subst_params[i]);
+    pll_aligned_free(range->frequencies[i]);
+    pll_aligned_free(range->eigenvecs[i]);
+    pll_aligned_free(range->inv_eigenvecs[i]);
+    pll_aligned_free(range->eigenvals[i]);
+  }
+  free(range->subst_params);
+  range->subst_params = full->subst_params;
+  free(range->frequencies);
+  range->frequencies = full->frequencies;
+  free(range->eigenvecs);
+  range->eigenvecs = full->eigenvecs;
+  free(range->inv_eigenvecs);
+  range->inv_eigenvecs = full->inv_eigenvecs;
+  free(range->eigenvals);
+  range->eigenvals = full->eigenvals;
+  free(range->prop_invar);
+  range->prop_invar = full->prop_invar;
+  free(range->eigen_decomp_valid);
+  range->eigen_decomp_valid = full->eigen_decomp_valid;
+
+  // point the per-site buffers into the full partition, then shift them to the range
+  for (i = 0; i < range->tips + range->clv_buffers; ++i) {
+    pll_aligned_free(range->clv[i]);
+    range->clv[i] = full->clv[i];
+  }
+  if (use_tipchars) {
+    for (i = 0; i < range->tips; ++i) {
+      pll_aligned_free(range->tipchars[i]);
+      range->tipchars[i] = full->tipchars[i];
+    }
+  }
+  for (i = 0; i < range->scale_buffers; ++i) {
+    pll_aligned_free(range->scale_buffer[i]);
+    range->scale_buffer[i] = full->scale_buffer[i];
+  }
+  free(range->pattern_weights);
+  range->pattern_weights = full->pattern_weights;
+  if (range->invariant) {
+    free(range->invariant);
+  }
+  range->invariant = full->invariant;
+
+  shift_partition_focus(range, begin, span);
+
+  return range;
+}
+
+void Site_Parallel_Likelihood::destroy_range_(pll_partition_t * range)
+{
+  // unset shallow copied things
+  range->rates              = nullptr;
+  range->rate_weights       = nullptr;
+  range->subst_params       = nullptr;
+  range->frequencies        = nullptr;
+  range->eigenvecs          = nullptr;
+  range->inv_eigenvecs      = nullptr;
+  range->eigenvals          = nullptr;
+  range->prop_invar         = nullptr;
+  range->invariant          = nullptr;
+  range->eigen_decomp_valid = nullptr;
+  range->pattern_weights    = nullptr;
+
+  for (size_t i = 0; i < range->tips + range->clv_buffers; ++i) {
+    range->clv[i] = nullptr;
+  }
+  if (range->attributes & PLL_ATTRIB_PATTERN_TIP) {
+    for (size_t i = 0; i < range->tips; ++i) {
+      range->tipchars[i] = nullptr;
+    }
+  }
+  for (size_t i = 0; i < range->scale_buffers; ++i) {
+    range->scale_buffer[i] = nullptr;
+  }
+
+  pll_partition_destroy(range);
+}
+
+template <class Func>
+double Site_Parallel_Likelihood::sum_over_ranges_(Func func)
+{
+  std::vector<double> results(ranges_.size(), 0.0);
+
+#ifdef __OMP
+  #pragma omp parallel for schedule(static)
+#endif
+  for (size_t i = 0; i < ranges_.size(); ++i) {
+    results[i] = func(ranges_[i], i);
+  }
+
+  // summed in fixed order, so the result does not depend on thread timing
+  return std::accumulate(std::begin(results), std::end(results), 0.0);
+}
+
+void Site_Parallel_Likelihood::update_pmatrices_( unsigned int const * const matrix_indices,
+                                                  double const * const branch_lengths,
+                                                  const unsigned int num_matrices)
+{
+  // updates the eigen decomposition shared by all ranges, if needed
+  if( not pll_update_prob_matrices( partition_,
+                                    &param_indices_[0],
+                                    matrix_indices,
+                                    branch_lengths,
+                                    num_matrices) ) {
+    throw std::runtime_error { std::string( pll_errmsg ) };
+  }
+
+  if (split_) {
+    sum_over_ranges_([&](pll_partition_t * range, size_t) {
+      pll_update_prob_matrices( range,
+                                &param_indices_[0],
+                                matrix_indices,
+                                branch_lengths,
+                                num_matrices);
+      return 0.0;
+    });
+  }
+}
+
+/**
+  Recomputes all probability matrices and all CLVs oriented toward the root, as needed
+  after a change of the model parameters. Returns the log-likelihood of the tree.
+*/
+double Site_Parallel_Likelihood::compute_all()
+{
+  std::vector<double> branch_lengths(branches_.size());
+  std::vector<unsigned int> matrix_indices(branches_.size());
+
+  for (size_t i = 0; i < branches_.size(); ++i) {
+    branch_lengths[i] = branches_[i]->length;
+    matrix_indices[i] = branches_[i]->pmatrix_index;
+  }
+
+  update_pmatrices_(&matrix_indices[0], &branch_lengths[0], branches_.size());
+
+  sum_over_ranges_([this](pll_partition_t * range, size_t) {
+    pll_update_partials(range, &operations_[0], operations_.size());
+    return 0.0;
+  });
+
+  return edge_loglh(root_);
+}
+
+double Site_Parallel_Likelihood::edge_loglh(pll_unode_t const * const node)
+{
+  return sum_over_ranges_([this, node](pll_partition_t * range, size_t) {
+    return pll_compute_edge_loglikelihood(range,
+                                          node->clv_index,
+                                          node->scaler_index,
+                                          node->back->clv_index,
+                                          node->back->scaler_index,
+                                          node->pmatrix_index,
+                                          &param_indices_[0],
+                                          nullptr);
+  });
+}
+
+/**
+  Recomputes the CLV of the given inner node, from the CLVs of its two other neighbours.
+*/
+void Site_Parallel_Likelihood::update_partial(pll_unode_t const * const node)
+{
+  assert(node->next);
+
+  pll_operation_t op;
+  op.parent_clv_index     = node->clv_index;
+  op.parent_scaler_index  = node->scaler_index;
+  op.child1_clv_index     = node->next->back->clv_index;
+  op.child1_scaler_index  = node->next->back->scaler_index;
+  op.child1_matrix_index  = node->next->back->pmatrix_index;
+  op.child2_clv_index     = node->next->next->back->clv_index;
+  op.child2_scaler_index  = node->next->next->back->scaler_index;
+  op.child2_matrix_index  = node->next->next->back->pmatrix_index;
+
+  sum_over_ranges_([&op](pll_partition_t * range, size_t) {
+    pll_update_partials(range, &op, 1);
+    return 0.0;
+  });
+}
+
+void Site_Parallel_Likelihood::set_branch_length(pll_unode_t * node, const double length)
+{
+  node->length = node->back->length = length;
+  update_pmatrices_(&node->pmatrix_index, &length, 1);
+}
+
+void Site_Parallel_Likelihood::prepare_sumtable(pll_unode_t const * const node)
+{
+  sum_over_ranges_([this, node](pll_partition_t * range, size_t i) {
+    pll_update_sumtable(range,
+                        node->clv_index,
+                        node->back->clv_index,
+                        node->scaler_index,
+                        node->back->scaler_index,
+                        &param_indices_[0],
+                        sumtables_[i]);
+    return 0.0;
+  });
+}
+
+void Site_Parallel_Likelihood::derivatives( pll_unode_t const * const node,
+                                            const double length,
+                                            double * df,
+                                            double * ddf)
+{
+  std::vector<double> ddfs(ranges_.size(), 0.0);
+
+  *df = sum_over_ranges_([&](pll_partition_t * range, size_t i) {
+    double range_df = 0.0;
+    pll_compute_likelihood_derivatives( range,
+                                        node->scaler_index,
+                                        node->back->scaler_index,
+                                        length,
+                                        &param_indices_[0],
+                                        sumtables_[i],
+                                        &range_df,
+                                        &ddfs[i]);
+    return range_df;
+  });
+
+  *ddf = std::accumulate(std::begin(ddfs), std::end(ddfs), 0.0);
+}
+
+struct Edge_Newton_Params
+{
+  Site_Parallel_Likelihood * lh;
+  pll_unode_t const * node;
+};
+
+static void site_parallel_derivative_func(void * parameters,
+                                          double proposal,
+                                          double *df,
+                                          double *ddf)
+{
+  auto params = static_cast<Edge_Newton_Params*>(parameters);
+  params->lh->derivatives(params->node, proposal, df, ddf);
+}
+
+/**
+  Newton-Raphson optimization of a single branch length. Expects the CLVs on both ends of
+  the branch to be up to date. Keeps the old length if the new one does not improve the logl.
+*/
+static double optimize_edge(Site_Parallel_Likelihood& lh, pll_unode_t * node)
+{
+  int const max_iters = 30;
+
+  const auto old_length = node->length;
+  const auto old_logl = lh.edge_loglh(node);
+
+  const double xmin = PLLMOD_OPT_MIN_BRANCH_LEN;
+  const double xmax = PLLMOD_OPT_MAX_BRANCH_LEN;
+  const double xtol = xmin / 10.0;
+  double xguess = old_length;
+
+  if ( (xguess < xmin) or (xguess > xmax) ) {
+    xguess = PLLMOD_OPT_DEFAULT_BRANCH_LEN;
+  }
+
+  lh.prepare_sumtable(node);
+
+  Edge_Newton_Params params{&lh, node};
+  const double xres = pllmod_opt_minimize_newton( xmin,
+                                                  xguess,
+                                                  xmax,
+                                                  xtol,
+                                                  max_iters,
+                                                  &params,
+                                                  site_parallel_derivative_func);
+  if (xres <= 0.0) {
+    return old_logl;
+  }
+
+  lh.set_branch_length(node, xres);
+  const auto new_logl = lh.edge_loglh(node);
+
+  if (new_logl < old_logl) {
+    lh.set_branch_length(node, old_length);
+    return old_logl;
+  }
+
+  return new_logl;
+}
+
+/**
+  Optimizes the branch between node and node->back, then recursively all branches in the
+  subtree behind node->back. Expects the CLVs of node and node->back to be valid toward
+  each other, and on return leaves the CLV of node->back valid toward node.
+*/
+static void smooth_subtree(Site_Parallel_Likelihood& lh, pll_unode_t * node)
+{
+  optimize_edge(lh, node);
+
+  const auto back = node->back;
+  if (not back->next) {
+    return;
+  }
+
+  for (auto child : {back->next, back->next->next}) {
+    lh.update_partial(child);
+    smooth_subtree(lh, child);
+  }
+
+  lh.update_partial(back);
+}
+
+static double optimize_branch_lengths(Site_Parallel_Likelihood& lh,
+                                      double lnl_monitor,
+                                      int smoothings)
+{
+  const auto root = lh.root();
+  auto cur_logl = lh.edge_loglh(root);
+
+  while (smoothings--) {
+    const auto prev_logl = cur_logl;
+
+    smooth_subtree(lh, root);
+    smooth_subtree(lh, root->back);
+
+    cur_logl = lh.edge_loglh(root);
+
+    if (fabs(cur_logl - prev_logl) < OPT_BRANCH_EPSILON) {
+      break;
+    }
+  }
+
+  if (cur_logl+1e-6 < lnl_monitor) {
+    throw std::runtime_error{std::string("cur_logl < lnl_monitor: ")
+                        + std::to_string(cur_logl)
+                        + std::string(" : ")
+                        + std::to_string(lnl_monitor)};
+  }
+
+  return cur_logl;
+}
+
+struct Subst_Rate_Params
+{
+  Site_Parallel_Likelihood * lh;
+  // per substitution rate: index into the free parameters, or -1 if fixed to 1.0
+  std::vector<int> free_index;
+  std::vector<double> rates;
+};
+
+static void apply_subst_rates(Subst_Rate_Params& params, double const * const x)
+{
+  for (size_t i = 0; i < params.rates.size(); ++i) {
+    params.rates[i] = params.free_index[i] < 0 ? 1.0 : x[params.free_index[i]];
+  }
+  pll_set_subst_params(params.lh->partition(), 0, &params.rates[0]);
+}
+
+static double subst_rates_target(void * parameters, double * x)
+{
+  auto params = static_cast<Subst_Rate_Params*>(parameters);
+  apply_subst_rates(*params, x);
+  return -params->lh->compute_all();
+}
+
+/**
+  L-BFGS-B optimization of the substitution rates, respecting the symmetries of the model.
+  The rates of the same symmetry class as the last rate are fixed to 1.0
+*/
+static double optimize_subst_rates( Site_Parallel_Likelihood& lh,
+                                    const std::vector<int>& symmetries)
+{
+  const auto partition = lh.partition();
+  const auto num_rates = pllmod_util_subst_rate_count(partition->states);
+
+  Subst_Rate_Params params;
+  params.lh = &lh;
+  params.rates.assign(partition->subst_params[0], partition->subst_params[0] + num_rates);
+  params.free_index.assign(num_rates, -1);
+
+  std::vector<double> x;
+  if (symmetries.size() == num_rates) {
+    std::vector<int> class_index(*std::max_element(std::begin(symmetries), std::end(symmetries)) + 1, -1);
+    for (size_t i = 0; i < num_rates; ++i) {
+      const auto sym_class = symmetries[i];
+      if (sym_class == symmetries.back()) {
+        continue;
+      }
+      if (class_index[sym_class] < 0) {
+        class_index[sym_class] = x.size();
+        x.push_back(params.rates[i]);
+      }
+      params.free_index[i] = class_index[sym_class];
+    }
+  } else {
+    for (size_t i = 0; i + 1 < num_rates; ++i) {
+      params.free_index[i] = x.size();
+      x.push_back(params.rates[i]);
+    }
+  }
+
+  if (x.empty()) {
+    return lh.edge_loglh(lh.root());
+  }
+
+  for (auto& rate : x) {
+    rate = std::min(std::max(rate, OPT_RATE_MIN), OPT_RATE_MAX);
+  }
+
+  std::vector<double> min_rates(x.size(), OPT_RATE_MIN);
+  std::vector<double> max_rates(x.size(), OPT_RATE_MAX);
+  std::vector<int> bound_type(x.size(), PLLMOD_OPT_LBFGSB_BOUND_BOTH);
+
+  pllmod_opt_minimize_lbfgsb( &x[0],
+                              &min_rates[0],
+                              &max_rates[0],
+                              &bound_type[0],
+                              x.size(),
+                              OPT_FACTR,
+                              OPT_PARAM_EPSILON,
+                              &params,
+                              subst_rates_target);
+
+  // ensure the partition reflects the solution, not just the last evaluated point
+  apply_subst_rates(params, &x[0]);
+  return lh.compute_all();
+}
+
+struct Alpha_Params
+{
+  Site_Parallel_Likelihood * lh;
+  int gamma_mode;
+  std::vector<double> rates;
+};
+
+static void apply_alpha(Alpha_Params& params, const double alpha)
+{
+  const auto partition = params.lh->partition();
+  pll_compute_gamma_cats(alpha, partition->rate_cats, &params.rates[0], params.gamma_mode);
+  pll_set_category_rates(partition, &params.rates[0]);
+}
+
+static double alpha_target(void * parameters, double alpha)
+{
+  auto params = static_cast<Alpha_Params*>(parameters);
+  apply_alpha(*params, alpha);
+  return -params->lh->compute_all();
+}
+
+static double optimize_alpha(Site_Parallel_Likelihood& lh, raxml::Model& model)
+{
+  const auto partition = lh.partition();
+  if (partition->rate_cats < 2) {
+    return lh.edge_loglh(lh.root());
+  }
+
+  Alpha_Params params{&lh, model.gamma_mode(), std::vector<double>(partition->rate_cats)};
+
+  const double xmin = 0.02;
+  const double xmax = 10000.;
+  const double xguess = std::min(std::max(model.alpha(), xmin), xmax);
+  double fx, f2x;
+
+  const auto alpha = pllmod_opt_minimize_brent( xmin,
+                                                xguess,
+                                                xmax,
+                                                OPT_PARAM_EPSILON,
+                                                &fx,
+                                                &f2x,
+                                                &params,
+                                                alpha_target);
+  apply_alpha(params, alpha);
+  model.alpha(alpha);
+  return lh.compute_all();
+}
+
 
 double optimize_branch_triplet( pll_partition_t * partition,
                                 pll_unode_t * root,
@@ -368,72 +1024,10 @@ double optimize_branch_triplet( pll_partition_t * partition,
   return cur_logl;
 }
 
-static double optimize_branch_lengths(pll_unode_t * root,
-                                      pll_partition_t * partition,
-                                      pll_optimize_options_t& params,
-                                      pll_unode_t ** travbuffer,
-                                      double cur_logl,
-                                      double lnl_monitor,
-                                      int* smoothings)
-{
-  if (!root->next) {
-    root = root->back;
-  }
-
-  traverse_update_partials( root,
-                            partition,
-                            travbuffer,
-                            params.lk_params.branch_lengths,
-                            params.lk_params.matrix_indices,
-                            params.lk_params.operations);
-
-  pll_errno = 0; // hotfix
-
-  std::vector<unsigned int> param_indices(partition->rate_cats, 0);
-
-  cur_logl = -1 * pllmod_opt_optimize_branch_lengths_iterative(
-    partition,
-    root,
-    &param_indices[0],
-    PLLMOD_OPT_MIN_BRANCH_LEN,
-    PLLMOD_OPT_MAX_BRANCH_LEN,
-    OPT_BRANCH_EPSILON,
-    *smoothings,
-    1); // keep updating BLs during call
-
-  if (cur_logl+1e-6 < lnl_monitor) {
-    throw std::runtime_error{std::string("cur_logl < lnl_monitor: ")
-                        + std::to_string(cur_logl)
-                        + std::string(" : ")
-                        + std::to_string(lnl_monitor)};
-  }
-
-  // reupdate the indices as they may have changed
-  params.lk_params.where.unrooted_t.parent_clv_index = root->clv_index;
-  params.lk_params.where.unrooted_t.parent_scaler_index = root->scaler_index;
-  params.lk_params.where.unrooted_t.child_clv_index = root->back->clv_index;
-  params.lk_params.where.unrooted_t.child_scaler_index = root->back->scaler_index;
-  params.lk_params.where.unrooted_t.edge_pmatrix_index = root->pmatrix_index;
-
-  traverse_update_partials( root,
-                            partition,
-                            travbuffer,
-                            params.lk_params.branch_lengths,
-                            params.lk_params.matrix_indices,
-                            params.lk_params.operations);
-
-  cur_logl = pll_compute_edge_loglikelihood(partition,
-                                            root->clv_index,
-                                            root->scaler_index,
-                                            root->back->clv_index,
-                                            root->back->scaler_index,
-                                            root->pmatrix_index,
-                                            &param_indices[0],
-                                            nullptr);
-
-  return cur_logl;
-}
-
+/**
+ * Optimizes the model parameters and/or branch lengths of the reference tree.
+ * Likelihood evaluations are split by site ranges across threads (see Site_Parallel_Likelihood).
+ */
 void optimize(raxml::Model& model,
               pll_utree_t * const tree,
               pll_partition_t * partition,
@@ -446,154 +1040,42 @@ void optimize(raxml::Model& model,
     return;
   }
 
-  const auto root = get_root(tree);
-
   if (opt_branches) {
     set_branch_lengths(tree, DEFAULT_BRANCH_LENGTH);
   }
 
   compute_and_set_empirical_frequencies(partition, model);
 
-  std::vector<int> symmetries = model.submodel(0).rate_sym();
-  std::vector<unsigned int> param_indices(model.num_ratecats(), 0);
+  const std::vector<int> symmetries = model.submodel(0).rate_sym();
 
-  // sadly we explicitly need these buffers here and in the params structure
-  std::vector<pll_unode_t*> travbuffer(nums.nodes);
-  std::vector<double> branch_lengths(nums.branches);
-  std::vector<unsigned int> matrix_indices(nums.branches);
-  std::vector<pll_operation_t> operations(nums.nodes);
-
-  traverse_update_partials( root,
-                            partition,
-                            &travbuffer[0],
-                            &branch_lengths[0],
-                            &matrix_indices[0],
-                            &operations[0]);
+  Site_Parallel_Likelihood lh(partition, tree, nums);
+  LOG_DBG << "Optimizing using " << lh.num_ranges() << " site range(s)";
 
   // compute logl once to give us a logl starting point
-  auto cur_logl = pll_compute_edge_loglikelihood( partition,
-                                                  root->clv_index,
-                                                  root->scaler_index,
-                                                  root->back->clv_index,
-                                                  root->back->scaler_index,
-                                                  root->pmatrix_index,
-                                                  &param_indices[0],
-                                                  nullptr);
-
-  // double cur_logl = -numeric_limits<double>::infinity();
-  int smoothings;
-  double lnl_monitor = cur_logl;
-
-  // set up high level options structure
-  pll_optimize_options_t params;
-  params.lk_params.partition = partition;
-  params.lk_params.operations = &operations[0];
-  params.lk_params.branch_lengths = &branch_lengths[0];
-  params.lk_params.matrix_indices = &matrix_indices[0];
-  params.lk_params.params_indices = &param_indices[0];
-  params.lk_params.alpha_value = model.alpha();
-  params.lk_params.rooted = 0;
-  params.lk_params.where.unrooted_t.parent_clv_index = root->clv_index;
-  params.lk_params.where.unrooted_t.parent_scaler_index = root->scaler_index;
-  params.lk_params.where.unrooted_t.child_clv_index = root->back->clv_index;
-  params.lk_params.where.unrooted_t.child_scaler_index =
-    root->back->scaler_index;
-  params.lk_params.where.unrooted_t.edge_pmatrix_index = root->pmatrix_index;
-
-  /* optimization parameters */
-  params.params_index = 0;
-  params.subst_params_symmetries = &symmetries[0];
-  params.factr = OPT_FACTR;
-  params.pgtol = OPT_PARAM_EPSILON;
-
-  std::vector<pll_unode_t*> branches(nums.branches);
-  auto num_traversed = utree_query_branches(tree, &branches[0]);
-  assert (num_traversed == nums.branches);
-  unsigned int branch_index = 0;
+  auto cur_logl = lh.compute_all();
+  const double lnl_monitor = cur_logl;
 
   double logl = cur_logl;
 
   if (opt_branches) {
-    smoothings = 8;
-    cur_logl = optimize_branch_lengths( branches[branch_index],
-                                        partition,
-                                        params,
-                                        &travbuffer[0],
-                                        cur_logl,
-                                        lnl_monitor,
-                                        &smoothings);
+    cur_logl = optimize_branch_lengths(lh, lnl_monitor, 8);
   }
 
-  const auto rates_size = model.subst_rates(0).size();
-
-  std::vector<double> min_rates(rates_size, OPT_RATE_MIN);
-  std::vector<double> max_rates(rates_size, OPT_RATE_MAX);
-
   do {
-    branch_index = rand () % num_traversed;
-
-    // LOG_INFO << "Start: " << to_string(cur_logl) << "\n";
     logl = cur_logl;
 
     if (opt_model) {
-
-      params.which_parameters = PLLMOD_OPT_PARAM_SUBST_RATES;
-      cur_logl = -pllmod_opt_optimize_multidim(&params, &min_rates[0], &max_rates[0]);
-
-      // LOG_INFO << "after rates: " << to_string(cur_logl) << "\n";
+      cur_logl = optimize_subst_rates(lh, symmetries);
 
       if (opt_branches) {
-        smoothings = 2;
-        cur_logl = optimize_branch_lengths( branches[branch_index],
-                                            partition,
-                                            params,
-                                            &travbuffer[0],
-                                            cur_logl,
-                                            lnl_monitor,
-                                            &smoothings);
-
-        // LOG_INFO << "after blo 1: " << to_string(cur_logl) << "\n";
-
+        cur_logl = optimize_branch_lengths(lh, lnl_monitor, 2);
       }
 
-      // params.which_parameters = PLL_PARAMETER_FREQUENCIES;
-      // pll_optimize_parameters_multidim(&params, nullptr, nullptr);
-
-      if (opt_branches) {
-        smoothings = 2;
-        cur_logl = optimize_branch_lengths( branches[branch_index],
-                                            partition,
-                                            params,
-                                            &travbuffer[0],
-                                            cur_logl,
-                                            lnl_monitor,
-                                            &smoothings);
-
-        // LOG_INFO << "after blo 2: " << to_string(cur_logl) << "\n";
-
-      }
-
-      // params.which_parameters = PLL_PARAMETER_PINV;
-      // cur_logl = -1 * pll_optimize_parameters_brent(&params);
-      params.which_parameters = PLLMOD_OPT_PARAM_ALPHA;
-      cur_logl = -pllmod_opt_optimize_onedim(&params, 0.02, 10000.);
-
-      // LOG_INFO << "after alpha: " << to_string(cur_logl) << "\n";
-
+      cur_logl = optimize_alpha(lh, model);
     }
 
     if (opt_branches) {
-      smoothings = 3;
-      cur_logl = optimize_branch_lengths( branches[branch_index],
-                                          partition,
-                                          params,
-                                          &travbuffer[0],
-                                          cur_logl,
-                                          lnl_monitor,
-                                          &smoothings);
-
-      // LOG_INFO << "after blo 3: " << to_string(cur_logl) << "\n";
-
+      cur_logl = optimize_branch_lengths(lh, lnl_monitor, 3);
     }
   } while (fabs (cur_logl - logl) > OPT_EPSILON);
 
@@ -6,6 +6,9 @@
 #include <stdexcept>
 #include <string>
 
+#include <cereal/types/vector.hpp>
+#include <cereal/types/string.hpp>
+
 class rtree_mapper
 {
 public:
@@ -92,6 +95,19 @@ public:
   void root_label(std::string const& s) {root_label_ = s;}
   std::string const& root_label() const {return root_label_;}
 
+  template <class Archive>
+  void serialize(Archive& archive)
+  {
+    archive(  utree_root_edge_,
+              rtree_proximal_edge_,
+              rtree_distal_edge_,
+              root_label_,
+              proximal_edge_length_,
+              distal_edge_length_,
+              left_,
+              map_ );
+  }
+
 private:
   /*
     needed to identify and deal with the special case of the root edge
@@ -2,9 +2,70 @@
 
 #include <stdexcept>
 #include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <sstream>
+#include <cmath>
+
+#include <unistd.h>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
 
 #include "util/constants.hpp"
+#include "util/logging.hpp"
+#include "io/clv_encoding.hpp"
 #include "tree/Tree.hpp"
+#include "core/Lookup_Store.hpp"
+
+#include <cereal/archives/binary.hpp>
+
+// lowest block id in use (snapshot gap mask), see dump_to_binary and dump_snapshot
+constexpr int BLOCK_ID_SHIFT = 7;
+constexpr long NO_OFFSET = -1;
+
+/**
+  Optional block describing how the CLV blocks are encoded. Absent in files storing CLVs
+  in full double precision, such that those stay readable by older versions.
+*/
+constexpr int FORMAT_BLOCK_ID = -4;
+
+struct Binary_Format
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t clv_precision;
+};
+
+static constexpr char FORMAT_MAGIC[8] = "EPACLV";
+
+/**
+  Optional blocks turning the binary file into a prepared reference snapshot: everything
+  needed to start placing right away, without the reference tree, MSA or model files.
+  The lookup tables follow the scaler blocks, one per branch.
+*/
+constexpr int SNAPSHOT_BLOCK_ID = -5;
+constexpr int MAPPER_BLOCK_ID   = -6;
+constexpr int MASK_BLOCK_ID     = -7;
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+struct Snapshot_Header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t lookup_cols;
+  uint64_t num_lookups;
+  int64_t lookup_block_id;
+};
+
+static constexpr char SNAPSHOT_MAGIC[8] = "EPASNAP";
+
+static bool is_aligned(void const * const ptr, const size_t alignment)
+{
+  return alignment == 0 or reinterpret_cast<std::uintptr_t>(ptr) % alignment == 0;
+}
 
 int safe_fclose(FILE* fptr) { return fptr ? fclose(fptr) : 0; }
 
@@ -13,12 +74,26 @@ Binary::Binary(Binary && other)
 {
   std::swap(bin_fptr_, other.bin_fptr_);
   std::swap(map_, other.map_);
+  std::swap(index_, other.index_);
+  std::swap(mmap_, other.mmap_);
+  std::swap(clv_precision_, other.clv_precision_);
+  std::swap(snapshot_, other.snapshot_);
+  std::swap(lookup_block_id_, other.lookup_block_id_);
+  std::swap(num_lookups_, other.num_lookups_);
+  std::swap(lookup_cols_, other.lookup_cols_);
 }
 
 Binary& Binary::operator=(Binary && other)
 {
   bin_fptr_ = std::move(other.bin_fptr_);
   map_ = std::move(other.map_);
+  index_ = std::move(other.index_);
+  mmap_ = std::move(other.mmap_);
+  clv_precision_ = other.clv_precision_;
+  snapshot_ = other.snapshot_;
+  lookup_block_id_ = other.lookup_block_id_;
+  num_lookups_ = other.num_lookups_;
+  lookup_cols_ = other.lookup_cols_;
   return *this;
 }
 
@@ -55,22 +130,200 @@ Binary::Binary(const std::string& binary_file_path)
   }
 
   free(block_map);
+
+  // block ids are dense, so a flat vector serves as the index
+  for (auto& block : map_) {
+    if (block.block_id + BLOCK_ID_SHIFT < 0) {
+      throw std::runtime_error{std::string("Unexpected block_id in binary file: ")
+                + std::to_string(block.block_id)};
+    }
+    const size_t pos = block.block_id + BLOCK_ID_SHIFT;
+    if (pos >= index_.size()) {
+      index_.resize(pos + 1, NO_OFFSET);
+    }
+    index_[pos] = block.block_offset;
+  }
+
+  // try to map the file. If this fails for whatever reason we still have the stream based loading
+  try {
+    mmap_ = Memory_Map::open_file(binary_file_path);
+  } catch (std::runtime_error& e) {
+    LOG_DBG << "Falling back to stream based loading of the binary file: " << e.what();
+  }
+
+  if (has_block_(FORMAT_BLOCK_ID)) {
+    const auto block = load_custom_(FORMAT_BLOCK_ID);
+
+    Binary_Format format;
+    const bool valid = (block.size() == sizeof(Binary_Format));
+    if (valid) {
+      std::memcpy(&format, block.data(), sizeof(Binary_Format));
+    }
+
+    if (not valid or std::memcmp(format.magic, FORMAT_MAGIC, sizeof(FORMAT_MAGIC)) != 0) {
+      throw std::runtime_error{"Binary file has an invalid format block."};
+    }
+    if (format.clv_precision > static_cast<uint32_t>(Options::ClvPrecision::kScaled16)) {
+      throw std::runtime_error{std::string("Binary file uses an unknown CLV encoding: ")
+                + std::to_string(format.clv_precision)};
+    }
+    clv_precision_ = static_cast<Options::ClvPrecision>(format.clv_precision);
+  }
+
+  if (has_block_(SNAPSHOT_BLOCK_ID)) {
+    const auto block = load_custom_(SNAPSHOT_BLOCK_ID);
+
+    Snapshot_Header snapshot;
+    const bool valid = (block.size() == sizeof(Snapshot_Header));
+    if (valid) {
+      std::memcpy(&snapshot, block.data(), sizeof(Snapshot_Header));
+    }
+
+    if (not valid or std::memcmp(snapshot.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+      throw std::runtime_error{"Binary file has an invalid snapshot block."};
+    }
+    if (snapshot.version != SNAPSHOT_VERSION) {
+      throw std::runtime_error{std::string("Snapshot has version ") + std::to_string(snapshot.version)
+                + ", expected " + std::to_string(SNAPSHOT_VERSION) + ". Please recreate it."};
+    }
+    snapshot_         = true;
+    lookup_block_id_  = snapshot.lookup_block_id;
+    num_lookups_      = snapshot.num_lookups;
+    lookup_cols_      = snapshot.lookup_cols;
+  }
 }
 
-static long int get_offset(std::vector<pll_block_map_t>& map, const int block_id)
+/**
+  Returns the payload of a custom block.
+*/
+std::string Binary::load_custom_(const int block_id)
 {
-  auto item = map.begin();
-  while (item != map.end()) {
-    if (item->block_id == block_id) {
-      break;
+  size_t block_len = 0;
+  auto block = mapped_block_(block_id, block_len);
+  if (block) {
+    return std::string(block, block_len);
+  }
+
+  unsigned int type = 0;
+  unsigned int attributes = 0;
+  void * ptr = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    ptr = pllmod_binary_custom_load(bin_fptr_.get(),
+                                    0,
+                                    &block_len,
+                                    &type,
+                                    &attributes,
+                                    get_offset_(block_id));
+  }
+  if (!ptr) {
+    throw std::runtime_error{std::string("Loading block ") + std::to_string(block_id)
+                            + " failed: " + pll_errmsg};
+  }
+  std::string result(static_cast<char*>(ptr), block_len);
+  free(ptr);
+  return result;
+}
+
+void Binary::load_mapper(rtree_mapper& mapper)
+{
+  if (not has_block_(MAPPER_BLOCK_ID)) {
+    return;
+  }
+  std::stringstream ss(load_custom_(MAPPER_BLOCK_ID));
+  cereal::BinaryInputArchive archive(ss);
+  archive(mapper);
+}
+
+/**
+  Returns the gap mask the reference was built with. Empty if it was built without premasking.
+*/
+MSA_Info::mask_type Binary::load_gap_mask()
+{
+  MSA_Info::mask_type mask;
+  if (has_block_(MASK_BLOCK_ID)) {
+    std::stringstream ss(load_custom_(MASK_BLOCK_ID));
+    ss >> mask;
+  }
+  return mask;
+}
+
+/**
+  Hands the precomputed lookup tables to the store. Where possible they are used
+  straight from the file mapping, otherwise they are copied.
+*/
+void Binary::load_lookups(Lookup_Store& lookups)
+{
+  if (lookups.num_branches() != num_lookups_
+      or lookups.char_map_size() != lookup_cols_) {
+    throw std::runtime_error{"Snapshot lookup tables do not match the reference tree."};
+  }
+
+  const size_t row_bytes = lookup_cols_ * sizeof(double);
+
+  for (size_t i = 0; i < num_lookups_; ++i) {
+    const int block_id = lookup_block_id_ + i;
+
+    size_t block_len = 0;
+    auto block = mapped_block_(block_id, block_len);
+    if (block and block_len % row_bytes == 0 and is_aligned(block, alignof(double))) {
+      lookups.attach_branch(i, reinterpret_cast<double const *>(block));
+      continue;
+    }
+
+    const auto data = load_custom_(block_id);
+    if (data.size() % row_bytes) {
+      throw std::runtime_error{std::string("Snapshot lookup table of unexpected size for branch ")
+                              + std::to_string(i)};
     }
-    item++;
+    std::vector<double> table(data.size() / sizeof(double));
+    std::memcpy(table.data(), data.data(), data.size());
+    lookups.init_branch(i, table.data(), data.size() / row_bytes);
   }
+}
+
+bool Binary::has_block_(const int block_id) const
+{
+  const auto pos = block_id + BLOCK_ID_SHIFT;
+  return pos >= 0 and static_cast<size_t>(pos) < index_.size() and index_[pos] != NO_OFFSET;
+}
 
-  if(item == map.end()) {
+long Binary::get_offset_(const int block_id) const
+{
+  if (not has_block_(block_id)) {
     throw std::runtime_error{std::string("Map does not contain block_id: ") + std::to_string(block_id)};
   }
-  return item->block_offset;
+  return index_[block_id + BLOCK_ID_SHIFT];
+}
+
+/**
+  Returns a pointer to the payload of the given block inside the file mapping, and sets block_len
+  accordingly. Returns nullptr if there is no mapping, or the block does not have the expected
+  (unpadded) layout, in which case the caller should resort to the stream based loading.
+*/
+char const * Binary::mapped_block_(const int block_id, size_t& block_len) const
+{
+  if (not mmap_) {
+    return nullptr;
+  }
+
+  const auto offset = static_cast<size_t>(get_offset_(block_id));
+  if (offset + sizeof(pll_block_header_t) > mmap_.size()) {
+    return nullptr;
+  }
+
+  pll_block_header_t header;
+  std::memcpy(&header, mmap_.data() + offset, sizeof(pll_block_header_t));
+
+  const auto data_offset = offset + sizeof(pll_block_header_t);
+  if (header.block_id != block_id
+      or header.alignment
+      or data_offset + header.block_len > mmap_.size()) {
+    return nullptr;
+  }
+
+  block_len = header.block_len;
+  return mmap_.data() + data_offset;
 }
 
 void Binary::load_clv(pll_partition_t * partition,
@@ -82,6 +335,31 @@ void Binary::load_clv(pll_partition_t * partition,
     assert(clv_index >= partition->tips);
   }
 
+  if (clv_precision_ != Options::ClvPrecision::kDouble) {
+    load_encoded_clv_(partition, clv_index);
+    return;
+  }
+
+  const size_t expected_size = pll_get_clv_size(partition, clv_index) * sizeof(double);
+  size_t block_len = 0;
+  auto block = mapped_block_(clv_index, block_len);
+
+  if (block and block_len == expected_size) {
+    if (!(partition->clv[clv_index]) and is_aligned(block, partition->alignment)) {
+      // zero-copy: point directly into the mapping
+      partition->clv[clv_index] = reinterpret_cast<double*>(const_cast<char*>(block));
+      return;
+    }
+    if (!(partition->clv[clv_index])) {
+      partition->clv[clv_index] = static_cast<double*>(pll_aligned_alloc(expected_size, partition->alignment));
+      if (!partition->clv[clv_index]) {
+        throw std::runtime_error{"Could not allocate CLV memory"};
+      }
+    }
+    std::memcpy(partition->clv[clv_index], block, expected_size);
+    return;
+  }
+
   if (!(partition->clv[clv_index])) {
     const size_t clv_size = pll_get_clv_size(partition, clv_index) * sizeof(double);
 
@@ -99,7 +377,7 @@ void Binary::load_clv(pll_partition_t * partition,
                                     partition,
                                     clv_index,
                                     &attributes,
-                                    get_offset(map_, clv_index));
+                                    get_offset_(clv_index));
     if (err != PLL_SUCCESS) {
       throw std::runtime_error{std::string("Loading CLV failed: ") 
                               + pll_errmsg 
@@ -109,6 +387,51 @@ void Binary::load_clv(pll_partition_t * partition,
   }
 }
 
+/**
+  Loads and decodes a reduced precision CLV (see io/clv_encoding.hpp). These always need
+  their own buffer, however decoding straight from the mapping still needs no lock.
+*/
+void Binary::load_encoded_clv_(pll_partition_t * partition, const unsigned int clv_index)
+{
+  const size_t clv_size = pll_get_clv_size(partition, clv_index);
+
+  if (!(partition->clv[clv_index])) {
+    partition->clv[clv_index] = static_cast<double*>(
+      pll_aligned_alloc(clv_size * sizeof(double), partition->alignment));
+    if (!partition->clv[clv_index]) {
+      throw std::runtime_error{"Could not allocate CLV memory"};
+    }
+  }
+
+  size_t block_len = 0;
+  auto block = mapped_block_(clv_index, block_len);
+  if (block) {
+    decode_clv(block, block_len, partition->clv[clv_index], clv_size);
+    return;
+  }
+
+  unsigned int type = 0;
+  unsigned int attributes = 0;
+  void * ptr = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    ptr = pllmod_binary_custom_load(bin_fptr_.get(),
+                                    0,
+                                    &block_len,
+                                    &type,
+                                    &attributes,
+                                    get_offset_(clv_index));
+  }
+  if (!ptr) {
+    throw std::runtime_error{std::string("Loading CLV failed: ")
+                            + pll_errmsg
+                            + std::string(". CLV index: ")
+                            + std::to_string(clv_index)};
+  }
+  decode_clv(static_cast<char*>(ptr), block_len, partition->clv[clv_index], clv_size);
+  free(ptr);
+}
+
 void Binary::load_tipchars( pll_partition_t * partition,
                             const unsigned int tipchars_index)
 {
@@ -116,6 +439,13 @@ void Binary::load_tipchars( pll_partition_t * partition,
   assert(tipchars_index < partition->tips);
   assert(partition->attributes & PLL_ATTRIB_PATTERN_TIP);
 
+  size_t block_len = 0;
+  auto block = mapped_block_(tipchars_index, block_len);
+  if (block and block_len == partition->sites * sizeof(unsigned char)) {
+    partition->tipchars[tipchars_index] = reinterpret_cast<unsigned char*>(const_cast<char*>(block));
+    return;
+  }
+
   unsigned int type = 0;
   unsigned int attributes = 0;
   size_t size = 0;
@@ -127,7 +457,7 @@ void Binary::load_tipchars( pll_partition_t * partition,
                                           &size,
                                           &type,
                                           &attributes,
-                                          get_offset(map_, tipchars_index));
+                                          get_offset_(tipchars_index));
     if (!ptr) {
       throw std::runtime_error{std::string("Loading tipchar failed: ") + pll_errmsg};
     }
@@ -143,6 +473,22 @@ void Binary::load_scaler( pll_partition_t * partition,
 
   auto block_offset = partition->clv_buffers + partition->tips;
 
+  size_t block_len = 0;
+  auto block = mapped_block_(block_offset + scaler_index, block_len);
+  if (block and block_len % sizeof(unsigned int) == 0) {
+    if (is_aligned(block, alignof(unsigned int))) {
+      partition->scale_buffer[scaler_index] = reinterpret_cast<unsigned int*>(const_cast<char*>(block));
+    } else {
+      auto ptr = static_cast<unsigned int*>(malloc(block_len));
+      if (!ptr) {
+        throw std::runtime_error{"Could not allocate scaler memory"};
+      }
+      std::memcpy(ptr, block, block_len);
+      partition->scale_buffer[scaler_index] = ptr;
+    }
+    return;
+  }
+
   unsigned int type, attributes;
   size_t size;
 
@@ -153,7 +499,7 @@ void Binary::load_scaler( pll_partition_t * partition,
                                           &size, 
                                           &type, 
                                           &attributes, 
-                                          get_offset(map_, block_offset + scaler_index));
+                                          get_offset_(block_offset + scaler_index));
     if (!ptr) {
       throw std::runtime_error{std::string("Loading scaler failed: ") + pll_errmsg};
     }
@@ -162,6 +508,33 @@ void Binary::load_scaler( pll_partition_t * partition,
   }
 }
 
+/**
+  Advises the OS that the CLV (or tipchars) block of the given index will be read soon, such
+  that its pages are read in the background. Returns false if there was nothing to advise,
+  as is the case when the file is not mapped.
+*/
+bool Binary::prefetch_clv(const unsigned int clv_index) const
+{
+  size_t block_len = 0;
+  auto block = mapped_block_(clv_index, block_len);
+  if (not block) {
+    return false;
+  }
+  mmap_.will_need(block, block_len);
+  return true;
+}
+
+bool Binary::prefetch_scaler(pll_partition_t * partition, const unsigned int scaler_index) const
+{
+  size_t block_len = 0;
+  auto block = mapped_block_(partition->clv_buffers + partition->tips + scaler_index, block_len);
+  if (not block) {
+    return false;
+  }
+  mmap_.will_need(block, block_len);
+  return true;
+}
+
 pll_partition_t* Binary::load_partition()
 {
   std::lock_guard<std::mutex> lock(file_mutex_);
@@ -171,7 +544,7 @@ pll_partition_t* Binary::load_partition()
                                                   0, 
                                                   nullptr, 
                                                   &part_attribs, 
-                                                  get_offset(map_, -1));
+                                                  get_offset_(-1));
 
   if (!partition) {
     throw std::runtime_error{std::string("Error loading partition: ") + pll_errmsg};
@@ -183,7 +556,7 @@ pll_partition_t* Binary::load_partition()
                                     0, 
                                     partition, 
                                     &repeats_attribs, 
-                                    get_offset(map_, -3))
+                                    get_offset_(-3))
         != PLL_SUCCESS) {
       throw std::runtime_error{std::string("Error loading repeats: ") + pll_errmsg};   
     }
@@ -199,7 +572,7 @@ pll_utree_t* Binary::load_utree(const unsigned int num_tips)
   auto root =  pllmod_binary_utree_load(bin_fptr_.get(), 
                                         0, 
                                         &attributes, 
-                                        get_offset(map_, -2));
+                                        get_offset_(-2));
   if (!root) {
     throw std::runtime_error{std::string("Loading tree: ") + pll_errmsg};
   }
@@ -207,62 +580,260 @@ pll_utree_t* Binary::load_utree(const unsigned int num_tips)
   return pll_utree_wraptree(root, num_tips);
 }
 
-static int full_trav(pll_unode_t*)
+/**
+  Drop a previously loaded buffer from memory again, such that it will be reloaded on next access.
+  Buffers pointing into the file mapping just have their pages discarded.
+*/
+void Binary::evict_clv(pll_partition_t * partition, const unsigned int clv_index)
 {
-  return 1;
+  auto& clv = partition->clv[clv_index];
+  if (mmap_.contains(clv)) {
+    mmap_.discard(clv, pll_get_clv_size(partition, clv_index) * sizeof(double));
+  } else {
+    pll_aligned_free(clv);
+  }
+  clv = nullptr;
 }
 
-static auto create_scaler_to_clv_map(Tree& tree)
+void Binary::evict_tipchars(pll_partition_t * partition, const unsigned int tipchars_index)
 {
-  const auto num_scalers = tree.partition()->scale_buffers;
-  std::vector<unsigned int> map(num_scalers);
+  auto& tipchars = partition->tipchars[tipchars_index];
+  if (mmap_.contains(tipchars)) {
+    mmap_.discard(tipchars, partition->sites * sizeof(unsigned char));
+  } else {
+    free(tipchars);
+  }
+  tipchars = nullptr;
+}
 
-  std::vector<pll_unode_t*> travbuffer(tree.nums().nodes);
-  unsigned int trav_size = 0;
-  pll_utree_traverse( get_root(tree.tree()),
-                      PLL_TREE_TRAVERSE_POSTORDER,
-                      full_trav, 
-                      &travbuffer[0], 
-                      &trav_size);
+void Binary::evict_scaler(pll_partition_t * partition, const unsigned int scaler_index)
+{
+  auto& scaler = partition->scale_buffer[scaler_index];
+  if (mmap_.contains(scaler)) {
+    size_t block_len = 0;
+    mapped_block_(partition->clv_buffers + partition->tips + scaler_index, block_len);
+    mmap_.discard(scaler, block_len);
+  } else {
+    free(scaler);
+  }
+  scaler = nullptr;
+}
 
-  for (auto& n : travbuffer) {
-    if (n->scaler_index != PLL_SCALE_BUFFER_NONE) {
-      map[n->scaler_index] = n->clv_index;
+/**
+  Nulls any buffer pointers of the partition that point into the file mapping,
+  such that the partition can be safely destroyed via pll_partition_destroy.
+*/
+void Binary::release(pll_partition_t * partition)
+{
+  if (not mmap_ or not partition) {
+    return;
+  }
+
+  for (size_t i = 0; i < partition->tips + partition->clv_buffers; ++i) {
+    if (mmap_.contains(partition->clv[i])) {
+      partition->clv[i] = nullptr;
     }
+  }
 
-    // node is an inner?
-    if (n->next) {
-      auto nn = n->next;
-      if (nn->scaler_index != PLL_SCALE_BUFFER_NONE) {
-        map[nn->scaler_index] = nn->clv_index;
+  if (partition->tipchars) {
+    for (size_t i = 0; i < partition->tips; ++i) {
+      if (mmap_.contains(partition->tipchars[i])) {
+        partition->tipchars[i] = nullptr;
       }
-      nn = nn->next;
-      if (nn->scaler_index != PLL_SCALE_BUFFER_NONE) {
-        map[nn->scaler_index] = nn->clv_index;
+    }
+  }
+
+  for (size_t i = 0; i < partition->scale_buffers; ++i) {
+    if (mmap_.contains(partition->scale_buffer[i])) {
+      partition->scale_buffer[i] = nullptr;
+    }
+  }
+}
+
+/**
+  Description of one data block of the binary file, as laid out by dump_to_binary.
+*/
+struct Block_Layout
+{
+  int block_id;
+  unsigned int type;
+  void const * data;
+  size_t size;
+  long offset;
+};
+
+/**
+  Determines the order in which the tipchar/CLV and scaler blocks are written: following the
+  branches in the order they are placed on (see utree_query_branches), such that lazily loading
+  the CLVs of neighbouring branches reads neighbouring regions of the file. The scaler of a CLV
+  directly follows it.
+  Also returns the CLV index each scaler belongs to, needed to determine the scaler size.
+*/
+static auto make_block_order(Tree& tree, std::vector<unsigned int>& scaler_to_clv)
+{
+  const auto partition = tree.partition();
+  const size_t num_clv_ids = partition->tips + partition->clv_buffers;
+
+  std::vector<pll_unode_t *> branches(tree.nums().branches);
+  const auto num_branches = utree_query_branches(tree.tree(), &branches[0]);
+
+  // pairs of (clv_index, scaler_index), in write order
+  std::vector<std::pair<unsigned int, unsigned int>> order;
+  std::vector<char> seen(num_clv_ids, false);
+  scaler_to_clv = std::vector<unsigned int>(partition->scale_buffers, 0);
+
+  auto visit = [&](pll_unode_t const * const node) {
+    if (seen[node->clv_index]) {
+      return;
+    }
+    seen[node->clv_index] = true;
+    order.emplace_back(node->clv_index, node->scaler_index);
+    if (node->scaler_index != PLL_SCALE_BUFFER_NONE) {
+      scaler_to_clv[node->scaler_index] = node->clv_index;
+    }
+  };
+
+  for (size_t i = 0; i < num_branches; ++i) {
+    visit(branches[i]);
+    visit(branches[i]->back);
+  }
+
+  // anything not reachable via the tree still has to be written
+  for (size_t i = 0; i < num_clv_ids; ++i) {
+    if (not seen[i]) {
+      order.emplace_back(i, PLL_SCALE_BUFFER_NONE);
+    }
+  }
+
+  return order;
+}
+
+/**
+  Measures what the reduced precision does to the log-likelihoods: computes the log-likelihood
+  of every branch once from the CLVs in double precision and once from their given encodings
+  (empty for CLVs that are not encoded, such as tips stored as tipchars).
+  Returns the largest absolute difference, and that of the reference tree log-likelihood
+  (see Tree::ref_tree_logl) via ref_delta.
+*/
+static double logl_error_(Tree& tree,
+                          const std::vector<std::vector<char>>& encoded,
+                          double& ref_delta)
+{
+  const auto partition = tree.partition();
+  std::vector<unsigned int> param_indices(partition->rate_cats, 0);
+
+  // the decoded CLVs of a branch are swapped in for the original ones
+  const size_t max_size = partition->sites * partition->states_padded * partition->rate_cats;
+  double * buffers[2];
+  for (auto& buffer : buffers) {
+    buffer = static_cast<double*>(pll_aligned_alloc(max_size * sizeof(double), partition->alignment));
+    if (!buffer) {
+      throw std::runtime_error{"Could not allocate CLV memory"};
+    }
+  }
+
+  auto edge_logl = [&](pll_unode_t const * const node) {
+    return pll_compute_edge_loglikelihood(partition,
+                                          node->clv_index,
+                                          node->scaler_index,
+                                          node->back->clv_index,
+                                          node->back->scaler_index,
+                                          node->pmatrix_index,
+                                          &param_indices[0],
+                                          nullptr);
+  };
+
+  auto delta_at = [&](pll_unode_t const * const node) {
+    const auto exact = edge_logl(node);
+
+    const unsigned int clv_indices[2] = {node->clv_index, node->back->clv_index};
+    for (size_t k = 0; k < 2; ++k) {
+      const auto& block = encoded[clv_indices[k]];
+      if (not block.empty()) {
+        decode_clv(block.data(), block.size(), buffers[k], pll_get_clv_size(partition, clv_indices[k]));
+      }
+    }
+    for (size_t k = 0; k < 2; ++k) {
+      if (not encoded[clv_indices[k]].empty()) {
+        std::swap(partition->clv[clv_indices[k]], buffers[k]);
       }
     }
+    const auto reduced = edge_logl(node);
+    for (size_t k = 0; k < 2; ++k) {
+      if (not encoded[clv_indices[k]].empty()) {
+        std::swap(partition->clv[clv_indices[k]], buffers[k]);
+      }
+    }
+
+    return std::fabs(exact - reduced);
+  };
+
+  std::vector<pll_unode_t *> branches(tree.nums().branches);
+  const auto num_branches = utree_query_branches(tree.tree(), &branches[0]);
+
+  double max_delta = 0.0;
+  for (size_t i = 0; i < num_branches; ++i) {
+    max_delta = std::max(max_delta, delta_at(branches[i]));
+  }
+  ref_delta = delta_at(get_root(tree.tree()));
+
+  for (auto& buffer : buffers) {
+    pll_aligned_free(buffer);
   }
 
-  return map;
+  return std::max(max_delta, ref_delta);
+}
+
+double reduced_precision_logl_error(Tree& tree,
+                                    const Options::ClvPrecision precision,
+                                    double& ref_delta)
+{
+  const auto partition = tree.partition();
+  const size_t num_clv_ids = partition->tips + partition->clv_buffers;
+  const size_t first_clv = (partition->attributes & PLL_ATTRIB_PATTERN_TIP) ? partition->tips : 0;
+  const size_t span = partition->states_padded * partition->rate_cats;
+
+  std::vector<std::vector<char>> encoded(num_clv_ids);
+  double max_error = 0.0;
+  for (size_t clv_index = first_clv; clv_index < num_clv_ids; ++clv_index) {
+    encoded[clv_index] = encode_clv(partition->clv[clv_index],
+                                    pll_get_clv_size(partition, clv_index),
+                                    span,
+                                    precision,
+                                    max_error);
+  }
+
+  return logl_error_(tree, encoded, ref_delta);
 }
 
 /**
-  Writes the structures and data encapsulated in Tree to the specified file in the binary format.
-  Writes them in such a way that the Binary class can read them.
+  Writes the structures and data encapsulated in Tree to the specified file in the binary format,
+  followed by the given extra blocks. Writes them in such a way that the Binary class can read them.
+
+  The small structural blocks (format, repeats, tree, partition) are written through pll-modules.
+  For the bulk of the file (tipchars, CLVs, scalers, extras) the layout is precomputed, following the
+  pll-modules random access format (block header followed by the payload, map entry per block),
+  and the blocks are then written in parallel using pwrite.
 */
-void dump_to_binary(Tree& tree, const std::string& file)
+static void dump_binary(Tree& tree,
+                        const std::string& file,
+                        const std::vector<Block_Layout>& extra_blocks)
 {
-  const auto num_clvs = tree.partition()->clv_buffers;
-  const auto num_tips = tree.partition()->tips;
-  const auto num_scalers = tree.partition()->scale_buffers;
-  const auto max_clv_index = num_clvs + num_tips;
-  
-  const bool use_tipchars = tree.partition()->attributes & PLL_ATTRIB_PATTERN_TIP;
-  const bool use_repeats = tree.partition()->attributes & PLL_ATTRIB_SITE_REPEATS;
+  const auto partition = tree.partition();
+  const auto num_clvs = partition->clv_buffers;
+  const auto num_tips = partition->tips;
+  const auto num_scalers = partition->scale_buffers;
+
+  const bool use_tipchars = partition->attributes & PLL_ATTRIB_PATTERN_TIP;
+  const bool use_repeats = partition->attributes & PLL_ATTRIB_SITE_REPEATS;
+
+  const auto precision = tree.options().binary_precision;
+  const bool reduced_precision = (precision != Options::ClvPrecision::kDouble);
 
   int block_id = use_repeats ? -3 : -2;
 
-  const unsigned int num_blocks = abs(block_id) + num_clvs + num_tips + num_scalers;
+  const unsigned int num_blocks = abs(block_id) + num_clvs + num_tips + num_scalers
+                                + (reduced_precision ? 1 : 0) + extra_blocks.size();
 
   pll_binary_header_t header;
   auto fptr =  pllmod_binary_create(
@@ -274,12 +845,23 @@ void dump_to_binary(Tree& tree, const std::string& file)
   if(!fptr) {
     throw std::runtime_error{std::string("Error opening binary file for writing: ") + pll_errmsg};
   }
+  Binary::file_ptr_type file_guard(fptr, safe_fclose);
 
   const auto attributes = PLLMOD_BIN_ATTRIB_UPDATE_MAP | PLLMOD_BIN_ATTRIB_PARTITION_DUMP_WGT;
 
+  if (reduced_precision) {
+    Binary_Format format;
+    std::memset(&format, 0, sizeof(Binary_Format));
+    std::memcpy(format.magic, FORMAT_MAGIC, sizeof(FORMAT_MAGIC));
+    format.version = 1;
+    format.clv_precision = static_cast<uint32_t>(precision);
+    if (!pllmod_binary_custom_dump(fptr, FORMAT_BLOCK_ID, &format, sizeof(Binary_Format), attributes)) {
+      throw std::runtime_error{std::string("Error dumping the format block: ") + pll_errmsg};
+    }
+  }
 
   if (use_repeats and not
-      pllmod_binary_repeats_dump(fptr, block_id++, tree.partition(), attributes)) {
+      pllmod_binary_repeats_dump(fptr, block_id++, partition, attributes)) {
     throw std::runtime_error{std::string("Error dumping the repeats: ") + pll_errmsg};
   }
 
@@ -289,58 +871,230 @@ void dump_to_binary(Tree& tree, const std::string& file)
   }
 
   // dump the partition
-  if(!pllmod_binary_partition_dump(fptr, block_id++, tree.partition(), attributes)) {
+  if(!pllmod_binary_partition_dump(fptr, block_id++, partition, attributes)) {
     throw std::runtime_error{std::string("Error dumping partition to binary: ") + pll_errmsg};
   }
 
-  // dump the tipchars, but only if partition uses them
-  size_t tip_index = 0;
-  if (use_tipchars) {
-    for (tip_index = 0; tip_index < num_tips; tip_index++) {
-      if(!pllmod_binary_custom_dump(fptr, 
-                                    block_id++, 
-                                    tree.partition()->tipchars[tip_index],
-                                    tree.partition()->sites * sizeof(unsigned char), 
-                                    attributes)) {
-        throw std::runtime_error{std::string("Error dumping tipchars to binary: ") + pll_errmsg};
-      }
+  // from here on, we write at precomputed offsets
+  if (fflush(fptr) or fseek(fptr, 0, SEEK_END)) {
+    throw std::runtime_error{"Error seeking in binary file."};
+  }
+  long offset = ftell(fptr);
+
+  std::vector<unsigned int> scaler_to_clv;
+  const auto order = make_block_order(tree, scaler_to_clv);
+
+  // with the repeats the scale buffers might not be allocated. dirty fix:
+  // allocate them in this case, just so they can be written and later used
+  const auto scaler_ptr = partition->scale_buffer;
+  for (size_t scaler_index = 0; scaler_index < num_scalers; scaler_index++) {
+    if (scaler_ptr[scaler_index] == nullptr) {
+      const auto scaler_size = pll_get_sites_number(partition, scaler_to_clv[scaler_index]);
+      scaler_ptr[scaler_index] = static_cast<unsigned int *>(calloc(scaler_size, sizeof(unsigned int)));
     }
   }
 
-  // dump the clvs
-  for (size_t clv_index = tip_index; clv_index < max_clv_index; clv_index++) {
-    if(!pllmod_binary_clv_dump( fptr, 
-                                block_id++, 
-                                tree.partition(), 
-                                clv_index, 
-                                attributes)) {
-      throw std::runtime_error{std::string("Error dumping clvs to binary: ") + pll_errmsg};
+  // encode the CLVs up front if needed, so that the layout is known
+  const size_t span = partition->states_padded * partition->rate_cats;
+  std::vector<std::vector<char>> encoded(num_tips + num_clvs);
+  double max_error = 0.0;
+  if (reduced_precision) {
+    const size_t first_clv = use_tipchars ? num_tips : 0;
+    std::vector<double> errors(num_tips + num_clvs, 0.0);
+#ifdef __OMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (size_t clv_index = first_clv; clv_index < num_tips + num_clvs; ++clv_index) {
+      encoded[clv_index] = encode_clv(partition->clv[clv_index],
+                                      pll_get_clv_size(partition, clv_index),
+                                      span,
+                                      precision,
+                                      errors[clv_index]);
     }
+    max_error = *std::max_element(std::begin(errors), std::end(errors));
   }
 
-  const auto scaler_to_clv = create_scaler_to_clv_map(tree);
+  // lay out the blocks. The payloads of CLV and scaler blocks start at a multiple of the
+  // partition alignment, such that they can be used straight from the file mapping
+  const size_t alignment = std::max<size_t>(partition->alignment, 1);
+  std::vector<Block_Layout> layout;
+  auto add_block = [&](const int id, const unsigned int type, void const * const data, const size_t size) {
+    layout.push_back({id, type, data, size, offset});
+    offset += sizeof(pll_block_header_t) + size;
+  };
+  auto add_aligned_block = [&](const int id, const unsigned int type, void const * const data, const size_t size) {
+    const size_t payload = offset + sizeof(pll_block_header_t);
+    offset += (alignment - payload % alignment) % alignment;
+    add_block(id, type, data, size);
+  };
 
-  const auto scaler_ptr = tree.partition()->scale_buffer;
-  
-  for (size_t scaler_index = 0; scaler_index < num_scalers; scaler_index++) {
-    
-    const auto scaler_size =  pll_get_sites_number( tree.partition(), 
-                                                    scaler_to_clv[scaler_index]);
+  const int scaler_block_offset = num_clvs + num_tips;
+  std::vector<char> scaler_written(num_scalers, false);
 
-    // with the repeats the scale buffers might not be allocated. dirty fix: 
-    // allocate them in this case, just so they can be written and later used
-    if (scaler_ptr[scaler_index] == nullptr) {
-      scaler_ptr[scaler_index] = static_cast<unsigned int *>(calloc(scaler_size, sizeof(unsigned int)));
+  for (auto const& entry : order) {
+    const auto clv_index = entry.first;
+    const auto scaler_index = entry.second;
+
+    if (use_tipchars and clv_index < num_tips) {
+      add_block(clv_index, PLLMOD_BIN_BTYPE_CUSTOM,
+                partition->tipchars[clv_index], partition->sites * sizeof(unsigned char));
+    } else if (reduced_precision) {
+      add_block(clv_index, PLLMOD_BIN_BTYPE_CUSTOM,
+                encoded[clv_index].data(), encoded[clv_index].size());
+    } else {
+      add_aligned_block(clv_index, PLLMOD_BIN_BTYPE_CLV,
+                partition->clv[clv_index], pll_get_clv_size(partition, clv_index) * sizeof(double));
+    }
+
+    if (scaler_index != PLL_SCALE_BUFFER_NONE and not scaler_written[scaler_index]) {
+      scaler_written[scaler_index] = true;
+      add_aligned_block(scaler_block_offset + scaler_index, PLLMOD_BIN_BTYPE_CUSTOM, scaler_ptr[scaler_index],
+                pll_get_sites_number(partition, scaler_to_clv[scaler_index]) * sizeof(unsigned int));
+    }
+  }
+
+  for (size_t scaler_index = 0; scaler_index < num_scalers; ++scaler_index) {
+    if (not scaler_written[scaler_index]) {
+      add_aligned_block(scaler_block_offset + scaler_index, PLLMOD_BIN_BTYPE_CUSTOM, scaler_ptr[scaler_index],
+                pll_get_sites_number(partition, scaler_to_clv[scaler_index]) * sizeof(unsigned int));
+    }
+  }
+
+  for (auto const& block : extra_blocks) {
+    add_block(block.block_id, block.type, block.data, block.size);
+  }
+
+  // update the file header and random access map, as pll-modules would have
+  if (fseek(fptr, 0, SEEK_SET)
+      or fread(&header, sizeof(pll_binary_header_t), 1, fptr) != 1) {
+    throw std::runtime_error{"Error reading back the binary file header."};
+  }
+
+  if (header.n_blocks + layout.size() > header.max_blocks) {
+    throw std::runtime_error{"Binary file header does not have room for all blocks."};
+  }
+
+  std::vector<pll_block_map_t> map_entries;
+  for (auto const& block : layout) {
+    pll_block_map_t entry;
+    std::memset(&entry, 0, sizeof(pll_block_map_t));
+    entry.block_id = block.block_id;
+    entry.block_offset = block.offset;
+    map_entries.push_back(entry);
+  }
+
+  const long map_offset = header.map_offset + header.n_blocks * sizeof(pll_block_map_t);
+  header.n_blocks += layout.size();
+
+  const int fd = fileno(fptr);
+
+  auto write_at = [fd](void const * const data, const size_t size, const long offset) {
+    auto ptr = static_cast<char const *>(data);
+    size_t done = 0;
+    while (done < size) {
+      const auto ret = pwrite(fd, ptr + done, size - done, offset + done);
+      if (ret <= 0) {
+        return false;
+      }
+      done += ret;
     }
+    return true;
+  };
+
+  std::atomic<bool> failed{false};
+
+#ifdef __OMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (size_t i = 0; i < layout.size(); ++i) {
+    auto const& block = layout[i];
+
+    pll_block_header_t block_header;
+    std::memset(&block_header, 0, sizeof(pll_block_header_t));
+    block_header.block_id = block.block_id;
+    block_header.type = block.type;
+    block_header.attributes = attributes;
+    block_header.block_len = block.size;
+
+    if (not write_at(&block_header, sizeof(pll_block_header_t), block.offset)
+        or not write_at(block.data, block.size, block.offset + sizeof(pll_block_header_t))) {
+      failed = true;
+    }
+  }
+
+  if (failed
+      or not write_at(map_entries.data(), map_entries.size() * sizeof(pll_block_map_t), map_offset)
+      or not write_at(&header, sizeof(pll_binary_header_t), 0)) {
+    throw std::runtime_error{std::string("Error writing blocks to binary file: ") + file};
+  }
+
+  if (reduced_precision) {
+    // the error per value is relative to the largest value of a site, so it says little about
+    // the log-likelihoods: those are measured from the decoded CLVs instead
+    double ref_delta = 0.0;
+    const auto logl_delta = logl_error_(tree, encoded, ref_delta);
+    LOG_INFO << "Reduced precision CLVs: max. error per value, relative to its site maximum: "
+             << max_error;
+    LOG_INFO << "Reduced precision CLVs: max. absolute log-likelihood error over all branches: "
+             << logl_delta << " (reference tree: " << ref_delta << ")";
+  }
+}
+
+void dump_to_binary(Tree& tree, const std::string& file)
+{
+  dump_binary(tree, file, {});
+}
+
+/**
+  Writes a prepared reference snapshot: the binary file as per dump_to_binary, plus the rooting
+  information of the tree, the gap mask used to build the reference (empty if it was built without
+  premasking) and the lookup tables of all branches. Load it via Tree(bin_file, ...).
+*/
+void dump_snapshot( Tree& tree,
+                    Lookup_Store& lookups,
+                    const MSA_Info::mask_type& gap_mask,
+                    const std::string& file)
+{
+  const auto partition = tree.partition();
+  const auto num_lookups = lookups.num_branches();
+  const int lookup_block_id = partition->tips + partition->clv_buffers + partition->scale_buffers;
+
+  Snapshot_Header snapshot;
+  std::memset(&snapshot, 0, sizeof(Snapshot_Header));
+  std::memcpy(snapshot.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  snapshot.version          = SNAPSHOT_VERSION;
+  snapshot.lookup_cols      = lookups.char_map_size();
+  snapshot.num_lookups      = num_lookups;
+  snapshot.lookup_block_id  = lookup_block_id;
+
+  std::stringstream mapper_stream;
+  {
+    cereal::BinaryOutputArchive archive(mapper_stream);
+    archive(tree.mapper());
+  }
+  const auto mapper_data = mapper_stream.str();
+
+  std::stringstream mask_stream;
+  if (gap_mask.size()) {
+    mask_stream << gap_mask;
+  }
+  const auto mask_data = mask_stream.str();
+
+  std::vector<Block_Layout> extra_blocks;
+  extra_blocks.push_back({SNAPSHOT_BLOCK_ID, PLLMOD_BIN_BTYPE_CUSTOM, &snapshot, sizeof(Snapshot_Header), 0});
+  extra_blocks.push_back({MAPPER_BLOCK_ID, PLLMOD_BIN_BTYPE_CUSTOM, mapper_data.data(), mapper_data.size(), 0});
+  if (not mask_data.empty()) {
+    extra_blocks.push_back({MASK_BLOCK_ID, PLLMOD_BIN_BTYPE_CUSTOM, mask_data.data(), mask_data.size(), 0});
+  }
 
-    if(!pllmod_binary_custom_dump(fptr, 
-                                  block_id++, 
-                                  scaler_ptr[scaler_index],
-                                  scaler_size * sizeof(unsigned int), 
-                                  attributes)) {
-      throw std::runtime_error{std::string("Error dumping scalers to binary: ") + pll_errmsg};
+  const size_t lookup_bytes = partition->sites * lookups.char_map_size() * sizeof(double);
+  for (size_t i = 0; i < num_lookups; ++i) {
+    if (not lookups.has_branch(i)) {
+      throw std::runtime_error{std::string("Lookup table missing for branch ") + std::to_string(i)};
     }
+    extra_blocks.push_back({static_cast<int>(lookup_block_id + i), PLLMOD_BIN_BTYPE_CUSTOM,
+                            lookups.branch_data(i), lookup_bytes, 0});
   }
 
-  fclose(fptr);
+  dump_binary(tree, file, extra_blocks);
 }
@@ -7,6 +7,12 @@
 #include <mutex>
 
 #include "core/pll/pllhead.hpp"
+#include "core/pll/rtree_mapper.hpp"
+#include "io/Memory_Map.hpp"
+#include "seq/MSA_Info.hpp"
+#include "util/Options.hpp"
+
+class Lookup_Store;
 
 // custom deleter
 int safe_fclose(FILE* fptr);
@@ -26,14 +32,54 @@ public:
   void load_clv(pll_partition_t * partition, const unsigned int clv_index);
   void load_tipchars(pll_partition_t * partition, const unsigned int tipchars_index);
   void load_scaler(pll_partition_t * partition, const unsigned int scaler_index);
+  bool prefetch_clv(const unsigned int clv_index) const;
+  bool prefetch_scaler(pll_partition_t * partition, const unsigned int scaler_index) const;
   pll_partition_t* load_partition();
   pll_utree_t* load_utree(const unsigned int num_tips);
+  void evict_clv(pll_partition_t * partition, const unsigned int clv_index);
+  void evict_tipchars(pll_partition_t * partition, const unsigned int tipchars_index);
+  void evict_scaler(pll_partition_t * partition, const unsigned int scaler_index);
+  void release(pll_partition_t * partition);
+  Options::ClvPrecision clv_precision() const { return clv_precision_; }
+  // true if the buffer points into the file mapping, that is, was loaded zero-copy
+  bool is_mapped(void const * const ptr) const { return mmap_.contains(ptr); }
+
+  // prepared reference snapshot (see dump_snapshot)
+  bool is_snapshot() const { return snapshot_; }
+  void load_mapper(rtree_mapper& mapper);
+  MSA_Info::mask_type load_gap_mask();
+  void load_lookups(Lookup_Store& lookups);
 private:
+  long get_offset_(const int block_id) const;
+  bool has_block_(const int block_id) const;
+  char const * mapped_block_(const int block_id, size_t& block_len) const;
+  void load_encoded_clv_(pll_partition_t * partition, const unsigned int clv_index);
+  std::string load_custom_(const int block_id);
+
   std::mutex file_mutex_;
   file_ptr_type bin_fptr_;
   std::vector<pll_block_map_t> map_;
+  // block offsets indexed by block_id + BLOCK_ID_SHIFT, for constant time lookup
+  std::vector<long> index_;
+  // read-only mapping of the whole file, used for lock free, zero-copy loading
+  Memory_Map mmap_;
+  // encoding of the CLV blocks, as stated by the optional format block
+  Options::ClvPrecision clv_precision_ = Options::ClvPrecision::kDouble;
+  // snapshot info: block id of the lookup table of branch 0, and its dimensions
+  bool snapshot_ = false;
+  int lookup_block_id_ = 0;
+  size_t num_lookups_ = 0;
+  size_t lookup_cols_ = 0;
 };
 
 class Tree;
 
 void dump_to_binary(Tree& tree, const std::string& file);
+// the log-likelihood error the given reduced precision causes (see dump_to_binary)
+double reduced_precision_logl_error(Tree& tree,
+                                    const Options::ClvPrecision precision,
+                                    double& ref_delta);
+void dump_snapshot( Tree& tree,
+                    Lookup_Store& lookups,
+                    const MSA_Info::mask_type& gap_mask,
+                    const std::string& file);
@@ -8,19 +8,17 @@
 #include "seq/MSA.hpp"
 #include "seq/MSA_Info.hpp"
 #include "io/encoding.hpp"
+#include "io/Binary_Fasta_Map.hpp"
 #include "util/template_magic.hpp"
 #include "util/stringify.hpp"
 #include "util/logging.hpp"
+#include "util/constants.hpp"
 
 #include "genesis/utils/io/serializer.hpp"
-#include "genesis/utils/io/deserializer.hpp"
 #include "genesis/sequence/formats/fasta_input_iterator.hpp"
 #include "genesis/sequence/functions/functions.hpp"
 #include "genesis/sequence/sequence.hpp"
 
-constexpr char MAGIC[] = "BFAST\0";
-constexpr size_t MAGIC_SIZE = array_size(MAGIC);
-
 using mask_type = MSA_Info::mask_type;
 
 using namespace genesis;
@@ -31,6 +29,30 @@ static FourBit& code_()
   return obj;
 }
 
+static TwoBit& twobit_code_()
+{
+  static TwoBit obj;
+  return obj;
+}
+
+static OneByte& onebyte_code_()
+{
+  static OneByte obj;
+  return obj;
+}
+
+static inline char const * magic(const unsigned version)
+{
+  switch (version) {
+    case 1:
+      return MAGIC;
+    case 2:
+      return MAGIC_V2;
+    default:
+      return MAGIC_AA;
+  }
+}
+
 static inline size_t data_section_offset(const size_t num_sequences, const size_t mask_size)
 {
   return MAGIC_SIZE
@@ -42,13 +64,14 @@ static inline size_t data_section_offset(const size_t num_sequences, const size_
 
 static inline void write_header(utils::Serializer& ser,
                                 const std::vector<size_t>& entry_sizes,
-                                const mask_type& mask)
+                                const mask_type& mask,
+                                const unsigned version)
 {
   const uint64_t num_sequences = entry_sizes.size();
 
   // First part:
   // <magic string><num_sequences>
-  ser.put_raw(MAGIC, MAGIC_SIZE);
+  ser.put_raw(magic(version), MAGIC_SIZE);
   ser.put_int(num_sequences);
 
   // Second part: the gap mask
@@ -71,107 +94,146 @@ static inline void write_header(utils::Serializer& ser,
   }
 }
 
-static inline std::vector<size_t> get_entry_sizes(const MSA& msa)
+static inline std::string encode(const std::string& seq, const unsigned version)
 {
-  std::vector<size_t> res;
-  for (const auto& s : msa) {
-    res.push_back(
-      code_().packed_size(s.sequence().size()) +
-      s.header().size()
-    );
+  switch (version) {
+    case 1:
+      return code_().to_fourbit(seq);
+    case 2:
+      return twobit_code_().to_twobit(seq);
+    default:
+      return onebyte_code_().to_onebyte(seq);
   }
-  return res;
+}
+
+// size of an entry, less that of the header_length and seq_length fields
+static inline size_t entry_size(const Char_Span header,
+                                const std::string& encoded_seq,
+                                const unsigned version)
+{
+  // later versions also store the size of the encoded sequence
+  return header.size() + encoded_seq.size() + ((version == 1) ? 0 : sizeof(uint64_t));
 }
 
 static inline void put_encoded(utils::Serializer& ser,
-                        const std::string& seq)
+                               const Char_Span seq,
+                               const std::string& encoded_seq,
+                               const unsigned version)
 {
-  const auto encoded_seq = code_().to_fourbit(seq);
   // put the size of actual characters
   ser.put_int<uint64_t>(seq.size());
-  // pack characters into encoding, write them out
+  // and for later versions that of the encoding, as it depends on the content
+  if (version > 1) {
+    ser.put_int<uint64_t>(encoded_seq.size());
+  }
+  // write out the encoded characters
   ser.put_raw_string(encoded_seq);
 }
 
-static std::string get_decoded(utils::Deserializer& des)
+// decodes a record into the given row, masked to the given ranges unless width (that of
+// the mask) is 0
+static inline void decode(const Binary_Fasta_Map::Record& record,
+                          const unsigned version,
+                          const std::vector<std::pair<size_t, size_t>>& ranges,
+                          const size_t width,
+                          char * const result)
 {
-  // get the size of characters that were packed
-  const auto decoded_size = des.get_int<uint64_t>();
-
-  // figure out how much that is in bytes
-  // (decoded_size = 3 would mean 2 bytes, one for the first two, one for the third plus padding)
-  const auto coded_size = code_().packed_size(decoded_size);
-
-  // get the bytes
-  auto coded_str = des.get_raw_string(coded_size);
-
-  // decode and return
-  return code_().from_fourbit(coded_str, decoded_size);
+  const bool masking = (width > 0);
+  switch (version) {
+    case 1:
+      if (masking) {
+        code_().from_fourbit(record.packed, record.sites, ranges, width, result);
+      } else {
+        code_().from_fourbit(record.packed, record.sites, result);
+      }
+      break;
+    case 2:
+      if (masking) {
+        twobit_code_().from_twobit(record.packed, record.packed_size, record.sites, ranges, width, result);
+      } else {
+        twobit_code_().from_twobit(record.packed, record.packed_size, record.sites, result);
+      }
+      break;
+    default:
+      if (masking) {
+        onebyte_code_().from_onebyte(record.packed, record.packed_size, record.sites, ranges, width, result);
+      } else {
+        onebyte_code_().from_onebyte(record.packed, record.packed_size, record.sites, result);
+      }
+  }
 }
 
-static void read_header(utils::Deserializer& des,
-                        std::vector<uint64_t>& offset,
-                        mask_type& mask)
+/**
+ * Decodes the records [begin, begin + number) of the mapped file into the result, in parallel
+ * and straight from the mapping into the rows of the result. Masking is done while decoding.
+ * The storage of the result is reused (see MSA::clear).
+ */
+static void read_sequences(const Binary_Fasta_Map& map,
+                           const size_t begin,
+                           const size_t number,
+                           const mask_type& mask,
+                           MSA& result)
 {
-  // read the header info
-  char magic[MAGIC_SIZE];
-  des.get_raw(magic, MAGIC_SIZE);
-
-  if (strcmp(magic, MAGIC)) {
-    throw std::runtime_error{std::string("File is not an epa::Binary_Fasta file")};
+  result.clear();
+  if (number == 0) {
+    return;
   }
 
-  const uint64_t num_sequences = des.get_int<uint64_t>();
+  std::vector<Binary_Fasta_Map::Record> records(number);
+  for (size_t i = 0; i < number; ++i) {
+    records[i] = map.record(begin + i);
+  }
 
-  // retrieve the mask
-  mask = mask_type();
-  std::stringstream mask_str( des.get_string() );
-  mask_str >> mask;
+  const bool masking = mask.count();
+  const auto ranges = masking ? kept_site_ranges(mask) : std::vector<std::pair<size_t, size_t>>();
 
-  offset = std::vector<uint64_t>(num_sequences);
-  // read the random access table
-  for (size_t i = 0; i < num_sequences; ++i) {
-    // sequence id
-    const auto idx = des.get_int<uint64_t>();
-    // offset
-    offset[idx] = des.get_int<uint64_t>();
+  for (const auto& record : records) {
+    if (masking and record.sites != mask.size()) {
+      throw std::runtime_error{"Sequence length does not match the width of the gap mask: "
+        + record.label_string()};
+    }
+    if (record.sites != records.front().sites) {
+      throw std::runtime_error{std::string("Tried to insert sequence to MSA of unequal length: ")
+        + record.label_string()};
+    }
   }
-}
 
-static MSA read_sequences(utils::Deserializer& des,
-                          const mask_type& mask,
-                          const size_t number,
-                          const size_t sites = 0)
-{
-  MSA msa(sites);
+  const auto width = masking ? mask.size() : 0;
+  result.num_sites(masking ? mask.size() - mask.count() : records.front().sites);
+  result.reserve(number);
+  result.add_rows(number);
 
+  #pragma omp parallel for schedule(static)
   for (size_t i = 0; i < number; ++i) {
-    auto label    = des.get_string();
-    auto sequence = get_decoded(des);
-
-    if ( mask.count() ) {
-      sequence = subset_sequence(sequence, mask);
-    }
-
-    msa.append( label, sequence );
+    decode(records[i], map.version(), ranges, width, result.row(i));
   }
 
-  return msa;
+  for (size_t i = 0; i < number; ++i) {
+    result.header(i, Char_Span(records[i].label, records[i].label_size));
+  }
 }
 
-static void ensure_dna(const std::string& seq)
+// the bfast version suited to the data: nucleotides if every character is one, amino acids otherwise
+static unsigned data_version(const Char_Span seq)
 {
   for (const auto& s : seq) {
-    bool found = false;
-    for (size_t i = 0; i < NT_MAP_SIZE and not found; ++i) {
-      found = (s == NT_MAP[i]);
+    const auto c = std::toupper(static_cast<unsigned char>(s));
+    if (std::find(NT_MAP, NT_MAP + NT_MAP_SIZE, c) == NT_MAP + NT_MAP_SIZE) {
+      return BFAST_AA_VERSION;
     }
-    if (not found) {
-      throw std::runtime_error{std::string("AA DATA NOT SUPPORTED for conversion to bfast!")
-        + " Sorry! Offending char: " + s
-      };
+  }
+  return BFAST_VERSION;
+}
+
+// the bfast version suited to the data of all sequences
+static unsigned data_version(const MSA& msa)
+{
+  for (const auto& s : msa) {
+    if (data_version(s.sequence()) == BFAST_AA_VERSION) {
+      return BFAST_AA_VERSION;
     }
   }
+  return BFAST_VERSION;
 }
 
 class Binary_Fasta
@@ -180,46 +242,63 @@ private:
   Binary_Fasta() = delete;
   ~Binary_Fasta() = delete;
 
+  static void check_version(const unsigned version)
+  {
+    if (version < 1 or version > BFAST_AA_VERSION) {
+      throw std::runtime_error{std::string("Unknown bfast version: ") + std::to_string(version)};
+    }
+  }
+
 public:
 
   static MSA_Info get_info(const std::string& file)
   {
-    utils::Deserializer des(file);
-
-    std::vector<uint64_t> offset;
-    mask_type mask;
-    read_header(des, offset, mask);
-
-    const auto sequences = offset.size();
+    Binary_Fasta_Map map(file);
 
-    return MSA_Info(file, sequences, mask, mask.size());
+    return MSA_Info(file, map.size(), map.gap_mask(), map.gap_mask().size());
   }
 
-  static void save(const MSA& msa, const std::string& file_name)
+  // version 0 means choosing it by the data type (see data_version)
+  static void save(const MSA& msa,
+                   const std::string& file_name,
+                   unsigned version = 0)
   {
+    if (not version) {
+      version = data_version(msa);
+    }
+
     // get the gap mask for the MSA
     mask_type gap_mask(msa.num_sites(), true);
     for (const auto& s : msa) {
-      const genesis::sequence::Sequence seq("", s.sequence());
+      const genesis::sequence::Sequence seq("", s.sequence().str());
       // get the mask of the current sequence
       auto cur_mask = genesis::sequence::gap_sites(seq);
       // adjust global mask accordingly
       gap_mask &= cur_mask;
     }
 
+    check_version(version);
+
+    std::vector<std::string> encoded;
+    std::vector<size_t> sizes;
+    for (const auto& s : msa) {
+      encoded.push_back(encode(s.sequence(), version));
+      sizes.push_back(entry_size(s.header(), encoded.back(), version));
+    }
+
     utils::Serializer ser(file_name);
 
     // Write the header
-    auto sizes = get_entry_sizes(msa);
-    write_header(ser, sizes, gap_mask);
+    write_header(ser, sizes, gap_mask, version);
 
     // Write the data. Every entry:
     // <header_length (bytes/chars)><header string><sequence_length><encoded sequence padded to next byte>
     // (note: the sequence_length is in number of encoded characters, so for
     // 4bit the number of bytes to be read is sequence_length * 2)
-    for (const auto& s : msa) {
-      ser.put_string(s.header());
-      put_encoded(ser, s.sequence());
+    // Version 2 entries hold the size of the encoded sequence between the last two
+    for (size_t i = 0; i < msa.size(); ++i) {
+      ser.put_string(msa[i].header().str());
+      put_encoded(ser, msa[i].sequence(), encoded[i], version);
     }
 
   }
@@ -227,54 +306,68 @@ public:
   static MSA load(const std::string& file_name,
                   const bool premasking = false)
   {
-    utils::Deserializer des(file_name);
+    Binary_Fasta_Map map(file_name);
 
-    std::vector<uint64_t> offset;
-    mask_type mask;
-    read_header(des, offset, mask);
+    const auto mask = premasking ? map.gap_mask() : mask_type();
 
-    if (not premasking) {
-      mask = mask_type();
-    }
-
-    return read_sequences( des, mask, offset.size() );
+    MSA result;
+    read_sequences( map, 0, map.size(), mask, result );
+    return result;
   }
 
   static std::string fasta_to_bfast( const std::string& fasta_file,
-                              std::string out_dir)
+                              std::string out_dir,
+                              unsigned version = 0)
   {
+    // probe first seq to see if this might be AA data
+    const bool choose = not version;
+    if (choose) {
+      auto it = sequence::FastaInputIterator( utils::from_file(fasta_file) );
+      version = it ? data_version( it->sites() ) : BFAST_VERSION;
+    }
+    check_version(version);
+
     auto parts = split_by_delimiter(fasta_file, "/");
 
     out_dir += parts.back() + ".bfast";
 
     // specific, per sequence sizes
     std::vector<size_t> entry_sizes;
-    // and a function to get it during msa info fetch
+    // and a function to get it during msa info fetch. Should a later sequence turn out to be
+    // no nucleotide one after all, the version falls back to amino acids, and as the sizes
+    // depend on it, they are taken again
+    bool rescan = false;
     auto get_sizes = [&](const genesis::sequence::Sequence& s)
     {
-      entry_sizes.push_back(
-        s.label().size() +
-        code_().packed_size(s.sites().size())
-      );
+      if (choose and version != BFAST_AA_VERSION and data_version(s.sites()) == BFAST_AA_VERSION) {
+        version = BFAST_AA_VERSION;
+        rescan = true;
+      }
+      if (not rescan) {
+        entry_sizes.push_back( entry_size(s.label(), encode(s.sites(), version), version) );
+      }
     };
 
     MSA_Info info(fasta_file, get_sizes);
+    if (rescan) {
+      LOG_DBG << "Found amino acids past the first sequence, using bfast version " << version;
+      entry_sizes.clear();
+      rescan = false;
+      info = MSA_Info(fasta_file, get_sizes);
+    }
 
     LOG_DBG << info;
 
     // write the header
     utils::Serializer ser(out_dir);
-    write_header(ser, entry_sizes, info.gap_mask());
+    write_header(ser, entry_sizes, info.gap_mask(), version);
 
     // write the data
     auto it = sequence::FastaInputIterator( utils::from_file(fasta_file) );
 
-    // probe first seq to see if this might be AA data
-    ensure_dna( it->sites() );
-
     while ( it ) {
       ser.put_string(it->label());
-      put_encoded(ser, it->sites());
+      put_encoded(ser, it->sites(), encode(it->sites(), version), version);
       ++it;
     }
     return out_dir;
@@ -285,41 +378,38 @@ public:
 #include "io/msa_reader_interface.hpp"
 #include "net/epa_mpi_util.hpp"
 
+/**
+ * Reader of bfast query files.
+ *
+ * The records are served from the mapping of the file, such that reading ahead is left to
+ * the OS: after every chunk, the pages of the following read_ahead chunks are requested
+ * (see Binary_Fasta_Map::will_need). As the faults on pages that did not arrive in time
+ * are not observed, there are no stats on reading ahead.
+ */
 class Binary_Fasta_Reader : public msa_reader
 {
 public:
   Binary_Fasta_Reader(std::string const& file_name,
                       MSA_Info const& info,
                       bool const premasking = false,
-                      bool const split = false)
-    : istream_(file_name)
-    , des_(istream_)
+                      bool const split = false,
+                      size_t const read_ahead = DEFAULT_READ_AHEAD)
+    : map_(file_name)
     , mask_(info.gap_mask())
+    , read_ahead_(std::max(read_ahead, size_t(1)))
   {
-    mask_type dummy_mask;
-    read_header(des_, seq_offsets_, dummy_mask);
+    assert(map_.size() == info.sequences());
 
-    assert(seq_offsets_.size() == info.sequences());
-
-
-    // if we are under MPI, skip to this ranks assigned part of the input file
+    // if we are under MPI, this rank only reads its assigned part of the input file
     #ifdef __MPI
     if ( split ) {
-      // get info about to which sequence to skip to and how much this rank should read
       std::tie( local_seq_offset_, max_read_ ) = local_seq_package( info.sequences() );
-
-      // skip to that offset in the underlying istream
-      istream_ = std::ifstream( file_name );
-      istream_.seekg( seq_offsets_[ local_seq_offset_ ], istream_.beg );
-
-      // rebuild the deserializer, starting from the desired sequence
-      des_ = utils::Deserializer( istream_ );
     }
     #else
     static_cast<void>(split);
     #endif
 
-    max_read_ = std::min( seq_offsets_.size(), max_read_);
+    max_read_ = std::min( map_.size() - local_seq_offset_, max_read_);
 
     if (not premasking) {
       mask_ = mask_type();
@@ -333,16 +423,41 @@ public:
     const auto to_read =
       std::min( number, max_read_ - num_read_ );
 
-    result = read_sequences( des_, mask_, to_read );
+    const auto begin = local_seq_offset_ + num_read_;
+    // the storage of the previous chunk is decoded into
+    read_sequences( map_, begin, to_read, mask_, result );
+
+    // the records are decoded, so their pages may leave memory again
+    map_.discard( begin, begin + to_read );
 
     num_read_ += result.size();
 
+    // while those of the next chunks are read in the background
+    const auto next = begin + to_read;
+    const auto left = local_seq_offset_ + max_read_ - next;
+    const auto ahead = (number > left / read_ahead_) ? left : read_ahead_ * number;
+    map_.will_need( next, next + ahead );
+
     return result.size();
   }
 
+  virtual void skip_to_sequence(const size_t n) override
+  {
+    if (local_seq_offset_ + n > map_.size()) {
+      throw std::runtime_error{"Trying to skip out of bounds!"};
+    }
+
+    if (n < num_read_) {
+      throw std::runtime_error{"Trying to skip behind!"};
+    }
+
+    // thanks to the offset table, records are accessed directly
+    num_read_ = std::min( n, max_read_ );
+  }
+
   virtual size_t num_sequences() const override
   {
-    return seq_offsets_.size();
+    return map_.size();
   }
 
   virtual size_t local_seq_offset() const override
@@ -352,11 +467,10 @@ public:
 
 
 private:
-  std::ifstream istream_;
-  utils::Deserializer des_;
+  Binary_Fasta_Map map_;
   mask_type mask_;
-  std::vector<uint64_t> seq_offsets_;
   size_t num_read_  = 0;
   size_t max_read_  = std::numeric_limits<size_t>::max();
   size_t local_seq_offset_ = 0;
+  size_t read_ahead_ = DEFAULT_READ_AHEAD;
 };
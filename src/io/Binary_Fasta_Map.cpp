@@ -0,0 +1,127 @@
+#include "io/Binary_Fasta_Map.hpp"
+
+#include <stdexcept>
+#include <sstream>
+#include <cstring>
+
+Binary_Fasta_Map::Binary_Fasta_Map(const std::string& file_name)
+  : file_name_(file_name)
+  , map_(Memory_Map::open_file(file_name))
+{
+  // <magic string><num_sequences>
+  if (map_.size() >= MAGIC_SIZE and not std::memcmp(map_.data(), MAGIC_V2, MAGIC_SIZE)) {
+    version_ = 2;
+  } else if (map_.size() >= MAGIC_SIZE and not std::memcmp(map_.data(), MAGIC_AA, MAGIC_SIZE)) {
+    version_ = BFAST_AA_VERSION;
+  } else if (map_.size() < MAGIC_SIZE or std::memcmp(map_.data(), MAGIC, MAGIC_SIZE)) {
+    throw std::runtime_error{std::string("File is not an epa::Binary_Fasta file")};
+  }
+  size_t pos = MAGIC_SIZE;
+
+  const auto num_sequences = get_int_(pos);
+  pos += sizeof(uint64_t);
+
+  // <mask_width><mask_string>
+  const auto mask_width = get_int_(pos);
+  pos += sizeof(uint64_t);
+  if (mask_width > map_.size() - pos) {
+    throw std::runtime_error{file_name + ": truncated bfast header"};
+  }
+  std::stringstream mask_str( std::string(map_.data() + pos, mask_width) );
+  mask_str >> mask_;
+  pos += mask_width;
+
+  // <<seqID><seqOffset>><...>
+  if (num_sequences > (map_.size() - pos) / (2 * sizeof(uint64_t))) {
+    throw std::runtime_error{file_name + ": truncated bfast header"};
+  }
+  offsets_ = std::vector<uint64_t>(num_sequences);
+  for (size_t i = 0; i < num_sequences; ++i) {
+    const auto idx = get_int_(pos);
+    if (idx >= num_sequences) {
+      throw std::runtime_error{file_name + ": invalid sequence id in bfast header: " + std::to_string(idx)};
+    }
+    offsets_[idx] = get_int_(pos + sizeof(uint64_t));
+    pos += 2 * sizeof(uint64_t);
+  }
+}
+
+uint64_t Binary_Fasta_Map::get_int_(const size_t offset) const
+{
+  if (offset > map_.size() or map_.size() - offset < sizeof(uint64_t)) {
+    throw std::runtime_error{file_name_ + ": unexpected end of bfast file"};
+  }
+  // the mapping gives no alignment guarantees past the header
+  uint64_t value;
+  std::memcpy(&value, map_.data() + offset, sizeof(value));
+  return value;
+}
+
+/**
+  Returns the i-th record. Format:
+  <header_length><header string><sequence_length><encoded sequence padded to next byte>
+  where version 2 has the size of the encoded sequence in bytes before it.
+*/
+Binary_Fasta_Map::Record Binary_Fasta_Map::record(const size_t i) const
+{
+  if (i >= offsets_.size()) {
+    throw std::runtime_error{"Binary_Fasta_Map: record index out of bounds"};
+  }
+
+  Record result;
+  size_t pos = offsets_[i];
+
+  result.label_size = get_int_(pos);
+  pos += sizeof(uint64_t);
+  if (result.label_size > map_.size() - pos) {
+    throw std::runtime_error{file_name_ + ": unexpected end of bfast file"};
+  }
+  result.label = map_.data() + pos;
+  pos += result.label_size;
+
+  result.sites = get_int_(pos);
+  pos += sizeof(uint64_t);
+  if (version_ == 1) {
+    result.packed_size = (result.sites + 1) / 2;
+  } else {
+    result.packed_size = get_int_(pos);
+    pos += sizeof(uint64_t);
+  }
+  result.packed = map_.data() + pos;
+  if (result.packed_size > map_.size() - pos) {
+    throw std::runtime_error{file_name_ + ": unexpected end of bfast file"};
+  }
+
+  return result;
+}
+
+/**
+  Hands the pages of the records [begin, end) back to the OS, for when they were consumed.
+*/
+void Binary_Fasta_Map::discard(const size_t begin, const size_t end) const
+{
+  if (begin >= end or end > offsets_.size()) {
+    return;
+  }
+  const auto first = offsets_[begin];
+  const auto last = (end < offsets_.size()) ? offsets_[end] : map_.size();
+  if (first < last and last <= map_.size()) {
+    map_.discard(map_.data() + first, last - first);
+  }
+}
+
+/**
+  Asks the OS to read the pages of the records [begin, end) ahead, for when they are
+  about to be consumed.
+*/
+void Binary_Fasta_Map::will_need(const size_t begin, const size_t end) const
+{
+  if (begin >= end or end > offsets_.size()) {
+    return;
+  }
+  const auto first = offsets_[begin];
+  const auto last = (end < offsets_.size()) ? offsets_[end] : map_.size();
+  if (first < last and last <= map_.size()) {
+    map_.will_need(map_.data() + first, last - first);
+  }
+}
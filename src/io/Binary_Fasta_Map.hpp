@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "io/Memory_Map.hpp"
+#include "seq/MSA_Info.hpp"
+#include "util/template_magic.hpp"
+
+// the last byte of the magic string is the version, where version 1 is 4bit encoded (see FourBit),
+// version 2 is 2bit encoded (see TwoBit) and version 3 holds amino acids (see OneByte)
+constexpr char MAGIC[] = "BFAST\0";
+constexpr char MAGIC_V2[] = "BFAST\2";
+constexpr char MAGIC_AA[] = "BFAST\3";
+constexpr size_t MAGIC_SIZE = array_size(MAGIC);
+constexpr unsigned BFAST_VERSION = 2;
+constexpr unsigned BFAST_AA_VERSION = 3;
+
+/**
+ * Read-only view of a bfast file (see Binary_Fasta), mapped into memory as a whole.
+ *
+ * Records are handed out as pointers into the mapping, such that reading them involves no
+ * copies or allocations: the page cache of the OS serves as the buffer, and pages of records
+ * that were consumed may be handed back to it via discard.
+ */
+class Binary_Fasta_Map
+{
+public:
+  using mask_type = MSA_Info::mask_type;
+
+  // non-owning view of one record, valid as long as the map is
+  struct Record
+  {
+    char const * label;
+    size_t label_size;
+    // the encoded sites
+    char const * packed;
+    size_t packed_size;
+    size_t sites;
+
+    std::string label_string() const { return std::string(label, label_size); }
+  };
+
+  explicit Binary_Fasta_Map(const std::string& file_name);
+  Binary_Fasta_Map()  = delete;
+  ~Binary_Fasta_Map() = default;
+
+  Binary_Fasta_Map(Binary_Fasta_Map const& other) = delete;
+  Binary_Fasta_Map(Binary_Fasta_Map&& other)      = default;
+
+  Binary_Fasta_Map& operator= (Binary_Fasta_Map const& other) = delete;
+  Binary_Fasta_Map& operator= (Binary_Fasta_Map && other)     = default;
+
+  // access
+  size_t size() const { return offsets_.size(); }
+  const mask_type& gap_mask() const { return mask_; }
+  const std::string& file_name() const { return file_name_; }
+  unsigned version() const { return version_; }
+
+  Record record(const size_t i) const;
+
+  void discard(const size_t begin, const size_t end) const;
+  void will_need(const size_t begin, const size_t end) const;
+
+private:
+  uint64_t get_int_(const size_t offset) const;
+
+  std::string file_name_;
+  Memory_Map map_;
+  std::vector<uint64_t> offsets_;
+  mask_type mask_;
+  unsigned version_ = 1;
+};
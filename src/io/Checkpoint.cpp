@@ -0,0 +1,114 @@
+#include "io/Checkpoint.hpp"
+
+#include <stdexcept>
+#include <fstream>
+#include <cstdio>
+
+#include "io/file_io.hpp"
+#include "io/Placement_Cache.hpp"
+
+static constexpr char MAGIC[] = "EPA-NG_CHECKPOINT";
+
+Checkpoint::Checkpoint(const std::string& file_path)
+  : file_path_(file_path)
+{ }
+
+/**
+  Reads the checkpoint file, if there is one. Returns false if there is none.
+*/
+bool Checkpoint::load()
+{
+  std::ifstream file(file_path_);
+  if (not file.is_open()) {
+    return false;
+  }
+
+  std::string magic;
+  unsigned int version = 0;
+  file >> magic >> version;
+  if (magic != MAGIC) {
+    throw std::runtime_error{file_path_ + " is not an epa-ng checkpoint file."};
+  }
+  if (version != VERSION) {
+    throw std::runtime_error{file_path_ + " has version " + std::to_string(version)
+      + ", expected " + std::to_string(VERSION)};
+  }
+
+  file >> chunk_size >> num_sequences >> query_size >> query_mtime >> context
+       >> chunks_done >> bytes_written;
+  if (file.fail()) {
+    throw std::runtime_error{file_path_ + " is corrupted."};
+  }
+
+  return true;
+}
+
+/**
+  Writes the checkpoint file. The previous one is replaced atomically, such that
+  an interruption at any point leaves a valid checkpoint behind.
+*/
+void Checkpoint::save() const
+{
+  const auto tmp_path = file_path_ + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ofstream::trunc);
+    file << MAGIC << " " << VERSION << "\n";
+    file << chunk_size << " " << num_sequences << " " << query_size << " " << query_mtime << " "
+         << context << "\n";
+    file << chunks_done << " " << bytes_written << "\n";
+    file.flush();
+    if (file.fail()) {
+      throw std::runtime_error{tmp_path + ": could not write checkpoint!"};
+    }
+  }
+
+  if (std::rename(tmp_path.c_str(), file_path_.c_str()) != 0) {
+    throw std::runtime_error{file_path_ + ": could not replace checkpoint!"};
+  }
+}
+
+/**
+  Removes the checkpoint file of a completed run.
+*/
+void Checkpoint::remove() const
+{
+  if (enabled()) {
+    std::remove(file_path_.c_str());
+  }
+}
+
+/**
+  Records what identifies the run: the state of the query file, the reference and the settings.
+*/
+void Checkpoint::identify(const std::string& query_file, Tree& reference_tree, const Options& options)
+{
+  if (not file_stamp(query_file, query_size, query_mtime)) {
+    throw std::runtime_error{query_file + ": could not access the query file!"};
+  }
+  // the output settings change the written document, but not the placements
+  context = Placement_Cache::hash_context(Placement_Cache::make_context(reference_tree, options)
+    + "\noutput: " + std::to_string(options.precision) + " " + std::to_string(options.abundances));
+}
+
+/**
+  Ensures the checkpoint was written by the given run, that is, on the same input with the
+  same chunking, reference and settings, as otherwise the chunks to skip and the output
+  written so far would not match.
+*/
+void Checkpoint::validate(Checkpoint const& run) const
+{
+  if (chunk_size != run.chunk_size or num_sequences != run.num_sequences) {
+    throw std::runtime_error{file_path_ + " does not match this run (chunk size "
+      + std::to_string(chunk_size) + " vs. " + std::to_string(run.chunk_size)
+      + ", sequences " + std::to_string(num_sequences) + " vs. " + std::to_string(run.num_sequences)
+      + "). Rerun with the same query file and --chunk-size, or remove it."};
+  }
+  if (query_size != run.query_size or query_mtime != run.query_mtime) {
+    throw std::runtime_error{file_path_ + " does not match this run: the query file changed since."
+      " Rerun with the same query file, or remove it."};
+  }
+  if (context != run.context) {
+    throw std::runtime_error{file_path_ + " does not match this run: the reference tree, model or"
+      " placement settings differ. Rerun with the same ones, or remove it."};
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+#include "util/Options.hpp"
+
+class Tree;
+
+/**
+ * Progress of a placement run, recorded after every chunk that was completely
+ * written to the jplace output (see Options::checkpointing).
+ *
+ * Chunks are processed in order, so the number of completed chunks identifies them.
+ * Under MPI, it is the number of chunks every rank has completed, and the byte offset
+ * refers to the shared output file.
+ *
+ * A checkpoint is only resumed by the same run: same query file (by its stamp, see file_stamp),
+ * chunk size, reference and settings (by the hash of their Placement_Cache context, plus the
+ * output settings). It is removed once the run completed (see jplace_writer::close).
+ */
+class Checkpoint
+{
+public:
+  static constexpr unsigned int VERSION = 2;
+
+  Checkpoint()  = default;
+  explicit Checkpoint(const std::string& file_path);
+  ~Checkpoint() = default;
+
+  bool load();
+  void save() const;
+  void remove() const;
+  void identify(const std::string& query_file, Tree& reference_tree, const Options& options);
+  void validate(Checkpoint const& run) const;
+
+  // member access
+  const std::string& file_path() const { return file_path_; }
+  bool enabled() const { return not file_path_.empty(); }
+
+  size_t chunk_size     = 0;
+  size_t num_sequences  = 0; // in the whole query file
+  long long query_size  = 0;
+  long long query_mtime = 0;
+  std::string context;       // hash of the reference and settings
+  size_t chunks_done    = 0;
+  size_t bytes_written  = 0; // to the jplace output, excluding the trailing metadata
+
+private:
+  std::string file_path_;
+};
@@ -0,0 +1,228 @@
+#include "io/Fasta_Chunk_Reader.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cctype>
+
+// how many records skip() looks at at once, bounding the buffered data
+static constexpr size_t SKIP_BATCH = 10000;
+
+static bool is_blank(const char c)
+{
+  return std::isspace(static_cast<unsigned char>(c));
+}
+
+/**
+  Parses a single record, from its '>' up to (excluding) the next one, writing its sites into
+  the given row of at most width sites. Sites dropped by the filter (see site_filter) are
+  skipped while scanning, such that the unmasked sequence is never stored. The header is
+  returned as a view into the record. Returns the number of sites of the record before masking.
+*/
+static size_t parse_record(const char* begin,
+                           const char* end,
+                           const std::vector<unsigned char>& filter,
+                           const size_t width,
+                           Char_Span& header,
+                           char * const row)
+{
+  // skip the '>'
+  ++begin;
+  auto line_end = std::find(begin, end, '\n');
+
+  auto header_end = line_end;
+  while (header_end != begin and is_blank(*(header_end - 1))) {
+    --header_end;
+  }
+  header = Char_Span(begin, header_end - begin);
+
+  size_t num_sites = 0;
+  size_t num_written = 0;
+  for (auto c = line_end; c != end; ++c) {
+    if (not is_blank(*c)) {
+      const bool kept = filter.empty() or (num_sites < filter.size() and filter[num_sites]);
+      if (kept and num_written < width) {
+        row[num_written++] = std::toupper(static_cast<unsigned char>(*c));
+      }
+      ++num_sites;
+    }
+  }
+
+  return num_sites;
+}
+
+/**
+  Number of sites of a record, from its '>' up to (excluding) the next one.
+*/
+static size_t count_sites(const char* begin, const char* end)
+{
+  const auto line_end = std::find(begin, end, '\n');
+  return std::count_if(line_end, end, [](const char c){ return not is_blank(c); });
+}
+
+Fasta_Chunk_Reader::Fasta_Chunk_Reader(const std::string& file_name, const size_t block_size)
+  : file_name_(file_name)
+  , source_(std::make_unique<Input_Source>(file_name))
+  , block_size_(block_size)
+  , eof_(false)
+{ }
+
+/**
+  Appends the next block of the file to the buffer. Returns false if there was nothing left.
+*/
+bool Fasta_Chunk_Reader::fill_()
+{
+  if (eof_) {
+    return false;
+  }
+
+  const auto old_size = buffer_.size();
+  buffer_.resize(old_size + block_size_);
+  const auto num_read = source_->read(&buffer_[old_size], block_size_);
+  buffer_.resize(old_size + num_read);
+
+  if (num_read < block_size_) {
+    eof_ = true;
+  }
+
+  return num_read > 0;
+}
+
+/**
+  Ensures up to the given number of complete records are buffered, and sets starts_
+  accordingly. Returns the number of records found, which is only less than requested
+  at the end of the file.
+*/
+size_t Fasta_Chunk_Reader::find_records_(const size_t number)
+{
+  // drop what was consumed already
+  buffer_.erase(0, pos_);
+  pos_ = 0;
+
+  starts_.clear();
+  if (number == 0) {
+    return 0;
+  }
+
+  // records begin with a '>' at the beginning of a line. One more is needed than asked for,
+  // as the start of the following record marks the end of the last one.
+  // The search resumes where the previous one ended, such that a record spanning many blocks
+  // is scanned only once
+  size_t search_from = 0;
+  while (starts_.size() <= number) {
+    size_t next = std::string::npos;
+    if (search_from == 0 and not buffer_.empty() and buffer_[0] == '>') {
+      next = 0;
+    } else if (not buffer_.empty()) {
+      next = buffer_.find("\n>", search_from ? search_from - 1 : 0);
+      if (next != std::string::npos) {
+        ++next;
+      }
+    }
+
+    if (next == std::string::npos) {
+      search_from = buffer_.size();
+      if (not fill_()) {
+        break;
+      }
+      continue;
+    }
+
+    if (starts_.empty() and not std::all_of(buffer_.begin(), buffer_.begin() + next, is_blank)) {
+      throw std::runtime_error{file_name_ + " is not a valid FASTA file (expected '>')"};
+    }
+
+    starts_.push_back(next);
+    search_from = next + 1;
+  }
+
+  if (starts_.empty()) {
+    if (not std::all_of(buffer_.begin(), buffer_.end(), is_blank)) {
+      throw std::runtime_error{file_name_ + " is not a valid FASTA file (expected '>')"};
+    }
+    return 0;
+  }
+
+  if (starts_.size() <= number) {
+    // end of the file
+    starts_.push_back(buffer_.size());
+  }
+
+  return starts_.size() - 1;
+}
+
+/**
+  Reads up to the given number of sequences into the result, replacing its contents.
+  If a mask is given, it is applied to every sequence. If the number of sites is given,
+  all sequences must have it, otherwise the first one determines it.
+  The storage of the result is reused, and the sequences parsed directly into it.
+*/
+size_t Fasta_Chunk_Reader::read(MSA& result,
+                                const size_t number,
+                                const MSA_Info::mask_type& mask,
+                                const size_t sites)
+{
+  result.clear();
+
+  const auto num_records = find_records_(number);
+  if (num_records == 0) {
+    return 0;
+  }
+
+  const bool masking = mask.size() > 0;
+  const auto filter = masking ? site_filter(mask) : std::vector<unsigned char>();
+  const char* data = buffer_.data();
+
+  const auto length = sites ? sites : count_sites(data + starts_[0], data + starts_[1]);
+  if (masking and length != mask.size()) {
+    throw std::runtime_error{"Sequence length does not match the width of the gap mask"};
+  }
+
+  result.num_sites(masking ? mask.size() - mask.count() : length);
+  result.reserve(num_records);
+  result.add_rows(num_records);
+
+  std::vector<size_t> lengths(num_records);
+  std::vector<Char_Span> headers(num_records);
+  const auto width = result.num_sites();
+
+  #pragma omp parallel for schedule(static) if(parallel_)
+  for (size_t i = 0; i < num_records; ++i) {
+    lengths[i] = parse_record(data + starts_[i],
+                              data + starts_[i + 1],
+                              filter,
+                              width,
+                              headers[i],
+                              result.row(i));
+  }
+
+  pos_ = starts_.back();
+
+  // unequal lengths are reported here, outside of the parallel region
+  for (size_t i = 0; i < num_records; ++i) {
+    if (lengths[i] != length) {
+      result.clear();
+      throw std::runtime_error{"MSA file does not contain equal size sequences"};
+    }
+    result.header(i, headers[i]);
+  }
+
+  return num_records;
+}
+
+/**
+  Skips the given number of sequences, without parsing them. Returns how many were
+  skipped, which is only less than requested at the end of the file.
+*/
+size_t Fasta_Chunk_Reader::skip(const size_t number)
+{
+  size_t skipped = 0;
+  while (skipped < number) {
+    const auto found = find_records_(std::min(number - skipped, SKIP_BATCH));
+    if (found == 0) {
+      break;
+    }
+    pos_ = starts_.back();
+    skipped += found;
+  }
+  return skipped;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+#include "seq/MSA.hpp"
+#include "seq/MSA_Info.hpp"
+#include "io/Input_Source.hpp"
+
+/**
+ * Reads a FASTA file chunk-wise, parsing the records of a chunk in parallel.
+ *
+ * The file is read in large blocks. The record boundaries within the buffered data are found
+ * in one quick pass, after which the records are parsed independently of each other, every one
+ * directly into its own row of the chunk (see MSA::add_rows), such that the input order is
+ * preserved. Masked sites are dropped while parsing, and the kept ones converted to upper case.
+ *
+ * Readers running alongside the placement (such as the prefetch thread of MSA_Stream) should
+ * parse serially, see parallel(), as the threads of the placement already occupy the cores.
+ *
+ * The file may be gzip or zstd compressed, see Input_Source.
+ */
+class Fasta_Chunk_Reader
+{
+public:
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 1ul << 22;
+
+  explicit Fasta_Chunk_Reader(const std::string& file_name,
+                              const size_t block_size = DEFAULT_BLOCK_SIZE);
+  Fasta_Chunk_Reader()  = default;
+  ~Fasta_Chunk_Reader() = default;
+
+  Fasta_Chunk_Reader(Fasta_Chunk_Reader const& other) = delete;
+  Fasta_Chunk_Reader(Fasta_Chunk_Reader&& other)      = default;
+
+  Fasta_Chunk_Reader& operator= (Fasta_Chunk_Reader const& other) = delete;
+  Fasta_Chunk_Reader& operator= (Fasta_Chunk_Reader && other)     = default;
+
+  size_t read(MSA& result,
+              const size_t number,
+              const MSA_Info::mask_type& mask,
+              const size_t sites = 0);
+  size_t skip(const size_t number);
+
+  // setters
+  void parallel(const bool parallel) { parallel_ = parallel; }
+
+private:
+  bool fill_();
+  size_t find_records_(const size_t number);
+
+  std::string file_name_;
+  std::unique_ptr<Input_Source> source_;
+  size_t block_size_ = DEFAULT_BLOCK_SIZE;
+  bool eof_ = true;
+  bool parallel_ = true;
+
+  // data read from the file but not yet consumed, starting at pos_
+  std::string buffer_;
+  size_t pos_ = 0;
+  // beginnings of the records found by find_records_, followed by the end of the last one
+  std::vector<size_t> starts_;
+};
@@ -0,0 +1,317 @@
+#include "io/Input_Source.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+#ifdef __ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef __ZSTD
+#include <zstd.h>
+#endif
+
+// ================== Decoders ==================
+
+class Plain_Decoder : public Input_Source::Decoder
+{
+public:
+  explicit Plain_Decoder(const std::string& file_name)
+    : file_(file_name, std::ifstream::binary)
+  {
+    if (not file_.is_open()) {
+      throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+    }
+  }
+
+  size_t read(char* buffer, const size_t size) override
+  {
+    file_.read(buffer, size);
+    return file_.gcount();
+  }
+
+private:
+  std::ifstream file_;
+};
+
+#ifdef __ZLIB
+class Gzip_Decoder : public Input_Source::Decoder
+{
+public:
+  explicit Gzip_Decoder(const std::string& file_name)
+    : file_name_(file_name)
+    , file_(file_name, std::ifstream::binary)
+    , in_(IN_SIZE)
+  {
+    if (not file_.is_open()) {
+      throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+    }
+    std::memset(&stream_, 0, sizeof(stream_));
+    // 32: detect the gzip header
+    if (inflateInit2(&stream_, 15 + 32) != Z_OK) {
+      throw std::runtime_error{file_name + ": could not initialize gzip decompression"};
+    }
+  }
+
+  ~Gzip_Decoder()
+  {
+    inflateEnd(&stream_);
+  }
+
+  size_t read(char* buffer, const size_t size) override
+  {
+    stream_.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream_.avail_out = size;
+
+    while (stream_.avail_out > 0) {
+      if (stream_.avail_in == 0) {
+        file_.read(in_.data(), in_.size());
+        stream_.next_in = reinterpret_cast<Bytef*>(in_.data());
+        stream_.avail_in = file_.gcount();
+        if (stream_.avail_in == 0) {
+          if (not finished_) {
+            throw std::runtime_error{file_name_ + ": unexpected end of gzip data"};
+          }
+          break;
+        }
+      }
+
+      const auto ret = inflate(&stream_, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END) {
+        // concatenated members (e.g. bgzf) are decompressed one after the other
+        finished_ = true;
+        inflateReset(&stream_);
+      } else if (ret == Z_OK or ret == Z_BUF_ERROR) {
+        finished_ = false;
+      } else {
+        throw std::runtime_error{file_name_ + ": invalid gzip data"};
+      }
+    }
+
+    return size - stream_.avail_out;
+  }
+
+private:
+  static constexpr size_t IN_SIZE = 1ul << 18;
+
+  std::string file_name_;
+  std::ifstream file_;
+  std::vector<char> in_;
+  z_stream stream_;
+  bool finished_ = false;
+};
+#endif
+
+#ifdef __ZSTD
+class Zstd_Decoder : public Input_Source::Decoder
+{
+public:
+  explicit Zstd_Decoder(const std::string& file_name)
+    : file_name_(file_name)
+    , file_(file_name, std::ifstream::binary)
+    , in_(ZSTD_DStreamInSize())
+    , stream_(ZSTD_createDStream())
+  {
+    if (not file_.is_open()) {
+      throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+    }
+    if (not stream_ or ZSTD_isError(ZSTD_initDStream(stream_))) {
+      throw std::runtime_error{file_name + ": could not initialize zstd decompression"};
+    }
+  }
+
+  ~Zstd_Decoder()
+  {
+    ZSTD_freeDStream(stream_);
+  }
+
+  size_t read(char* buffer, const size_t size) override
+  {
+    ZSTD_outBuffer output = { buffer, size, 0 };
+
+    while (output.pos < output.size) {
+      if (input_.pos == input_.size) {
+        file_.read(in_.data(), in_.size());
+        input_ = { in_.data(), static_cast<size_t>(file_.gcount()), 0 };
+        if (input_.size == 0) {
+          if (not finished_) {
+            throw std::runtime_error{file_name_ + ": unexpected end of zstd data"};
+          }
+          break;
+        }
+      }
+
+      // consecutive frames are decompressed one after the other
+      const auto ret = ZSTD_decompressStream(stream_, &output, &input_);
+      if (ZSTD_isError(ret)) {
+        throw std::runtime_error{file_name_ + ": invalid zstd data: " + ZSTD_getErrorName(ret)};
+      }
+      finished_ = (ret == 0);
+    }
+
+    return output.pos;
+  }
+
+private:
+  std::string file_name_;
+  std::ifstream file_;
+  std::vector<char> in_;
+  ZSTD_DStream* stream_;
+  ZSTD_inBuffer input_ = { nullptr, 0, 0 };
+  bool finished_ = true;
+};
+#endif
+
+// ================== Input_Source ==================
+
+Input_Source::Format Input_Source::detect(const std::string& file_name)
+{
+  std::ifstream file(file_name, std::ifstream::binary);
+  if (not file.is_open()) {
+    throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+  }
+
+  unsigned char magic[4] = {0, 0, 0, 0};
+  file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+  const auto num_read = file.gcount();
+
+  if (num_read >= 2 and magic[0] == 0x1f and magic[1] == 0x8b) {
+    return Format::kGzip;
+  }
+  if (num_read >= 4 and magic[0] == 0x28 and magic[1] == 0xb5 and magic[2] == 0x2f and magic[3] == 0xfd) {
+    return Format::kZstd;
+  }
+  return Format::kPlain;
+}
+
+Input_Source::Input_Source(const std::string& file_name, const size_t block_size)
+  : format_(detect(file_name))
+  , block_size_(block_size)
+{
+  switch (format_) {
+    case Format::kPlain:
+      decoder_ = std::make_unique<Plain_Decoder>(file_name);
+      break;
+    case Format::kGzip:
+      #ifdef __ZLIB
+      decoder_ = std::make_unique<Gzip_Decoder>(file_name);
+      #else
+      throw std::runtime_error{file_name + " is gzip compressed, but this build of epa-ng lacks zlib support."};
+      #endif
+      break;
+    case Format::kZstd:
+      #ifdef __ZSTD
+      decoder_ = std::make_unique<Zstd_Decoder>(file_name);
+      #else
+      throw std::runtime_error{file_name + " is zstd compressed, but this build of epa-ng lacks zstd support."};
+      #endif
+      break;
+  }
+
+#ifdef __PREFETCH
+  // plain files are read ahead by the OS already
+  if (format_ != Format::kPlain) {
+    worker_ = std::thread(&Input_Source::decompress_, this);
+  }
+#endif
+}
+
+Input_Source::~Input_Source()
+{
+#ifdef __PREFETCH
+  if (worker_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    worker_.join();
+  }
+#endif
+}
+
+#ifdef __PREFETCH
+/**
+  Body of the decompression thread: produces blocks until the end of the input, staying
+  at most PREFETCH_BLOCKS ahead of the reader.
+*/
+void Input_Source::decompress_()
+{
+  try {
+    while (true) {
+      std::vector<char> block(block_size_);
+      const auto num_read = decoder_->read(block.data(), block.size());
+      block.resize(num_read);
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this]{ return stop_ or blocks_.size() < PREFETCH_BLOCKS; });
+      if (stop_) {
+        return;
+      }
+      if (num_read == 0) {
+        worker_done_ = true;
+        cond_.notify_all();
+        return;
+      }
+      blocks_.push_back(std::move(block));
+      cond_.notify_all();
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    error_ = std::current_exception();
+    worker_done_ = true;
+    cond_.notify_all();
+  }
+}
+#endif
+
+/**
+  Makes the next block current. Returns false at the end of the input.
+*/
+bool Input_Source::next_block_()
+{
+  block_pos_ = 0;
+
+#ifdef __PREFETCH
+  if (worker_.joinable()) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this]{ return worker_done_ or not blocks_.empty(); });
+    if (not blocks_.empty()) {
+      block_ = std::move(blocks_.front());
+      blocks_.pop_front();
+      cond_.notify_all();
+      return true;
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    block_.clear();
+    return false;
+  }
+#endif
+
+  block_.resize(block_size_);
+  block_.resize(decoder_->read(block_.data(), block_.size()));
+  return not block_.empty();
+}
+
+/**
+  Reads up to size bytes into the buffer. Less than that are only returned at the end of the input.
+*/
+size_t Input_Source::read(char* buffer, const size_t size)
+{
+  size_t num_read = 0;
+  while (num_read < size and not done_) {
+    if (block_pos_ == block_.size() and not next_block_()) {
+      done_ = true;
+      break;
+    }
+    const auto num_copy = std::min(size - num_read, block_.size() - block_pos_);
+    std::memcpy(buffer + num_read, block_.data() + block_pos_, num_copy);
+    block_pos_ += num_copy;
+    num_read += num_copy;
+  }
+  return num_read;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <exception>
+#include <cstddef>
+
+#ifdef __PREFETCH
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+/**
+ * Sequential byte source for query files that may be compressed: plain, gzip (including
+ * multi-member files such as bgzf) or zstd, as detected from the first bytes of the file.
+ * Compressed formats need the respective library at build time (__ZLIB, __ZSTD).
+ *
+ * With __PREFETCH, decompression runs on a dedicated thread that stays a few blocks ahead of
+ * the reader, such that it overlaps with parsing and placement.
+ */
+class Input_Source
+{
+public:
+  enum class Format {
+    kPlain,
+    kGzip,
+    kZstd
+  };
+
+  // decompression of one format, see Input_Source.cpp
+  class Decoder
+  {
+  public:
+    virtual ~Decoder() = default;
+    // fills the buffer as far as possible, returns the number of bytes, 0 meaning the end
+    virtual size_t read(char* buffer, const size_t size) = 0;
+  };
+
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 1ul << 22;
+  static constexpr size_t PREFETCH_BLOCKS = 4;
+
+  explicit Input_Source(const std::string& file_name,
+                        const size_t block_size = DEFAULT_BLOCK_SIZE);
+  Input_Source()  = delete;
+  ~Input_Source();
+
+  Input_Source(Input_Source const& other) = delete;
+  Input_Source(Input_Source&& other)      = delete;
+
+  Input_Source& operator= (Input_Source const& other) = delete;
+  Input_Source& operator= (Input_Source && other)     = delete;
+
+  static Format detect(const std::string& file_name);
+
+  size_t read(char* buffer, const size_t size);
+
+  Format format() const { return format_; }
+
+private:
+  bool next_block_();
+
+  Format format_ = Format::kPlain;
+  std::unique_ptr<Decoder> decoder_;
+  size_t block_size_;
+
+  // the block currently read from
+  std::vector<char> block_;
+  size_t block_pos_ = 0;
+  bool done_ = false;
+
+#ifdef __PREFETCH
+  void decompress_();
+
+  std::thread worker_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::vector<char>> blocks_;
+  bool worker_done_ = false;
+  bool stop_ = false;
+  std::exception_ptr error_;
+#endif
+};
@@ -0,0 +1,182 @@
+#include "io/Memory_Map.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <utility>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static std::string errno_string()
+{
+  return std::string(std::strerror(errno));
+}
+
+// POSIX requires shared memory object names to start with a single slash
+static std::string shared_name(const std::string& name)
+{
+  if (name.empty()) {
+    throw std::invalid_argument{"Shared memory segment name must not be empty."};
+  }
+  return (name.front() == '/') ? name : "/" + name;
+}
+
+static char * map_fd(const int fd, const size_t size, const bool writable)
+{
+  const int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+  void * ptr = mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+  if (ptr == MAP_FAILED) {
+    return nullptr;
+  }
+  return static_cast<char *>(ptr);
+}
+
+static size_t fd_size(const int fd)
+{
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return 0;
+  }
+  return static_cast<size_t>(st.st_size);
+}
+
+Memory_Map::~Memory_Map()
+{
+  unmap_();
+}
+
+Memory_Map::Memory_Map(Memory_Map&& other)
+{
+  std::swap(data_, other.data_);
+  std::swap(size_, other.size_);
+}
+
+Memory_Map& Memory_Map::operator=(Memory_Map&& other)
+{
+  if (this != &other) {
+    unmap_();
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+  }
+  return *this;
+}
+
+void Memory_Map::unmap_()
+{
+  if (data_) {
+    munmap(data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+/**
+  Hints to the kernel that the given range is not needed for now, dropping it from the
+  resident set. Only safe for read-only mappings, where the pages can simply be faulted
+  back in from their backing file on the next access.
+*/
+void Memory_Map::discard(void const * const ptr, const size_t size) const
+{
+  if (not contains(ptr)) {
+    return;
+  }
+  const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const auto begin = static_cast<size_t>(static_cast<char const *>(ptr) - data_);
+  const auto page_begin = begin / page_size * page_size;
+  const auto end = std::min(begin + size, size_);
+  madvise(data_ + page_begin, end - page_begin, MADV_DONTNEED);
+}
+
+/**
+  Asks the OS to start reading the pages of the given range in the background, such that
+  a later access does not have to wait for the disk.
+*/
+void Memory_Map::will_need(void const * const ptr, const size_t size) const
+{
+  if (not contains(ptr)) {
+    return;
+  }
+  const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const auto begin = static_cast<size_t>(static_cast<char const *>(ptr) - data_);
+  const auto page_begin = begin / page_size * page_size;
+  const auto end = std::min(begin + size, size_);
+  madvise(data_ + page_begin, end - page_begin, MADV_WILLNEED);
+}
+
+Memory_Map Memory_Map::open_file(const std::string& file_path)
+{
+  const int fd = open(file_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error{"Could not open file for mapping: " + file_path + " (" + errno_string() + ")"};
+  }
+
+  const auto size = fd_size(fd);
+  auto data = size ? map_fd(fd, size, false) : nullptr;
+  close(fd);
+
+  if (not data) {
+    throw std::runtime_error{"Could not map file: " + file_path + " (" + errno_string() + ")"};
+  }
+
+  return Memory_Map(data, size);
+}
+
+Memory_Map Memory_Map::open_shared(const std::string& name)
+{
+  const auto shm_name = shared_name(name);
+  const int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    throw std::runtime_error{"Could not open shared memory segment: " + shm_name + " (" + errno_string() + ")"};
+  }
+
+  const auto size = fd_size(fd);
+  auto data = size ? map_fd(fd, size, false) : nullptr;
+  close(fd);
+
+  if (not data) {
+    throw std::runtime_error{"Could not map shared memory segment: " + shm_name + " (" + errno_string() + ")"};
+  }
+
+  return Memory_Map(data, size);
+}
+
+Memory_Map Memory_Map::create_shared(const std::string& name, const size_t size)
+{
+  const auto shm_name = shared_name(name);
+  // fail if the segment exists, so we never overwrite pages someone else has mapped
+  const int fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd < 0) {
+    throw std::runtime_error{"Could not create shared memory segment: " + shm_name + " (" + errno_string()
+      + "). If a stale segment exists, remove it first."};
+  }
+
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    const auto msg = errno_string();
+    close(fd);
+    shm_unlink(shm_name.c_str());
+    throw std::runtime_error{"Could not size shared memory segment: " + shm_name + " (" + msg + ")"};
+  }
+
+  auto data = map_fd(fd, size, true);
+  close(fd);
+
+  if (not data) {
+    const auto msg = errno_string();
+    shm_unlink(shm_name.c_str());
+    throw std::runtime_error{"Could not map shared memory segment: " + shm_name + " (" + msg + ")"};
+  }
+
+  return Memory_Map(data, size);
+}
+
+void Memory_Map::unlink_shared(const std::string& name)
+{
+  const auto shm_name = shared_name(name);
+  if (shm_unlink(shm_name.c_str()) != 0) {
+    throw std::runtime_error{"Could not remove shared memory segment: " + shm_name + " (" + errno_string() + ")"};
+  }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+/**
+ * RAII wrapper around a memory mapping, either of a regular file or of a named
+ * POSIX shared memory segment.
+ *
+ * Mappings obtained via open_file/open_shared are read-only. create_shared produces
+ * a writable mapping of a fresh segment, intended to be filled exactly once.
+ */
+class Memory_Map
+{
+public:
+  Memory_Map() = default;
+  ~Memory_Map();
+
+  Memory_Map(Memory_Map const& other) = delete;
+  Memory_Map(Memory_Map&& other);
+
+  Memory_Map& operator= (Memory_Map const& other) = delete;
+  Memory_Map& operator= (Memory_Map && other);
+
+  static Memory_Map open_file(const std::string& file_path);
+  static Memory_Map open_shared(const std::string& name);
+  static Memory_Map create_shared(const std::string& name, const size_t size);
+  static void unlink_shared(const std::string& name);
+
+  // member access
+  char const * data() const { return data_; }
+  char * data() { return data_; }
+  size_t size() const { return size_; }
+  explicit operator bool() const { return data_ != nullptr; }
+
+  template <class T>
+  T const * at(const size_t offset) const
+  {
+    return reinterpret_cast<T const *>(data_ + offset);
+  }
+
+  void discard(void const * const ptr, const size_t size) const;
+  void will_need(void const * const ptr, const size_t size) const;
+
+  bool contains(void const * const ptr) const
+  {
+    auto const p = static_cast<char const *>(ptr);
+    return data_ and p >= data_ and p < data_ + size_;
+  }
+
+private:
+  Memory_Map(char * data, const size_t size)
+    : data_(data)
+    , size_(size)
+  { }
+
+  void unmap_();
+
+  char * data_  = nullptr;
+  size_t size_  = 0;
+};
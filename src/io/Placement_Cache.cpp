@@ -0,0 +1,311 @@
+#include "io/Placement_Cache.hpp"
+
+#include <stdexcept>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "tree/Tree.hpp"
+#include "core/pll/pll_util.hpp"
+#include "net/mpihead.hpp"
+#include "util/logging.hpp"
+
+static constexpr char MAGIC[8] = "EPACACH";
+static constexpr size_t CONTEXT_SIZE = 32;
+static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 2 * sizeof(uint32_t) + CONTEXT_SIZE;
+// per record: the sequence hash and number of placements, then the placements
+static constexpr size_t RECORD_HEAD_SIZE = 2 * sizeof(uint64_t) + sizeof(uint32_t);
+static constexpr size_t PLACEMENT_SIZE = sizeof(uint64_t) + 4 * sizeof(double);
+
+static std::string to_hex(const sequence_hash_type& hash)
+{
+  std::ostringstream result;
+  result << std::hex << std::setfill('0')
+         << std::setw(16) << hash.first
+         << std::setw(16) << hash.second;
+  return result.str();
+}
+
+static bool starts_with(const std::string& str, const std::string& prefix)
+{
+  return str.size() >= prefix.size() and str.compare(0, prefix.size(), prefix) == 0;
+}
+
+static bool ends_with(const std::string& str, const std::string& suffix)
+{
+  return str.size() >= suffix.size()
+    and str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/**
+  Condenses everything that determines the placement result of a sequence, besides the
+  sequence itself, into one string: the reference tree and model, and the relevant options.
+*/
+std::string Placement_Cache::make_context(Tree& reference_tree, const Options& options)
+{
+  std::ostringstream context;
+  context << "tree: " << get_numbered_newick_string(reference_tree.tree(), reference_tree.mapper(), 10);
+  context << "\nmodel: ";
+  context << reference_tree.model();
+  context << "\nsites: " << reference_tree.partition()->sites;
+  context << "\nlogl: " << std::setprecision(8) << reference_tree.ref_tree_logl();
+  context << "\nsettings: "
+          << options.prescoring << " "
+          << options.prescoring_by_percentage << " "
+          << options.prescoring_threshold << " "
+          << options.baseball << " "
+          << options.sliding_blo << " "
+          << options.opt_model << " "
+          << options.opt_branches << " "
+          << options.support_threshold << " "
+          << options.acc_threshold << " "
+          << options.filter_min << " "
+          << options.filter_max << " "
+          << options.premasking << " "
+          << options.repeats << " "
+          << static_cast<int>(options.scaling);
+  return context.str();
+}
+
+std::string Placement_Cache::hash_context(const std::string& context)
+{
+  return to_hex(hash_sequence(context));
+}
+
+Placement_Cache::Placement_Cache(const std::string& cache_dir, const std::string& context)
+  : context_hash_(hash_context(context))
+{
+  int local_rank = 0;
+  MPI_COMM_RANK(MPI_COMM_WORLD, &local_rank);
+
+  auto dir = cache_dir;
+  if (not dir.empty() and dir.back() != '/') {
+    dir += "/";
+  }
+
+  const auto prefix = "epa_cache_" + context_hash_ + ".";
+  const auto own_name = prefix + std::to_string(local_rank) + ".bin";
+  const auto own_path = dir + own_name;
+
+  // read the index of all files of this context, including those of other ranks
+  auto dir_handle = ::opendir(dir.c_str());
+  if (not dir_handle) {
+    throw std::runtime_error{std::string("Cannot open cache directory: ") + cache_dir};
+  }
+  bool own_exists = false;
+  while (auto entry = ::readdir(dir_handle)) {
+    const std::string name(entry->d_name);
+    if (starts_with(name, prefix) and ends_with(name, ".bin")) {
+      if (name == own_name) {
+        own_exists = true;
+      } else {
+        load_(dir + name, false);
+      }
+    }
+  }
+  ::closedir(dir_handle);
+
+  if (not own_exists) {
+    auto file = std::fopen(own_path.c_str(), "wb");
+    if (not file) {
+      throw std::runtime_error{own_path + ": could not create cache file!"};
+    }
+    const uint32_t version = VERSION;
+    const uint32_t reserved = 0;
+    std::fwrite(MAGIC, sizeof(MAGIC), 1, file);
+    std::fwrite(&version, sizeof(version), 1, file);
+    std::fwrite(&reserved, sizeof(reserved), 1, file);
+    std::fwrite(context_hash_.data(), CONTEXT_SIZE, 1, file);
+    std::fclose(file);
+  }
+
+  out_file_id_ = files_.size();
+  load_(own_path, true);
+
+  out_file_ = std::fopen(own_path.c_str(), "ab");
+  if (not out_file_) {
+    throw std::runtime_error{own_path + ": could not open cache file for writing!"};
+  }
+
+  LOG_INFO << "Placement cache holds " << index_.size() << " sequences";
+}
+
+Placement_Cache::~Placement_Cache()
+{
+  if (out_file_) {
+    std::fclose(out_file_);
+  }
+}
+
+/**
+  Indexes the records of a cache file. A record cut short by an interrupted run ends the
+  file: it is ignored, and for the file of this rank truncated, so appending may continue.
+*/
+void Placement_Cache::load_(const std::string& file_path, const bool own)
+{
+  auto file = std::make_unique<std::ifstream>(file_path, std::ifstream::binary);
+  if (not file->is_open()) {
+    throw std::runtime_error{file_path + ": could not open cache file!"};
+  }
+
+  file->seekg(0, std::ifstream::end);
+  const uint64_t file_size = file->tellg();
+  file->seekg(0, std::ifstream::beg);
+
+  char magic[sizeof(MAGIC)];
+  uint32_t version = 0;
+  uint32_t reserved = 0;
+  std::string context(CONTEXT_SIZE, ' ');
+  file->read(magic, sizeof(magic));
+  file->read(reinterpret_cast<char*>(&version), sizeof(version));
+  file->read(reinterpret_cast<char*>(&reserved), sizeof(reserved));
+  file->read(&context[0], CONTEXT_SIZE);
+
+  if (not *file or std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+    throw std::runtime_error{file_path + " is not an epa-ng placement cache file."};
+  }
+  if (version != VERSION) {
+    throw std::runtime_error{file_path + " has version " + std::to_string(version)
+      + ", expected " + std::to_string(VERSION)};
+  }
+  if (context != context_hash_) {
+    throw std::runtime_error{file_path + " belongs to a different reference or settings."};
+  }
+
+  const auto file_id = files_.size();
+  uint64_t offset = HEADER_SIZE;
+  while (offset + RECORD_HEAD_SIZE <= file_size) {
+    hash_type hash;
+    uint32_t count = 0;
+    file->read(reinterpret_cast<char*>(&hash.first), sizeof(hash.first));
+    file->read(reinterpret_cast<char*>(&hash.second), sizeof(hash.second));
+    file->read(reinterpret_cast<char*>(&count), sizeof(count));
+
+    const uint64_t end = offset + RECORD_HEAD_SIZE + count * PLACEMENT_SIZE;
+    if (not *file or end > file_size) {
+      break;
+    }
+
+    index_[hash] = Location{file_id, offset + RECORD_HEAD_SIZE, count};
+    file->seekg(end);
+    offset = end;
+  }
+
+  if (offset < file_size) {
+    LOG_WARN << file_path << ": ignoring incomplete trailing record";
+    if (own and ::truncate(file_path.c_str(), offset) != 0) {
+      throw std::runtime_error{file_path + ": could not truncate incomplete record!"};
+    }
+  }
+
+  if (own) {
+    out_offset_ = offset;
+  }
+
+  file->clear();
+  files_.push_back(std::move(file));
+}
+
+std::vector<Placement> Placement_Cache::read_(const Location& location)
+{
+  auto& file = *files_[location.file];
+  file.clear();
+  file.seekg(location.offset);
+
+  std::vector<Placement> result;
+  for (size_t i = 0; i < location.count; ++i) {
+    uint64_t branch_id = 0;
+    double values[4];
+    file.read(reinterpret_cast<char*>(&branch_id), sizeof(branch_id));
+    file.read(reinterpret_cast<char*>(values), sizeof(values));
+    if (not file) {
+      throw std::runtime_error{"Reading from the placement cache failed!"};
+    }
+    // likelihood, lwr, pendant length, distal length
+    result.emplace_back(branch_id, values[0], values[2], values[3]);
+    result.back().lwr(values[1]);
+  }
+  return result;
+}
+
+void Placement_Cache::write_(const hash_type& hash, const PQuery<Placement>& pquery)
+{
+  const uint32_t count = pquery.size();
+  std::fwrite(&hash.first, sizeof(hash.first), 1, out_file_);
+  std::fwrite(&hash.second, sizeof(hash.second), 1, out_file_);
+  std::fwrite(&count, sizeof(count), 1, out_file_);
+  for (const auto& placement : pquery) {
+    const uint64_t branch_id = placement.branch_id();
+    const double values[4] = { placement.likelihood(),
+                               placement.lwr(),
+                               placement.pendant_length(),
+                               placement.distal_length() };
+    std::fwrite(&branch_id, sizeof(branch_id), 1, out_file_);
+    std::fwrite(values, sizeof(values), 1, out_file_);
+  }
+
+  index_[hash] = Location{out_file_id_, out_offset_ + RECORD_HEAD_SIZE, count};
+  out_offset_ += RECORD_HEAD_SIZE + count * PLACEMENT_SIZE;
+}
+
+/**
+  Removes the sequences with a cached result from the chunk.
+*/
+void Placement_Cache::filter(MSA& chunk)
+{
+  chunk_hashes_.clear();
+  chunk_positions_.clear();
+  chunk_hits_.clear();
+
+  // the misses are moved to the front of the chunk, keeping their storage
+  const auto misses = chunk.begin();
+  size_t num_misses = 0;
+  size_t position = 0;
+  for (auto& seq : chunk) {
+    const auto hash = hash_sequence(seq.sequence());
+    const auto cached = index_.find(hash);
+    if (cached != index_.end()) {
+      chunk_hits_.emplace_back(seq.header(), seq.abundance(), position, cached->second);
+      ++hits_;
+    } else {
+      chunk_hashes_.push_back(hash);
+      chunk_positions_.push_back(position);
+      if (num_misses != position) {
+        misses[num_misses] = std::move(seq);
+      }
+      ++num_misses;
+      ++misses_;
+    }
+    ++position;
+  }
+
+  chunk.erase(misses + num_misses, chunk.end());
+}
+
+/**
+  Completes the result of placing a filtered chunk (with a sequence id offset of 0):
+  stores the new results, restores the original sequence ids and adds the cached results.
+*/
+void Placement_Cache::expand(Sample<Placement>& sample, const size_t seq_id_offset)
+{
+  for (auto& pquery : sample) {
+    const auto local_id = pquery.sequence_id();
+    const auto& hash = chunk_hashes_[local_id];
+    if (index_.find(hash) == index_.end()) {
+      write_(hash, pquery);
+    }
+    pquery.sequence_id(seq_id_offset + chunk_positions_[local_id]);
+  }
+  std::fflush(out_file_);
+
+  for (const auto& hit : chunk_hits_) {
+    PQuery<Placement> pquery(seq_id_offset + std::get<2>(hit), std::get<0>(hit), std::get<1>(hit));
+    const auto placements = read_(std::get<3>(hit));
+    pquery.append(placements.begin(), placements.end());
+    sample.push_back(std::move(pquery));
+  }
+  chunk_hits_.clear();
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <tuple>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+#include <cstdint>
+#include <cstdio>
+
+#include "seq/MSA.hpp"
+#include "seq/sequence_hash.hpp"
+#include "sample/Sample.hpp"
+#include "util/Options.hpp"
+
+class Tree;
+
+/**
+ * Persistent cache of placement results, such that sequences placed in a previous run
+ * against the same reference with the same settings are not placed again.
+ *
+ * Results are keyed by the hash of the masked sequence. The reference and all settings that
+ * influence the result are condensed into a context hash, which is part of the file names,
+ * so one cache directory may hold results for any number of references. Files are append-only
+ * logs of filtered placements: on startup only an index is built, and cached placements are read
+ * on a hit. Every MPI rank appends to its own file, but reads those of all ranks.
+ *
+ * Usage per chunk, like Duplicate_Filter: filter() before placement, expand() on the result.
+ */
+class Placement_Cache
+{
+public:
+  static constexpr uint32_t VERSION = 2;
+  using hash_type = sequence_hash_type;
+
+  Placement_Cache(const std::string& cache_dir, const std::string& context);
+  Placement_Cache()  = delete;
+  ~Placement_Cache();
+
+  Placement_Cache(Placement_Cache const& other) = delete;
+  Placement_Cache(Placement_Cache&& other)      = delete;
+
+  Placement_Cache& operator= (Placement_Cache const& other) = delete;
+  Placement_Cache& operator= (Placement_Cache && other)     = delete;
+
+  static std::string make_context(Tree& reference_tree, const Options& options);
+  static std::string hash_context(const std::string& context);
+
+  void filter(MSA& chunk);
+  void expand(Sample<Placement>& sample, const size_t seq_id_offset);
+
+  // member access
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+  size_t size() const { return index_.size(); }
+
+private:
+  struct Location
+  {
+    size_t file;
+    uint64_t offset;
+    uint32_t count;
+  };
+
+  void load_(const std::string& file_path, const bool own);
+  std::vector<Placement> read_(const Location& location);
+  void write_(const hash_type& hash, const PQuery<Placement>& pquery);
+
+  std::string context_hash_;
+  std::vector<std::unique_ptr<std::ifstream>> files_;
+  std::unordered_map<hash_type, Location, sequence_hash_hasher> index_;
+
+  // this ranks file, appended to
+  std::FILE* out_file_ = nullptr;
+  size_t out_file_id_ = 0;
+  uint64_t out_offset_ = 0;
+
+  // bookkeeping of the current chunk, per remaining sequence
+  std::vector<hash_type> chunk_hashes_;
+  std::vector<size_t> chunk_positions_;
+  // cache hits: header, abundance, position in the chunk, location of the placements
+  std::vector<std::tuple<std::string, size_t, size_t, Location>> chunk_hits_;
+
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+};
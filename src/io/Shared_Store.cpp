@@ -0,0 +1,257 @@
+#include "io/Shared_Store.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#include <atomic>
+#include <vector>
+
+#include "tree/Tree.hpp"
+#include "core/Lookup_Store.hpp"
+#include "util/logging.hpp"
+
+static constexpr char MAGIC[8] = "EPASHM";
+static constexpr size_t BLOCK_ALIGNMENT = 64;
+
+static size_t align_up(const size_t offset)
+{
+  return (offset + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+}
+
+static size_t clv_size(pll_partition_t const * const partition)
+{
+  const size_t sites = partition->sites + partition->asc_additional_sites;
+  return sites * partition->states_padded * partition->rate_cats;
+}
+
+static size_t scaler_size(pll_partition_t const * const partition)
+{
+  const size_t sites = partition->sites + partition->asc_additional_sites;
+  return (partition->attributes & PLL_ATTRIB_RATE_SCALERS) ? sites * partition->rate_cats : sites;
+}
+
+void publish_to_shared(Tree& tree, Lookup_Store& lookups, const std::string& name)
+{
+  auto partition = tree.partition();
+
+  if (partition->attributes & PLL_ATTRIB_SITE_REPEATS) {
+    throw std::runtime_error{"Publishing to shared memory is not supported with site repeats."};
+  }
+
+  const size_t num_clvs     = partition->tips + partition->clv_buffers;
+  const size_t num_scalers  = partition->scale_buffers;
+  const size_t num_branches = lookups.num_branches();
+  const size_t clv_bytes    = clv_size(partition) * sizeof(double);
+  const size_t scaler_bytes = scaler_size(partition) * sizeof(unsigned int);
+  const size_t lookup_bytes = partition->sites * lookups.char_map_size() * sizeof(double);
+
+  // compute the layout: header, offset tables, then the data blocks
+  Shared_Store::Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version        = Shared_Store::VERSION;
+  header.tips           = partition->tips;
+  header.clv_buffers    = partition->clv_buffers;
+  header.scale_buffers  = partition->scale_buffers;
+  header.sites          = partition->sites;
+  header.states         = partition->states;
+  header.states_padded  = partition->states_padded;
+  header.rate_cats      = partition->rate_cats;
+  header.attributes     = partition->attributes;
+  header.clv_size       = clv_size(partition);
+  header.scaler_size    = scaler_size(partition);
+  header.num_branches   = num_branches;
+  header.lookup_cols    = lookups.char_map_size();
+  header.logl           = tree.ref_tree_logl();
+
+  size_t offset = align_up(sizeof(Shared_Store::Header));
+  header.clv_table = offset;
+  offset = align_up(offset + num_clvs * sizeof(uint64_t));
+  header.scaler_table = offset;
+  offset = align_up(offset + num_scalers * sizeof(uint64_t));
+  header.lookup_table = offset;
+  offset = align_up(offset + num_branches * sizeof(uint64_t));
+
+  // only inner CLVs are shared, tips are cheap to set up from the MSA
+  std::vector<uint64_t> clv_offsets(num_clvs, 0);
+  for (size_t i = partition->tips; i < num_clvs; ++i) {
+    if (partition->clv[i]) {
+      clv_offsets[i] = offset;
+      offset = align_up(offset + clv_bytes);
+    }
+  }
+
+  std::vector<uint64_t> scaler_offsets(num_scalers, 0);
+  for (size_t i = 0; i < num_scalers; ++i) {
+    if (partition->scale_buffer[i]) {
+      scaler_offsets[i] = offset;
+      offset = align_up(offset + scaler_bytes);
+    }
+  }
+
+  std::vector<uint64_t> lookup_offsets(num_branches, 0);
+  for (size_t i = 0; i < num_branches; ++i) {
+    if (lookups.has_branch(i)) {
+      lookup_offsets[i] = offset;
+      offset = align_up(offset + lookup_bytes);
+    }
+  }
+
+  header.total_size = offset;
+
+  auto map = Memory_Map::create_shared(name, header.total_size);
+  auto data = map.data();
+
+  std::memcpy(data + header.clv_table, clv_offsets.data(), num_clvs * sizeof(uint64_t));
+  std::memcpy(data + header.scaler_table, scaler_offsets.data(), num_scalers * sizeof(uint64_t));
+  std::memcpy(data + header.lookup_table, lookup_offsets.data(), num_branches * sizeof(uint64_t));
+
+  for (size_t i = 0; i < num_clvs; ++i) {
+    if (clv_offsets[i]) {
+      std::memcpy(data + clv_offsets[i], partition->clv[i], clv_bytes);
+    }
+  }
+
+  for (size_t i = 0; i < num_scalers; ++i) {
+    if (scaler_offsets[i]) {
+      std::memcpy(data + scaler_offsets[i], partition->scale_buffer[i], scaler_bytes);
+    }
+  }
+
+  for (size_t i = 0; i < num_branches; ++i) {
+    if (lookup_offsets[i]) {
+      std::memcpy(data + lookup_offsets[i], lookups.branch_data(i), lookup_bytes);
+    }
+  }
+
+  std::memcpy(data, &header, sizeof(header));
+
+  // only flag the segment as ready once everything else is visible
+  std::atomic_thread_fence(std::memory_order_release);
+  reinterpret_cast<Shared_Store::Header*>(data)->ready = 1;
+
+  LOG_INFO << "Published reference to shared memory segment '" << name << "' ("
+           << header.total_size / (1024 * 1024) << " MiB)";
+}
+
+Shared_Store::Shared_Store(const std::string& name)
+  : name_(name)
+  , map_(Memory_Map::open_shared(name))
+{
+  if (map_.size() < sizeof(Header)) {
+    throw std::runtime_error{"Shared memory segment '" + name + "' is too small to be a reference store."};
+  }
+
+  header_ = map_.at<Header>(0);
+
+  if (std::memcmp(header_->magic, MAGIC, sizeof(MAGIC)) != 0) {
+    throw std::runtime_error{"Shared memory segment '" + name + "' is not an epa-ng reference store."};
+  }
+
+  if (header_->version != VERSION) {
+    throw std::runtime_error{std::string("Shared memory segment '") + name + "' has version "
+      + std::to_string(header_->version) + ", expected " + std::to_string(VERSION)};
+  }
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (not header_->ready or header_->total_size != map_.size()) {
+    throw std::runtime_error{"Shared memory segment '" + name + "' is incomplete. Was publishing interrupted?"};
+  }
+}
+
+uint64_t const * Shared_Store::table_(const uint64_t offset) const
+{
+  return map_.at<uint64_t>(offset);
+}
+
+/**
+  Ensures the given partition has the same dimensions as the published one.
+*/
+void Shared_Store::validate(pll_partition_t const * const partition) const
+{
+  const auto& h = *header_;
+  if (h.tips != partition->tips
+      or h.clv_buffers != partition->clv_buffers
+      or h.scale_buffers != partition->scale_buffers
+      or h.sites != partition->sites
+      or h.states != partition->states
+      or h.states_padded != partition->states_padded
+      or h.rate_cats != partition->rate_cats
+      or h.attributes != partition->attributes
+      or h.clv_size != clv_size(partition)
+      or h.scaler_size != scaler_size(partition)) {
+    throw std::runtime_error{"Shared memory segment '" + name_
+      + "' does not match the dimensions of the given reference tree/MSA/model."};
+  }
+}
+
+/**
+  As a cheap proxy for "same tree, same MSA, same model", compares the
+  reference tree log-likelihood computed on the attached CLVs against the published one.
+*/
+void Shared_Store::validate(const double logl) const
+{
+  if (std::fabs(logl - header_->logl) > 1e-6 * std::fabs(header_->logl)) {
+    throw std::runtime_error{"Shared memory segment '" + name_
+      + "' was published for a different reference: log-likelihood " + std::to_string(header_->logl)
+      + " vs. " + std::to_string(logl)};
+  }
+}
+
+/**
+  Points the inner CLVs and scalers of the partition into the shared segment,
+  freeing the buffers allocated by pll_partition_create.
+*/
+void Shared_Store::assign(pll_partition_t * partition) const
+{
+  const auto clv_offsets = table_(header_->clv_table);
+  for (size_t i = 0; i < header_->tips + header_->clv_buffers; ++i) {
+    if (clv_offsets[i]) {
+      pll_aligned_free(partition->clv[i]);
+      partition->clv[i] = const_cast<double*>(map_.at<double>(clv_offsets[i]));
+    }
+  }
+
+  const auto scaler_offsets = table_(header_->scaler_table);
+  for (size_t i = 0; i < header_->scale_buffers; ++i) {
+    if (scaler_offsets[i]) {
+      pll_aligned_free(partition->scale_buffer[i]);
+      partition->scale_buffer[i] = const_cast<unsigned int*>(map_.at<unsigned int>(scaler_offsets[i]));
+    }
+  }
+}
+
+/**
+  Nulls any pointers into the shared segment, such that the partition can be
+  safely destroyed via pll_partition_destroy.
+*/
+void Shared_Store::release(pll_partition_t * partition) const
+{
+  for (size_t i = 0; i < partition->tips + partition->clv_buffers; ++i) {
+    if (map_.contains(partition->clv[i])) {
+      partition->clv[i] = nullptr;
+    }
+  }
+
+  for (size_t i = 0; i < partition->scale_buffers; ++i) {
+    if (map_.contains(partition->scale_buffer[i])) {
+      partition->scale_buffer[i] = nullptr;
+    }
+  }
+}
+
+void Shared_Store::assign(Lookup_Store& lookups) const
+{
+  if (lookups.num_branches() != header_->num_branches
+      or lookups.char_map_size() != header_->lookup_cols) {
+    throw std::runtime_error{"Shared memory segment '" + name_
+      + "' lookup tables do not match the reference tree."};
+  }
+
+  const auto lookup_offsets = table_(header_->lookup_table);
+  for (size_t i = 0; i < header_->num_branches; ++i) {
+    if (lookup_offsets[i]) {
+      lookups.attach_branch(i, map_.at<double>(lookup_offsets[i]));
+    }
+  }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "core/pll/pllhead.hpp"
+#include "io/Memory_Map.hpp"
+
+class Tree;
+class Lookup_Store;
+
+/**
+ * Read-only view of a reference (inner CLVs, scalers and per-branch lookup tables)
+ * that was published to a named POSIX shared memory segment by another process.
+ *
+ * Attaching processes point their partition directly into the mapped pages, meaning
+ * the physical memory is shared between all processes on a host, and no CLV has to
+ * be recomputed. As the mapping is read-only, the reference partition must not be
+ * written to while attached.
+ */
+class Shared_Store
+{
+public:
+  static constexpr uint32_t VERSION = 1;
+
+  struct Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t ready;
+    uint64_t tips;
+    uint64_t clv_buffers;
+    uint64_t scale_buffers;
+    uint64_t sites;
+    uint64_t states;
+    uint64_t states_padded;
+    uint64_t rate_cats;
+    uint64_t attributes;
+    uint64_t clv_size;
+    uint64_t scaler_size;
+    uint64_t num_branches;
+    uint64_t lookup_cols;
+    double logl;
+    // offsets to the per-buffer offset tables. An entry of 0 means "not present"
+    uint64_t clv_table;
+    uint64_t scaler_table;
+    uint64_t lookup_table;
+    uint64_t total_size;
+  };
+
+  explicit Shared_Store(const std::string& name);
+  Shared_Store()  = delete;
+  ~Shared_Store() = default;
+
+  Shared_Store(Shared_Store const& other) = delete;
+  Shared_Store(Shared_Store&& other)      = default;
+
+  Shared_Store& operator= (Shared_Store const& other) = delete;
+  Shared_Store& operator= (Shared_Store && other)     = default;
+
+  // member access
+  const Header& header() const { return *header_; }
+  const std::string& name() const { return name_; }
+
+  void assign(pll_partition_t * partition) const;
+  void release(pll_partition_t * partition) const;
+  void assign(Lookup_Store& lookups) const;
+  void validate(pll_partition_t const * const partition) const;
+  void validate(const double logl) const;
+
+private:
+  uint64_t const * table_(const uint64_t offset) const;
+
+  std::string name_;
+  Memory_Map map_;
+  Header const * header_ = nullptr;
+};
+
+void publish_to_shared(Tree& tree, Lookup_Store& lookups, const std::string& name);
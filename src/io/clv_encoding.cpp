@@ -0,0 +1,157 @@
+#include "io/clv_encoding.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+static constexpr double SCALED16_MAX = std::numeric_limits<uint16_t>::max();
+
+static size_t padded(const size_t bytes)
+{
+  return (bytes + 7u) / 8u * 8u;
+}
+
+static size_t mantissa_size(const Options::ClvPrecision precision)
+{
+  switch (precision) {
+    case Options::ClvPrecision::kFloat:
+      return sizeof(float);
+    case Options::ClvPrecision::kScaled16:
+      return sizeof(uint16_t);
+    default:
+      throw std::invalid_argument{"Not a reduced CLV precision."};
+  }
+}
+
+/**
+  Upper bound of the error of a decoded value, relative to the largest value of its site.
+*/
+double clv_precision_epsilon(const Options::ClvPrecision precision)
+{
+  switch (precision) {
+    case Options::ClvPrecision::kDouble:
+      return 0.0;
+    case Options::ClvPrecision::kFloat:
+      return std::ldexp(1.0, -24);
+    case Options::ClvPrecision::kScaled16:
+      return 1.0 / SCALED16_MAX;
+  }
+  return 0.0;
+}
+
+/**
+  Encodes the CLV of given size into a block of the given reduced precision.
+  Sets max_error to the largest measured error of any decoded entry, relative to its site maximum.
+*/
+std::vector<char> encode_clv( double const * const clv,
+                              const size_t size,
+                              const size_t span,
+                              const Options::ClvPrecision precision,
+                              double& max_error)
+{
+  if (span == 0 or size % span) {
+    throw std::invalid_argument{"CLV size is not a multiple of the per-site span."};
+  }
+
+  CLV_Block_Meta meta;
+  meta.encoding = static_cast<uint32_t>(precision);
+  meta.span     = span;
+  meta.sites    = size / span;
+
+  const size_t exponents_offset = padded(sizeof(CLV_Block_Meta));
+  const size_t mantissas_offset = exponents_offset + padded(meta.sites * sizeof(int16_t));
+  std::vector<char> block(mantissas_offset + size * mantissa_size(precision));
+
+  std::memcpy(block.data(), &meta, sizeof(CLV_Block_Meta));
+  auto exponents = reinterpret_cast<int16_t*>(block.data() + exponents_offset);
+  auto mantissas = block.data() + mantissas_offset;
+
+  max_error = 0.0;
+
+  for (size_t site = 0; site < meta.sites; ++site) {
+    auto const values = clv + site * span;
+    const double site_max = *std::max_element(values, values + span);
+
+    int exponent = 0;
+    if (site_max > 0.0) {
+      std::frexp(site_max, &exponent);
+    }
+    exponent = std::max<int>(exponent, std::numeric_limits<int16_t>::min());
+    exponents[site] = static_cast<int16_t>(exponent);
+
+    for (size_t i = 0; i < span; ++i) {
+      // in [0, 1)
+      const double normalized = std::ldexp(values[i], -exponent);
+      double decoded = 0.0;
+
+      if (precision == Options::ClvPrecision::kFloat) {
+        const float mantissa = static_cast<float>(normalized);
+        std::memcpy(mantissas + (site * span + i) * sizeof(float), &mantissa, sizeof(float));
+        decoded = mantissa;
+      } else {
+        const uint16_t mantissa = static_cast<uint16_t>(std::lround(normalized * SCALED16_MAX));
+        std::memcpy(mantissas + (site * span + i) * sizeof(uint16_t), &mantissa, sizeof(uint16_t));
+        decoded = mantissa / SCALED16_MAX;
+      }
+
+      if (site_max > 0.0) {
+        const double error = std::fabs(std::ldexp(decoded, exponent) - values[i]) / site_max;
+        max_error = std::max(max_error, error);
+      }
+    }
+  }
+
+  return block;
+}
+
+/**
+  Decodes a block created by encode_clv into a CLV buffer of the given size.
+*/
+void decode_clv(char const * const block,
+                const size_t block_len,
+                double * const clv,
+                const size_t size)
+{
+  if (block_len < sizeof(CLV_Block_Meta)) {
+    throw std::runtime_error{"Encoded CLV block is too small."};
+  }
+
+  CLV_Block_Meta meta;
+  std::memcpy(&meta, block, sizeof(CLV_Block_Meta));
+
+  const auto precision = static_cast<Options::ClvPrecision>(meta.encoding);
+  const size_t exponents_offset = padded(sizeof(CLV_Block_Meta));
+  const size_t mantissas_offset = exponents_offset + padded(meta.sites * sizeof(int16_t));
+  const size_t span = meta.span;
+
+  if (meta.sites * span != size
+      or block_len != mantissas_offset + size * mantissa_size(precision)) {
+    throw std::runtime_error{std::string("Encoded CLV block does not match the expected CLV size: ")
+      + std::to_string(meta.sites * span) + " vs. " + std::to_string(size)};
+  }
+
+  auto exponents = block + exponents_offset;
+  auto mantissas = block + mantissas_offset;
+
+  for (size_t site = 0; site < meta.sites; ++site) {
+    int16_t exponent;
+    std::memcpy(&exponent, exponents + site * sizeof(int16_t), sizeof(int16_t));
+
+    if (precision == Options::ClvPrecision::kFloat) {
+      for (size_t i = 0; i < span; ++i) {
+        float mantissa;
+        std::memcpy(&mantissa, mantissas + (site * span + i) * sizeof(float), sizeof(float));
+        clv[site * span + i] = std::ldexp(static_cast<double>(mantissa), exponent);
+      }
+    } else {
+      for (size_t i = 0; i < span; ++i) {
+        uint16_t mantissa;
+        std::memcpy(&mantissa, mantissas + (site * span + i) * sizeof(uint16_t), sizeof(uint16_t));
+        clv[site * span + i] = std::ldexp(mantissa / SCALED16_MAX, exponent);
+      }
+    }
+  }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "util/Options.hpp"
+
+/**
+ * Reduced precision encodings of CLVs for the binary store.
+ *
+ * Every encoded CLV block starts with a CLV_Block_Meta, followed by one exponent per site
+ * and then one mantissa per CLV entry. All entries of a site (all rate categories and states)
+ * share the exponent of the largest entry of that site, which is what keeps the encodings safe
+ * from the underflow that plain float32 would suffer from on deep trees:
+ *
+ *   kFloat:    value = float mantissa   * 2^exponent  (relative to site maximum: < 2^-24)
+ *   kScaled16: value = uint16 / 65535   * 2^exponent  (relative to site maximum: < 2^-16)
+ */
+struct CLV_Block_Meta
+{
+  uint32_t encoding;  // static_cast of Options::ClvPrecision
+  uint32_t span;      // CLV entries per site (states_padded * rate_cats)
+  uint64_t sites;
+};
+
+std::vector<char> encode_clv( double const * const clv,
+                              const size_t size,
+                              const size_t span,
+                              const Options::ClvPrecision precision,
+                              double& max_error);
+
+void decode_clv(char const * const block,
+                const size_t block_len,
+                double * const clv,
+                const size_t size);
+
+double clv_precision_epsilon(const Options::ClvPrecision precision);
@@ -1,14 +1,77 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <utility>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <limits>
 
 #include "util/Matrix.hpp"
 #include "util/maps.hpp"
 
+#if (defined(__GNUC__) or defined(__clang__)) and (defined(__x86_64__) or defined(__i386__))
+#define EPA_FOURBIT_SSSE3
+#include <tmmintrin.h>
+
+// decoding uses SSSE3 where the CPU has it, as the 16 codes fit exactly into one shuffle
+static inline bool has_ssse3()
+{
+  static const bool result = __builtin_cpu_supports("ssse3");
+  return result;
+}
+
+/**
+ * Decodes the packed bytes in blocks of 16, into two characters each: the nibbles are
+ * used as shuffle indices into the code table. Returns the number of bytes decoded; the
+ * remainder (less than 16) is left to the caller.
+ */
+__attribute__((target("ssse3")))
+static inline size_t decode_bytes_ssse3(const unsigned char* bytes, const size_t num_bytes, char* out)
+{
+  const __m128i table     = _mm_loadu_si128(reinterpret_cast<const __m128i*>(NT_MAP));
+  const __m128i low_mask  = _mm_set1_epi8(0x0F);
+
+  size_t i = 0;
+  for (; i + 16 <= num_bytes; i += 16) {
+    const __m128i packed  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+    const __m128i high    = _mm_and_si128(_mm_srli_epi16(packed, 4), low_mask);
+    const __m128i low     = _mm_and_si128(packed, low_mask);
+    const __m128i first   = _mm_shuffle_epi8(table, high);
+    const __m128i second  = _mm_shuffle_epi8(table, low);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i),      _mm_unpacklo_epi8(first, second));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), _mm_unpackhi_epi8(first, second));
+  }
+  return i;
+}
+#endif
+
 
 
+// number of sites covered by the given ranges (see kept_site_ranges) of a sequence of n sites,
+// where width is that of the mask they were made from
+static inline size_t num_kept_sites(const std::vector<std::pair<size_t, size_t>>& ranges,
+                                    const size_t n,
+                                    const size_t width)
+{
+  if (width != n) {
+    throw std::runtime_error{"Sequence length does not match the width of the gap mask"};
+  }
+
+  size_t num_kept = 0;
+  for (const auto& range : ranges) {
+    assert(range.first < range.second and range.second <= n);
+    num_kept += range.second - range.first;
+  }
+  return num_kept;
+}
+
 class FourBit
 {
   // shorthand
@@ -82,7 +145,7 @@ public:
   }
   ~FourBit() = default;
 
-  inline size_t packed_size(const size_t size)
+  inline size_t packed_size(const size_t size) const
   {
     return std::ceil(size / 2.0);
   }
@@ -107,41 +170,597 @@ public:
     return res;
   }
 
-  std::string from_fourbit(const std::basic_string<char>& s, const size_t n)
+  std::string from_fourbit(const std::basic_string<char>& s, const size_t n) const
   {
     assert(s.size() > 0);
-    assert(n > 0);
+    assert(s.size() == (n + 1) / 2);
+
+    // padding of an odd number of characters
+    assert((n % 2 == 0) or NT_MAP[unpack_(static_cast<uchar>(s.back())).second] == NONE_CHAR);
 
-    // prepare the result string
+    return from_fourbit(s.data(), n);
+  }
+
+  // decodes n characters from packed bytes, e.g. directly from a mapped file
+  std::string from_fourbit(char const * const s, const size_t n) const
+  {
     std::string res;
+    from_fourbit(s, n, res);
+    return res;
+  }
+
+  // the same, into the given string, reusing its storage
+  void from_fourbit(char const * const s, const size_t n, std::string& res) const
+  {
     res.resize(n);
+    from_fourbit(s, n, &res[0]);
+  }
+
+  // the same, into out, which must hold n characters
+  void from_fourbit(char const * const s, const size_t n, char * const out) const
+  {
+    assert(n > 0);
+
+    decode_range_(reinterpret_cast<const uchar*>(s), 0, n, out);
+  }
 
-    // determine whether the packed string has padding
-    const bool padded = (s.size() * 2 < n);
+  // decodes only the given ranges of sites (see kept_site_ranges), skipping the unmasked intermediate
+  std::string from_fourbit(const std::basic_string<char>& s,
+                           const size_t n,
+                           const std::vector<std::pair<size_t, size_t>>& ranges,
+                           const size_t width) const
+  {
+    assert(s.size() == (n + 1) / 2);
+    return from_fourbit(s.data(), n, ranges, width);
+  }
+
+  std::string from_fourbit(char const * const s,
+                           const size_t n,
+                           const std::vector<std::pair<size_t, size_t>>& ranges,
+                           const size_t width) const
+  {
+    std::string res;
+    from_fourbit(s, n, ranges, width, res);
+    return res;
+  }
 
-    // unpack
+  void from_fourbit(char const * const s,
+                    const size_t n,
+                    const std::vector<std::pair<size_t, size_t>>& ranges,
+                    const size_t width,
+                    std::string& res) const
+  {
+    res.resize(num_kept_sites(ranges, n, width));
+    from_fourbit(s, n, ranges, width, &res[0]);
+  }
+
+  // the same, into out, which must hold as many characters as the ranges cover
+  void from_fourbit(char const * const s,
+                    const size_t n,
+                    const std::vector<std::pair<size_t, size_t>>& ranges,
+                    const size_t width,
+                    char * const out) const
+  {
+    num_kept_sites(ranges, n, width);
+
+    size_t k = 0;
+    for (const auto& range : ranges) {
+      decode_range_(reinterpret_cast<const uchar*>(s), range.first, range.second, out + k);
+      k += range.second - range.first;
+    }
+  }
+
+private:
+  // decodes the sites [begin, end) of a packed sequence to out
+  void decode_range_(const uchar* packed, size_t begin, const size_t end, char* out) const
+  {
+    // a range starting with the second character of a byte
+    if (begin < end and begin % 2) {
+      *out++ = NT_MAP[unpack_(packed[begin / 2]).second];
+      ++begin;
+    }
+
+    // whole bytes, two characters each
+    const size_t num_bytes = (end - begin) / 2;
+    const uchar* bytes = packed + begin / 2;
     size_t i = 0;
-    for (; i < s.size() - 1u; ++i) {
-      reinterpret_cast<char16_t*>(&res[0])[i]
-        = from_fourbit_[static_cast<uchar>(s[i])];
+    #ifdef EPA_FOURBIT_SSSE3
+    if (has_ssse3()) {
+      i = decode_bytes_ssse3(bytes, num_bytes, out);
+    }
+    #endif
+    for (; i < num_bytes; ++i) {
+      std::memcpy(out + 2 * i, &from_fourbit_[bytes[i]], 2);
     }
+    out += 2 * num_bytes;
+    begin += 2 * num_bytes;
+
+    // a range ending with the first character of a byte
+    if (begin < end) {
+      *out = NT_MAP[unpack_(packed[begin / 2]).first];
+    }
+  }
+
+  Matrix<char> to_fourbit_;
+  std::array<char16_t, 256> from_fourbit_;
+};
 
-    // last element is special
-    auto char_pair = unpack_(static_cast<uchar>(s[i]));
-    res[i*2] = NT_MAP[char_pair.first];
+constexpr char TWOBIT_BASES[] = {'A', 'C', 'G', 'T'};
+
+/**
+ * Denser encoding of nucleotide sequences, as used by bfast version 2: the bases A, C, G and T
+ * are packed at 2 bits each, gaps are stored as runs, and the remaining (ambiguous) characters
+ * as a sparse list of exceptions, which take up a base slot that is ignored.
+ *
+ * Layout of an encoded sequence:
+ * <num_gap_runs><num_exceptions>
+ * <<run_begin><run_length>><...>
+ * <exception_position><...><exception_char><...>
+ * <bases of all non-gap sites, 4 per byte, padded to the next byte>
+ */
+class TwoBit
+{
+  // shorthand
+  using uchar = unsigned char;
+private:
+  enum : uchar {
+    INVALID = 255,
+    GAP = 254
+  };
+
+  static inline void put_(std::string& out, const uint32_t value)
+  {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  static inline uint32_t get_(char const * const data, const size_t pos)
+  {
+    uint32_t value;
+    std::memcpy(&value, data + pos, sizeof(value));
+    return value;
+  }
+
+  [[noreturn]] static void corrupt_()
+  {
+    throw std::runtime_error{"Corrupt 2bit encoded sequence."};
+  }
+
+public:
+  TwoBit()
+  {
+    codes_.fill(INVALID);
+    for (uchar i = 0; i < NT_MAP_SIZE; ++i) {
+      codes_[NT_MAP[i]] = codes_[std::tolower(NT_MAP[i])] = i;
+    }
+    for (uchar i = 0; i < 4; ++i) {
+      codes_[TWOBIT_BASES[i]] = codes_[std::tolower(TWOBIT_BASES[i])] = 16 + i;
+    }
+    codes_['-'] = GAP;
+
+    // the four bases of every possible byte
+    for (size_t byte = 0; byte < from_twobit_.size(); ++byte) {
+      for (size_t k = 0; k < 4; ++k) {
+        from_twobit_[byte][k] = TWOBIT_BASES[(byte >> (2 * k)) & 3u];
+      }
+    }
+  }
+  ~TwoBit() = default;
+
+  std::string to_twobit(const std::string& s) const
+  {
+    if (s.size() > std::numeric_limits<uint32_t>::max()) {
+      throw std::runtime_error{"Sequence too long for the 2bit encoding."};
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> runs;
+    std::vector<uint32_t> exception_pos;
+    std::string exception_chars;
+    std::string bases;
+    size_t num_bases = 0;
+
+    for (size_t i = 0; i < s.size(); ++i) {
+      const auto code = codes_[static_cast<uchar>(s[i])];
+      if (code == INVALID) {
+        throw std::runtime_error{std::string("Invalid character for the 2bit encoding: ") + s[i]};
+      }
+
+      if (code == GAP) {
+        if (not runs.empty() and runs.back().first + runs.back().second == i) {
+          ++runs.back().second;
+        } else {
+          runs.emplace_back(i, 1);
+        }
+        continue;
+      }
+
+      uchar base = 0;
+      if (code >= 16) {
+        base = code - 16;
+      } else {
+        exception_pos.push_back(i);
+        exception_chars.push_back(NT_MAP[code]);
+      }
+
+      if (num_bases % 4 == 0) {
+        bases.push_back(0);
+      }
+      bases.back() |= static_cast<char>(base << (2 * (num_bases % 4)));
+      ++num_bases;
+    }
+
+    std::string res;
+    res.reserve(2 * sizeof(uint32_t) + runs.size() * 2 * sizeof(uint32_t)
+      + exception_pos.size() * (sizeof(uint32_t) + 1) + bases.size());
+
+    put_(res, static_cast<uint32_t>(runs.size()));
+    put_(res, static_cast<uint32_t>(exception_pos.size()));
+    for (const auto& run : runs) {
+      put_(res, run.first);
+      put_(res, run.second);
+    }
+    for (const auto pos : exception_pos) {
+      put_(res, pos);
+    }
+    res += exception_chars;
+    res += bases;
+
+    return res;
+  }
+
+  std::string from_twobit(char const * const data, const size_t size, const size_t n) const
+  {
+    std::string res;
+    from_twobit(data, size, n, res);
+    return res;
+  }
+
+  // the same, into the given string, reusing its storage
+  void from_twobit(char const * const data, const size_t size, const size_t n, std::string& res) const
+  {
+    res.resize(n);
+    from_twobit(data, size, n, &res[0]);
+  }
 
-    if (not padded) {
-      res[i*2+1] = NT_MAP[char_pair.second];
+  // the same, into out, which must hold n characters
+  void from_twobit(char const * const data, const size_t size, const size_t n, char * const out) const
+  {
+    std::fill_n(out, n, '-');
+    if (n) {
+      decode_(data, size, n, {{0, n}}, out);
     } else {
-      assert(NT_MAP[char_pair.second] == NONE_CHAR);
+      decode_(data, size, n, {}, nullptr);
+    }
+  }
+
+  // decodes only the given ranges of sites (see kept_site_ranges), skipping the unmasked intermediate
+  std::string from_twobit(char const * const data,
+                          const size_t size,
+                          const size_t n,
+                          const std::vector<std::pair<size_t, size_t>>& ranges,
+                          const size_t width) const
+  {
+    std::string res;
+    from_twobit(data, size, n, ranges, width, res);
+    return res;
+  }
+
+  void from_twobit(char const * const data,
+                   const size_t size,
+                   const size_t n,
+                   const std::vector<std::pair<size_t, size_t>>& ranges,
+                   const size_t width,
+                   std::string& res) const
+  {
+    res.resize(num_kept_sites(ranges, n, width));
+    from_twobit(data, size, n, ranges, width, &res[0]);
+  }
+
+  // the same, into out, which must hold as many characters as the ranges cover
+  void from_twobit(char const * const data,
+                   const size_t size,
+                   const size_t n,
+                   const std::vector<std::pair<size_t, size_t>>& ranges,
+                   const size_t width,
+                   char * const out) const
+  {
+    const auto num_kept = num_kept_sites(ranges, n, width);
+
+    std::fill_n(out, num_kept, '-');
+    decode_(data, size, n, ranges, num_kept ? out : nullptr);
+  }
+
+private:
+  // decodes count bases, starting with the b-th one, to out
+  void decode_bases_(const uchar* bases, size_t b, size_t count, char* out) const
+  {
+    // up to the next whole byte
+    for (; count and b % 4; --count, ++b) {
+      *out++ = from_twobit_[bases[b / 4]][b % 4];
+    }
+    // whole bytes
+    for (; count >= 4; count -= 4, b += 4, out += 4) {
+      std::memcpy(out, from_twobit_[bases[b / 4]].data(), 4);
+    }
+    for (; count; --count, ++b) {
+      *out++ = from_twobit_[bases[b / 4]][b % 4];
+    }
+  }
+
+  /**
+    Decodes the sites of the given (ordered) ranges of a sequence of n sites to out, one range
+    after the other. The gaps are not written, out is expected to hold them already.
+    Bases outside of the ranges are skipped without being looked at.
+  */
+  void decode_(char const * const data,
+               const size_t size,
+               const size_t n,
+               const std::vector<std::pair<size_t, size_t>>& ranges,
+               char* const out) const
+  {
+    if (size < 2 * sizeof(uint32_t)) {
+      corrupt_();
+    }
+    const size_t num_runs = get_(data, 0);
+    const size_t num_exceptions = get_(data, sizeof(uint32_t));
+
+    const size_t runs_pos = 2 * sizeof(uint32_t);
+    const size_t exceptions_pos = runs_pos + num_runs * 2 * sizeof(uint32_t);
+    const size_t chars_pos = exceptions_pos + num_exceptions * sizeof(uint32_t);
+    const size_t bases_pos = chars_pos + num_exceptions;
+    if (num_runs > size or num_exceptions > size or bases_pos > size) {
+      corrupt_();
+    }
+
+    const auto bases = reinterpret_cast<const uchar*>(data + bases_pos);
+    const size_t num_base_bytes = size - bases_pos;
+
+    // the first range not entirely before the current site, and its position in out
+    size_t range = 0;
+    size_t range_pos = 0;
+    auto advance_ranges = [&](const size_t site) {
+      for (; range < ranges.size() and ranges[range].second <= site; ++range) {
+        range_pos += ranges[range].second - ranges[range].first;
+      }
+    };
+
+    // decodes the bases of the sites [begin, end) that lie within the ranges
+    size_t b = 0;
+    auto put_bases = [&](const size_t begin, const size_t end) {
+      if (end < begin or (b + (end - begin) + 3) / 4 > num_base_bytes) {
+        corrupt_();
+      }
+      advance_ranges(begin);
+      size_t pos = range_pos;
+      for (size_t r = range; r < ranges.size() and ranges[r].first < end; ++r) {
+        const auto from = std::max(begin, ranges[r].first);
+        const auto to = std::min(end, ranges[r].second);
+        decode_bases_(bases, b + (from - begin), to - from, out + pos + (from - ranges[r].first));
+        pos += ranges[r].second - ranges[r].first;
+      }
+      b += end - begin;
+    };
+
+    size_t site = 0;
+    for (size_t r = 0; r < num_runs; ++r) {
+      const size_t run_begin = get_(data, runs_pos + r * 2 * sizeof(uint32_t));
+      const size_t run_length = get_(data, runs_pos + r * 2 * sizeof(uint32_t) + sizeof(uint32_t));
+      if (run_begin < site or run_begin + run_length > n) {
+        corrupt_();
+      }
+      put_bases(site, run_begin);
+      site = run_begin + run_length;
     }
+    put_bases(site, n);
 
-    assert(res.size() == n);
+    // the exceptions are in ascending order
+    range = 0;
+    range_pos = 0;
+    site = 0;
+    for (size_t e = 0; e < num_exceptions; ++e) {
+      const size_t pos = get_(data, exceptions_pos + e * sizeof(uint32_t));
+      if (pos >= n or pos < site) {
+        corrupt_();
+      }
+      advance_ranges(pos);
+      if (range < ranges.size() and ranges[range].first <= pos) {
+        out[range_pos + (pos - ranges[range].first)] = data[chars_pos + e];
+      }
+      site = pos;
+    }
+  }
+
+  std::array<uchar, 256> codes_;
+  std::array<std::array<char, 4>, 256> from_twobit_;
+};
+
+/**
+ * Encoding of amino acid sequences, as used by bfast version 3: gaps are stored as runs (as
+ * in TwoBit), all other characters verbatim at one byte each.
+ *
+ * Layout of an encoded sequence:
+ * <num_gap_runs>
+ * <<run_begin><run_length>><...>
+ * <characters of all non-gap sites>
+ */
+class OneByte
+{
+private:
+  static inline void put_(std::string& out, const uint32_t value)
+  {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  static inline uint32_t get_(char const * const data, const size_t pos)
+  {
+    uint32_t value;
+    std::memcpy(&value, data + pos, sizeof(value));
+    return value;
+  }
+
+  [[noreturn]] static void corrupt_()
+  {
+    throw std::runtime_error{"Corrupt byte encoded sequence."};
+  }
+
+public:
+  OneByte() = default;
+  ~OneByte() = default;
+
+  std::string to_onebyte(const std::string& s) const
+  {
+    if (s.size() > std::numeric_limits<uint32_t>::max()) {
+      throw std::runtime_error{"Sequence too long for the byte encoding."};
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> runs;
+    std::string residues;
+
+    for (size_t i = 0; i < s.size(); ++i) {
+      const auto c = static_cast<unsigned char>(s[i]);
+      if (not std::isgraph(c)) {
+        throw std::runtime_error{std::string("Invalid character for the byte encoding: ")
+          + std::to_string(static_cast<unsigned>(c))};
+      }
+
+      if (c == '-') {
+        if (not runs.empty() and runs.back().first + runs.back().second == i) {
+          ++runs.back().second;
+        } else {
+          runs.emplace_back(i, 1);
+        }
+      } else {
+        residues.push_back(std::toupper(c));
+      }
+    }
+
+    std::string res;
+    res.reserve(sizeof(uint32_t) + runs.size() * 2 * sizeof(uint32_t) + residues.size());
+
+    put_(res, static_cast<uint32_t>(runs.size()));
+    for (const auto& run : runs) {
+      put_(res, run.first);
+      put_(res, run.second);
+    }
+    res += residues;
 
     return res;
   }
 
+  std::string from_onebyte(char const * const data, const size_t size, const size_t n) const
+  {
+    std::string res;
+    from_onebyte(data, size, n, res);
+    return res;
+  }
+
+  // the same, into the given string, reusing its storage
+  void from_onebyte(char const * const data, const size_t size, const size_t n, std::string& res) const
+  {
+    res.resize(n);
+    from_onebyte(data, size, n, &res[0]);
+  }
+
+  // the same, into out, which must hold n characters
+  void from_onebyte(char const * const data, const size_t size, const size_t n, char * const out) const
+  {
+    std::fill_n(out, n, '-');
+    if (n) {
+      decode_(data, size, n, {{0, n}}, out);
+    } else {
+      decode_(data, size, n, {}, nullptr);
+    }
+  }
+
+  // decodes only the given ranges of sites (see kept_site_ranges), skipping the unmasked intermediate
+  std::string from_onebyte(char const * const data,
+                           const size_t size,
+                           const size_t n,
+                           const std::vector<std::pair<size_t, size_t>>& ranges,
+                           const size_t width) const
+  {
+    std::string res;
+    from_onebyte(data, size, n, ranges, width, res);
+    return res;
+  }
+
+  void from_onebyte(char const * const data,
+                    const size_t size,
+                    const size_t n,
+                    const std::vector<std::pair<size_t, size_t>>& ranges,
+                    const size_t width,
+                    std::string& res) const
+  {
+    res.resize(num_kept_sites(ranges, n, width));
+    from_onebyte(data, size, n, ranges, width, &res[0]);
+  }
+
+  // the same, into out, which must hold as many characters as the ranges cover
+  void from_onebyte(char const * const data,
+                    const size_t size,
+                    const size_t n,
+                    const std::vector<std::pair<size_t, size_t>>& ranges,
+                    const size_t width,
+                    char * const out) const
+  {
+    const auto num_kept = num_kept_sites(ranges, n, width);
+
+    std::fill_n(out, num_kept, '-');
+    decode_(data, size, n, ranges, num_kept ? out : nullptr);
+  }
+
 private:
-  Matrix<char> to_fourbit_;
-  std::array<char16_t, 256> from_fourbit_;
+  /**
+    Copies the residues of the given (ordered) ranges of a sequence of n sites to out, one
+    range after the other. The gaps are not written, out is expected to hold them already.
+  */
+  void decode_(char const * const data,
+               const size_t size,
+               const size_t n,
+               const std::vector<std::pair<size_t, size_t>>& ranges,
+               char* const out) const
+  {
+    if (size < sizeof(uint32_t)) {
+      corrupt_();
+    }
+    const size_t num_runs = get_(data, 0);
+    const size_t runs_pos = sizeof(uint32_t);
+    if (num_runs > size or runs_pos + num_runs * 2 * sizeof(uint32_t) > size) {
+      corrupt_();
+    }
+
+    // the first range not entirely before the current site, and its position in out
+    size_t range = 0;
+    size_t range_pos = 0;
+
+    size_t r_pos = runs_pos + num_runs * 2 * sizeof(uint32_t);
+    // copies the residues of the sites [begin, end) that lie within the ranges
+    auto put_residues = [&](const size_t begin, const size_t end) {
+      if (end < begin or end - begin > size - r_pos) {
+        corrupt_();
+      }
+      for (; range < ranges.size() and ranges[range].second <= begin; ++range) {
+        range_pos += ranges[range].second - ranges[range].first;
+      }
+      size_t pos = range_pos;
+      for (size_t r = range; r < ranges.size() and ranges[r].first < end; ++r) {
+        const auto from = std::max(begin, ranges[r].first);
+        const auto to = std::min(end, ranges[r].second);
+        std::memcpy(out + pos + (from - ranges[r].first), data + r_pos + (from - begin), to - from);
+        pos += ranges[r].second - ranges[r].first;
+      }
+      r_pos += end - begin;
+    };
+
+    size_t site = 0;
+    for (size_t r = 0; r < num_runs; ++r) {
+      const size_t run_begin = get_(data, runs_pos + r * 2 * sizeof(uint32_t));
+      const size_t run_length = get_(data, runs_pos + r * 2 * sizeof(uint32_t) + sizeof(uint32_t));
+      if (run_begin < site or run_begin + run_length > n) {
+        corrupt_();
+      }
+      put_residues(site, run_begin);
+      site = run_begin + run_length;
+    }
+    put_residues(site, n);
+  }
 };
@@ -4,6 +4,8 @@
 #include <fstream>
 #include <functional>
 
+#include <sys/stat.h>
+
 #include "core/pll/pllhead.hpp"
 #include "core/pll/pll_util.hpp"
 #include "core/pll/rtree_mapper.hpp"
@@ -262,6 +264,28 @@ pll_partition_t *  make_partition(const raxml::Model& model,
 
 }
 
+/**
+  Identifies the state of a file by its size and modification time, such that data derived
+  from it (see MSA_Info sidecars, Checkpoint) is not used once it changed. The modification
+  time is taken in nanoseconds, as a file rewritten within the same second would go unnoticed
+  otherwise. Returns false if the file cannot be accessed.
+*/
+bool file_stamp(const std::string& file_path, long long& size, long long& mtime)
+{
+  struct stat info;
+  if (::stat(file_path.c_str(), &info) != 0) {
+    return false;
+  }
+  size = info.st_size;
+#ifdef __APPLE__
+  const auto& time = info.st_mtimespec;
+#else
+  const auto& time = info.st_mtim;
+#endif
+  mtime = static_cast<long long>(time.tv_sec) * 1000000000ll + time.tv_nsec;
+  return true;
+}
+
 void file_check(const std::string& file_path)
 {
   std::ifstream file(file_path.c_str());
@@ -26,5 +26,6 @@ pll_partition_t * make_partition( const raxml::Model& model,
                                   const int num_sites,
                                   const Options options);
 void file_check(const std::string& file_path);
+bool file_stamp(const std::string& file_path, long long& size, long long& mtime);
 std::vector<size_t> get_offsets(const std::string& file, MSA& msa);
 int pll_fasta_fseek(pll_fasta_t* fd, const long int offset, const int whence);
@@ -36,9 +36,22 @@ void placement_to_jplace_string(Placement const& p,
   os << p.pendant_length() << "]";
 }
 
+static void name_to_jplace_string(std::string const& header,
+                                  size_t const abundance,
+                                  std::ostream& os,
+                                  bool const abundances)
+{
+  if (abundances) {
+    os << "[\"" << header.c_str() << "\", " << abundance << "]";
+  } else {
+    os << "\"" << header.c_str() << "\"";
+  }
+}
+
 void pquery_to_jplace_string( PQuery<Placement> const& pquery,
                               std::ostream& os,
-                              rtree_mapper const& mapper)
+                              rtree_mapper const& mapper,
+                              bool const abundances)
 {
   os << "    {\"p\": [" << NEWL; // p for pquery
 
@@ -59,12 +72,16 @@ void pquery_to_jplace_string( PQuery<Placement> const& pquery,
   // closing bracket for pquery array
   os << "      ]," << NEWL;
 
-  // start of name column
-  os <<"    \"n\": [";
+  // start of name column (or name and multiplicity)
+  os << (abundances ? "    \"nm\": [" : "    \"n\": [");
 
-  // sequence header
-  const auto& header = pquery.header();
-  os << "\"" << header.c_str() << "\"";
+  // sequence header, and those of its duplicates
+  name_to_jplace_string(pquery.header(), pquery.abundance(), os, abundances);
+  const auto& duplicates = pquery.duplicate_headers();
+  for (size_t i = 0; i < duplicates.size(); ++i) {
+    os << ", ";
+    name_to_jplace_string(duplicates[i], pquery.duplicate_abundances()[i], os, abundances);
+  }
 
 
   os << "]" << NEWL; // close name bracket
@@ -97,11 +114,14 @@ void finalize_jplace_string(const std::string& invocation, std::ostream& os)
   os << "}" << NEWL;
 }
 
-void sample_to_jplace_string(Sample<Placement> const& sample, std::ostream& os, rtree_mapper const& mapper)
+void sample_to_jplace_string(Sample<Placement> const& sample,
+                             std::ostream& os,
+                             rtree_mapper const& mapper,
+                             bool const abundances)
 {
   size_t i = 0;
   for (const auto& p : sample) {
-    pquery_to_jplace_string(p, os, mapper);
+    pquery_to_jplace_string(p, os, mapper, abundances);
     if (++i < sample.size()) {
       os << ",";
     }
@@ -10,8 +10,16 @@
 #include "seq/MSA.hpp"
 #include "core/pll/rtree_mapper.hpp"
 
-void sample_to_jplace_string( Sample<Placement> const& sample, std::ostream& os, rtree_mapper const& mapper );
-void pquery_to_jplace_string( PQuery<Placement> const& p, std::ostream& os, rtree_mapper const& mapper );
+// with abundances, names are written as "nm" with the abundances stored in the pqueries
+// (see split_abundances)
+void sample_to_jplace_string( Sample<Placement> const& sample,
+                              std::ostream& os,
+                              rtree_mapper const& mapper,
+                              bool const abundances = false );
+void pquery_to_jplace_string( PQuery<Placement> const& p,
+                              std::ostream& os,
+                              rtree_mapper const& mapper,
+                              bool const abundances = false );
 void placement_to_jplace_string( Placement const& p, std::ostream& os, rtree_mapper const& mapper );
 std::string full_jplace_string( Sample<Placement> const& sample,
                                 std::string const& invocation,
@@ -1,15 +1,19 @@
 #pragma once
 
 #include <string>
+#include <fstream>
 #include <future>
 #include <memory>
 #include <sstream>
 #include <cassert>
 #include <iomanip>
 
+#include <unistd.h>
+
 #include "sample/Sample.hpp"
 #include "util/logging.hpp"
 #include "io/jplace_util.hpp"
+#include "io/Checkpoint.hpp"
 #include "core/pll/rtree_mapper.hpp"
 
 #ifdef __MPI
@@ -24,10 +28,12 @@ public:
                 const std::string& file_name,
                 const std::string& tree_string,
                 const std::string& invocation_string,
-                rtree_mapper const& mapper)
+                rtree_mapper const& mapper,
+                Checkpoint const& checkpoint = Checkpoint())
     : tree_string_(tree_string)
     , invocation_(invocation_string)
     , mapper_(mapper)
+    , checkpoint_(checkpoint)
   {
     init_mpi_();
     init_file_(out_dir, file_name);
@@ -35,31 +41,23 @@ public:
 
   ~jplace_writer()
   {
-    // ensure last write/gather was completed
-    wait();
-
-    // finalize and close
-    #ifdef __MPI
-
-    if (local_rank_ == 0) {
-      std::stringstream trailing;
-      trailing.precision( precision_ );
-      trailing.setf( std::ios::fixed, std:: ios::floatfield );
-      finalize_jplace_string( invocation_, trailing );
-      MPI_File_seek(shared_file_, 0, MPI_SEEK_END);
-      MPI_File_write(shared_file_, trailing.str().c_str(), trailing.str().size(),
-                      MPI_CHAR, MPI_STATUS_IGNORE);
-    }
-    MPI_File_close(&shared_file_);
+    finalize_();
+  }
 
-    #else
+  /**
+    Completes the output and closes the file. As this marks the run as complete, the
+    checkpoint is removed, such that a later run does not resume it.
+  */
+  void close()
+  {
+    finalize_();
 
-    if (file_) {
-      finalize_jplace_string(invocation_, *file_);
-      file_->close();
+    #ifdef __MPI
+    if (local_rank_ != 0) {
+      return;
     }
-
     #endif
+    checkpoint_.remove();
   }
 
   void write( Sample<>& chunk )
@@ -72,9 +70,11 @@ public:
     prev_gather_ = std::async(std::launch::async,
       [chunk = chunk, this]() mutable {
         this->write_(chunk);
+        this->checkpoint_chunk_();
       });
     #else
     write_(chunk);
+    checkpoint_chunk_();
     #endif
   }
 
@@ -99,8 +99,49 @@ public:
     return *this;
   }
 
+  // write names with the multiplicities of their abundance annotations (see --abundances)
+  jplace_writer& set_abundances( bool const abundances )
+  {
+    abundances_ = abundances;
+    return *this;
+  }
+
 protected:
 
+  void finalize_()
+  {
+    if (closed_) {
+      return;
+    }
+    closed_ = true;
+
+    // ensure last write/gather was completed
+    wait();
+
+    // finalize and close
+    #ifdef __MPI
+
+    if (local_rank_ == 0) {
+      std::stringstream trailing;
+      trailing.precision( precision_ );
+      trailing.setf( std::ios::fixed, std:: ios::floatfield );
+      finalize_jplace_string( invocation_, trailing );
+      MPI_File_seek(shared_file_, 0, MPI_SEEK_END);
+      MPI_File_write(shared_file_, trailing.str().c_str(), trailing.str().size(),
+                      MPI_CHAR, MPI_STATUS_IGNORE);
+    }
+    MPI_File_close(&shared_file_);
+
+    #else
+
+    if (file_) {
+      finalize_jplace_string(invocation_, *file_);
+      file_->close();
+    }
+
+    #endif
+  }
+
   void write_( Sample<>& chunk )
   {
     #ifdef __MPI // ========== MPI ==============
@@ -119,7 +160,7 @@ protected:
       } else {
         buffer << ",\n";
       }
-      sample_to_jplace_string(chunk, buffer, mapper_);
+      sample_to_jplace_string(chunk, buffer, mapper_, abundances_);
 
       // how much this rank intends to write this turn
       const auto buffer_str = buffer.str();
@@ -159,7 +200,7 @@ protected:
         *file_ << ",\n";
       }
 
-      sample_to_jplace_string(chunk, *file_, mapper_);
+      sample_to_jplace_string(chunk, *file_, mapper_, abundances_);
     }
 
     #endif
@@ -169,16 +210,38 @@ protected:
                           const std::string& file_name)
   {
     const auto file_path = out_dir + file_name;
+    // when resuming, continue after the last completed chunk
+    const size_t resume_offset = checkpoint_.bytes_written;
     #ifdef __MPI
     MPI_File_open(MPI_COMM_WORLD,
               file_path.c_str(),
               MPI_MODE_WRONLY | MPI_MODE_CREATE,
               MPI_INFO_NULL,
               &shared_file_);
+    if (resume_offset) {
+      MPI_File_set_size(shared_file_, resume_offset);
+      bytes_written_ = resume_offset;
+      first_ = false;
+    }
     #else
     file_ = std::make_unique<std::fstream>();
-    file_->open(file_path,
-                std::fstream::in | std::fstream::out | std::fstream::trunc);
+    if (resume_offset) {
+      std::ifstream existing(file_path, std::ifstream::ate | std::ifstream::binary);
+      if (not existing.is_open() or static_cast<size_t>(existing.tellg()) < resume_offset) {
+        throw std::runtime_error{file_path + ": could not resume, the file is missing or shorter than checkpointed!"};
+      }
+      existing.close();
+      // cut off anything written after the checkpoint, including the trailing metadata
+      if (::truncate(file_path.c_str(), resume_offset) != 0) {
+        throw std::runtime_error{file_path + ": could not resume, the file is not writable!"};
+      }
+      file_->open(file_path, std::fstream::in | std::fstream::out);
+      file_->seekp(resume_offset);
+      first_ = false;
+    } else {
+      file_->open(file_path,
+                  std::fstream::in | std::fstream::out | std::fstream::trunc);
+    }
 
     if (not file_->is_open()) {
       throw std::runtime_error{file_path + ": could not open!"};
@@ -189,6 +252,28 @@ protected:
     #endif
   }
 
+  // record that the last chunk was completely written
+  void checkpoint_chunk_()
+  {
+    if (not checkpoint_.enabled()) {
+      return;
+    }
+
+    #ifdef __MPI
+    MPI_File_sync(shared_file_);
+    checkpoint_.bytes_written = bytes_written_;
+    ++checkpoint_.chunks_done;
+    if (local_rank_ == 0) {
+      checkpoint_.save();
+    }
+    #else
+    file_->flush();
+    checkpoint_.bytes_written = file_->tellp();
+    ++checkpoint_.chunks_done;
+    checkpoint_.save();
+    #endif
+  }
+
   void init_mpi_()
   {
     #ifdef __MPI // then have one outfile per rank
@@ -213,8 +298,11 @@ protected:
   std::string invocation_;
   std::future<void> prev_gather_;
   bool first_ = true;
+  bool closed_ = false;
   unsigned int precision_ = 6;
+  bool abundances_ = false;
   rtree_mapper const mapper_;
+  Checkpoint checkpoint_;
 
   #ifdef __MPI
   MPI_File shared_file_;
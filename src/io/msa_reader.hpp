@@ -9,20 +9,22 @@
 #include "util/stringify.hpp"
 #include "util/logging.hpp"
 #include "util/Options.hpp"
+#include "util/constants.hpp"
 #include "io/msa_reader_interface.hpp"
 
 inline auto make_msa_reader(const std::string& file_name,
                             const MSA_Info& info,
                             const bool premasking = true,
-                            const bool split = false)
+                            const bool split = false,
+                            const size_t read_ahead = DEFAULT_READ_AHEAD)
 {
   std::unique_ptr<msa_reader> result(nullptr);
 
   try {
-    result = std::make_unique<Binary_Fasta_Reader>( file_name, info, premasking, split );
+    result = std::make_unique<Binary_Fasta_Reader>( file_name, info, premasking, split, read_ahead );
   } catch(const std::exception& e) {
     LOG_DBG << "Failed to parse input as binary fasta (bfast), trying `fasta` instead.";
-    result = std::make_unique<MSA_Stream>( file_name, info, premasking, split );
+    result = std::make_unique<MSA_Stream>( file_name, info, premasking, split, read_ahead );
   }
 
   return result;
@@ -1,16 +1,30 @@
 #pragma once
 
+#include <cstddef>
+
 #include "seq/MSA.hpp"
 
 class msa_reader
 {
 
 public:
+  // counters regarding reading ahead of the consumer, for readers that do
+  struct Stats
+  {
+    size_t chunks = 0;          // chunks returned by read_next
+    size_t stalls = 0;          // read_next had to wait for the next chunk
+    double stall_seconds = 0.0; // time spent waiting in total
+    size_t queued = 0;          // chunks that were ready, summed over all calls to read_next
+  };
+
   msa_reader() = default;
   virtual ~msa_reader() = default;
 
   virtual size_t num_sequences() const = 0;
   virtual size_t local_seq_offset() const = 0;
   virtual size_t read_next(MSA& result, const size_t number) = 0;
+  // skip to the n-th sequence of the part of the file this reader is assigned (see local_seq_offset)
+  virtual void skip_to_sequence(const size_t n) = 0;
+  virtual Stats stats() const { return Stats(); }
 
 };
@@ -13,11 +13,15 @@
 #include "util/split.hpp"
 #include "io/Binary_Fasta.hpp"
 #include "io/Binary.hpp"
+#include "io/Shared_Store.hpp"
+#include "io/Memory_Map.hpp"
 #include "io/file_io.hpp"
 #include "io/msa_reader.hpp"
 #include "tree/Tree.hpp"
 #include "core/raxml/Model.hpp"
 #include "core/place.hpp"
+#include "core/Placer.hpp"
+#include "net/Placement_Server.hpp"
 #include "seq/MSA.hpp"
 #include "seq/MSA_Info.hpp"
 
@@ -81,6 +85,7 @@ int main(int argc, char** argv)
   std::string reference_file;
   std::string binary_file;
   std::string bfast_conv_file;
+  std::string shm_unlink_name;
   std::vector<std::string> split_files;
 
   std::string banner;
@@ -113,6 +118,22 @@ int main(int argc, char** argv)
                   options.dump_binary_mode,
                   "Binary Dump mode: write ref. tree in binary format then exit. NOTE: not compatible with premasking!"
                 )->group("Convert");
+  auto dump_snapshot_opt =
+  app.add_flag( "--dump-snapshot",
+                  options.dump_snapshot_mode,
+                  "Snapshot mode: write the fully prepared reference (tree, model, CLVs, lookup tables and gap mask)"
+                  " to a single file then exit. Pass it to a later run via --binary to skip the reference setup."
+                )->group("Convert");
+  std::string binary_precision_option("double");
+  app.add_option( "--binary-precision",
+                  binary_precision_option,
+                  "Precision of the CLVs written via --dump-binary. 'float' and 'scaled16' store every value"
+                  " in 32 and 16 bits respectively (plus a shared exponent per site), cutting file size and"
+                  " load time. The resulting error per value is reported; its effect on placement"
+                  " log-likelihoods is not bounded by it and should be checked on the data at hand.",
+                  true
+                )->group("Convert")
+                ->check(CLI::IsMember({"double", "float", "scaled16"}, CLI::ignore_case));
   auto split_option =
   app.add_option( "--split",
                   split_files,
@@ -121,6 +142,16 @@ int main(int argc, char** argv)
                   "reference file (fasta), ready for use. "
                   "Usage: epa-ng --split ref_alignment query_alignments+"
                 )->group("Convert")->check(CLI::ExistingFile);
+  auto shm_publish_opt =
+  app.add_option( "--shm-publish",
+                  options.shm_publish,
+                  "Build the reference tree and lookup tables, publish them to the named POSIX shared memory "
+                  "segment, then exit. Other runs on the same host may then use --shm-attach."
+                )->group("Convert");
+  app.add_option( "--shm-unlink",
+                  shm_unlink_name,
+                  "Remove the named shared memory segment created via --shm-publish, then exit."
+                )->group("Convert");
 
   //  ============== INPUT OPTIONS ==============
   auto tree_file_opt =
@@ -136,17 +167,46 @@ int main(int argc, char** argv)
   auto binary_file_opt =
   app.add_option( "-b,--binary",
                   binary_file,
-                  "Path to binary reference file, as created using --dump-binary."
+                  "Path to binary reference file, as created using --dump-binary or --dump-snapshot."
                 )->group("Input")->check(CLI::ExistingFile);
 
-  binary_file_opt->excludes(tree_file_opt)->excludes(reference_file_opt);
+  auto shm_attach_opt =
+  app.add_option( "--shm-attach",
+                  options.shm_attach,
+                  "Name of a shared memory segment created via --shm-publish. Skips recomputing the reference"
+                  " CLVs and lookup tables. Tree, reference MSA and model must match the published ones."
+                )->group("Input");
+
+  binary_file_opt->excludes(tree_file_opt)->excludes(reference_file_opt)->excludes(shm_attach_opt)
+                 ->excludes(shm_publish_opt)->excludes(dump_snapshot_opt);
+  shm_attach_opt->excludes(binary_file_opt)->excludes(shm_publish_opt);
+  shm_publish_opt->excludes(shm_attach_opt)->excludes(binary_file_opt);
   tree_file_opt->excludes(binary_file_opt);
   reference_file_opt->excludes(binary_file_opt);
 
+  auto query_file_opt =
   app.add_option( "-q,--query",
                   query_file,
                   "Path to Query MSA file."
                 )->group("Input")->check(CLI::ExistingFile);
+  auto serve_opt =
+  app.add_option( "--serve",
+                  options.server_socket,
+                  "Path of a Unix domain socket. Instead of placing a query file, keep the reference in memory"
+                  " and place the aligned FASTA sequences sent to the socket, answering with jplace."
+                )->group("Input");
+  serve_opt->excludes(query_file_opt)->excludes(shm_publish_opt)->excludes(dump_snapshot_opt);
+  app.add_flag( "--info-sidecar",
+                  options.info_sidecar,
+                  "Store the sequence count and gap mask of the query FASTA file next to it (<query>.epa_info),"
+                  " such that later runs on the unchanged file skip the initial pass over it."
+                )->group("Input");
+  app.add_flag( "--abundances",
+                  options.abundances,
+                  "Query headers carry abundance annotations of dereplicated sequences (>name;size=N)."
+                  " Identical sequences are placed once, and names are reported with their multiplicity"
+                  " (jplace field 'nm')."
+                )->group("Input");
 
   auto model_option =
   app.add_option( "-m,--model",
@@ -206,6 +266,12 @@ int main(int argc, char** argv)
                   redo,
                   "Overwrite existing files."
                 )->group("Output");
+  app.add_flag( "--checkpoint",
+                  options.checkpointing,
+                  "Record the progress in the output directory after every chunk. If a checkpoint of a previous,"
+                  " interrupted run with the same input, reference and settings exists there, resume it and append to"
+                  " its output. The checkpoint is removed once the run completed."
+                )->group("Output");
 
   std::string preserve_rooting_option("on");
   app.add_option( "--preserve-rooting",
@@ -249,12 +315,60 @@ int main(int argc, char** argv)
                   "Number of query sequences to be read in at a time. May influence performance.",
                   true
                 )->group("Compute");
+  auto read_ahead =
+  app.add_option( "--read-ahead",
+                  options.read_ahead,
+                  "Number of query chunks to read ahead of the placement. "
+                  "Hides slow reads (e.g. from network file systems) at the cost of memory.",
+                  true
+                )->group("Compute")->check(CLI::Range(1u, 64u));
+  size_t clv_memory_limit_mb = 0;
+  auto clv_memory_limit =
+  app.add_option( "--clv-memory-limit",
+                  clv_memory_limit_mb,
+                  "Maximum amount of memory (in MB) to hold reference CLVs loaded from a binary file (see --binary)."
+                  " Least recently used CLVs are evicted and reloaded on demand. 0 means no limit.",
+                  true
+                )->group("Compute");
   app.add_flag( "--raxml-blo",
                   raxml_blo,
                   "Employ old style of branch length optimization during thorough insertion as opposed"
                   " to sliding approach. "
                   "WARNING: may significantly slow down computation."
                 )->group("Compute");
+  app.add_flag( "--dedup",
+                  options.dedup,
+                  "Place identical (after masking) query sequences only once. Duplicates within a chunk are"
+                  " reported as additional names of one pquery, later ones receive a copy of the earlier result."
+                )->group("Compute");
+  size_t dedup_memory_limit_mb = 0;
+  auto dedup_memory_limit =
+  app.add_option( "--dedup-memory-limit",
+                  dedup_memory_limit_mb,
+                  "Maximum amount of memory (in MB) to hold the placements of unique sequences for their later"
+                  " duplicates (see --dedup). The earliest ones are forgotten first, their duplicates are then"
+                  " placed again. 0 means no limit.",
+                  true
+                )->group("Compute");
+  app.add_option( "--cache",
+                  options.cache_dir,
+                  "Directory of a persistent placement cache. Query sequences placed by an earlier run against"
+                  " the same reference and with the same settings are taken from the cache instead of being placed"
+                  " again; new results are added to it."
+                )->group("Compute")->check(CLI::ExistingDirectory);
+  auto opt_model =
+  app.add_flag( "--opt-ref-model",
+                  options.opt_model,
+                  "Optimize the substitution rates and the alpha shape parameter of the model on the reference"
+                  " tree before placement, using empirical base frequencies. The site likelihoods are split"
+                  " across the threads (see --threads)."
+                )->group("Compute");
+  auto opt_branches =
+  app.add_flag( "--opt-ref-branches",
+                  options.opt_branches,
+                  "Re-estimate the branch lengths of the reference tree before placement, starting from"
+                  " default lengths."
+                )->group("Compute");
   app.add_flag( "--no-pre-mask",
                   no_pre_mask,
                   "Do NOT pre-mask sequences. Enables repeats unless --no-repeats is also specified."
@@ -305,6 +419,12 @@ int main(int argc, char** argv)
     exit_epa();
   }
 
+  if (not shm_unlink_name.empty()) {
+    LOG_INFO << "Removing shared memory segment: " << shm_unlink_name;
+    Memory_Map::unlink_shared(shm_unlink_name);
+    exit_epa();
+  }
+
   if ( redo ) {
     genesis::utils::Options::get().allow_file_overwriting( true );
   }
@@ -328,7 +448,10 @@ int main(int argc, char** argv)
   log_file = work_dir + "epa_info.log";
   #endif
 
-  if ( not redo and genesis::utils::file_exists( log_file ) ) {
+  // a resumed run continues in the same output directory
+  const bool resuming = options.checkpointing and genesis::utils::file_exists( work_dir + "epa_checkpoint" );
+
+  if ( not redo and not resuming and genesis::utils::file_exists( log_file ) ) {
     throw std::runtime_error{ log_file + " already exists! To overwrite existing output files, rerun with --redo" };
   } else {
     genesis::utils::Logging::log_to_file( log_file );
@@ -358,6 +481,18 @@ int main(int argc, char** argv)
     LOG_INFO << "Selected: Binary CLV store: " << binary_file;
   }
 
+  if (not options.shm_attach.empty()) {
+    LOG_INFO << "Selected: Shared memory reference store: " << options.shm_attach;
+  }
+
+  if (not options.server_socket.empty()) {
+    LOG_INFO << "Selected: Serving placement requests on socket: " << options.server_socket;
+  }
+
+  if (options.checkpointing) {
+    LOG_INFO << "Selected: Checkpointing after every chunk" << (resuming ? ", resuming the previous run" : "");
+  }
+
   if (*filter_acc_lwr)
   {
     options.acc_threshold = true;
@@ -400,6 +535,22 @@ int main(int argc, char** argv)
     LOG_INFO << "Selected: Prescoring using the baseball heuristic";
   }
 
+  if (*clv_memory_limit) {
+    options.clv_memory_limit = clv_memory_limit_mb * 1024 * 1024;
+    LOG_INFO << "Selected: Limit memory for lazily loaded reference CLVs to: " << clv_memory_limit_mb << " MB";
+    if (not options.load_binary_mode) {
+      LOG_WARN << "\tWARNING: --clv-memory-limit only has an effect when loading from a binary file (--binary)";
+    }
+  }
+
+  if (*opt_model) {
+    LOG_INFO << "Selected: Optimizing the model parameters on the reference tree";
+  }
+
+  if (*opt_branches) {
+    LOG_INFO << "Selected: Optimizing the branch lengths of the reference tree";
+  }
+
   if (raxml_blo) {
     options.sliding_blo = false;
     LOG_INFO << "Selected: On query insertion, optimize branch lengths the way RAxML-EPA did it";
@@ -422,6 +573,14 @@ int main(int argc, char** argv)
     LOG_INFO << "Selected: Disabling per rate scalers";
   }
 
+  if (binary_precision_option == "float") {
+    options.binary_precision = Options::ClvPrecision::kFloat;
+    LOG_INFO << "Selected: Writing binary CLV store in reduced (float) precision";
+  } else if (binary_precision_option == "scaled16") {
+    options.binary_precision = Options::ClvPrecision::kScaled16;
+    LOG_INFO << "Selected: Writing binary CLV store in reduced (scaled 16 bit) precision";
+  }
+
   if (preserve_rooting_option == "off") {
     options.preserve_rooting = false;
     LOG_INFO << "Selected: Do NOT preserve the root of the input tree";
@@ -435,6 +594,32 @@ int main(int argc, char** argv)
   //   LOG_INFO << "Selected: Using the non-repeats version of libpll/modules";
   // }
 
+  if (options.info_sidecar) {
+    LOG_INFO << "Selected: Using an info sidecar file for the query file";
+  }
+
+  if (options.abundances) {
+    LOG_INFO << "Selected: Reading abundance annotations of the query sequences";
+    options.dedup = true;
+  }
+
+  if (options.dedup) {
+    LOG_INFO << "Selected: Placing duplicate query sequences only once";
+  }
+
+  if (*dedup_memory_limit) {
+    options.dedup_memory_limit = dedup_memory_limit_mb * 1024 * 1024;
+    LOG_INFO << "Selected: Limit memory for the placements of unique query sequences to: "
+             << dedup_memory_limit_mb << " MB";
+    if (not options.dedup) {
+      LOG_WARN << "\tWARNING: --dedup-memory-limit only has an effect together with --dedup";
+    }
+  }
+
+  if (not options.cache_dir.empty()) {
+    LOG_INFO << "Selected: Using the placement cache in " << options.cache_dir;
+  }
+
   if (*no_heur) {
     options.prescoring = false;
     LOG_INFO << "Selected: Disabling the prescoring heuristics.";
@@ -445,6 +630,19 @@ int main(int argc, char** argv)
     LOG_INFO << "\tWARNING: this mode means that no placement will take place in this run";
   }
 
+  if (options.dump_snapshot_mode) {
+    LOG_INFO << "Selected: Build reference tree and write it out as a prepared reference snapshot";
+    LOG_INFO << "\tWARNING: this mode means that no placement will take place in this run";
+  }
+
+  if (not options.shm_publish.empty()) {
+    if (options.repeats) {
+      throw std::runtime_error{"--shm-publish is not compatible with --no-pre-mask!"};
+    }
+    LOG_INFO << "Selected: Build reference tree and publish it to shared memory segment: " << options.shm_publish;
+    LOG_INFO << "\tWARNING: this mode means that no placement will take place in this run";
+  }
+
   if (is_file(model_desc)) {
     LOG_INFO << "Selected: Specified model file: " << model_desc;
     model_desc = parse_model(model_desc);
@@ -460,6 +658,9 @@ int main(int argc, char** argv)
   if (*chunk_size) {
     LOG_INFO << "Selected: Reading queries in chunks of: " << options.chunk_size;
   }
+  if (*read_ahead) {
+    LOG_INFO << "Selected: Reading ahead query chunks: " << options.read_ahead;
+  }
   #ifdef __OMP
   if (*threads) {
     LOG_INFO << "Selected: Using threads: " << options.num_threads;
@@ -490,18 +691,23 @@ int main(int argc, char** argv)
 
   MSA_Info qry_info;
   if (not query_file.empty()) {
-    qry_info = make_msa_info(query_file);
+    qry_info = make_msa_info(query_file, options.info_sidecar);
     LOG_DBG << "Query File:\n" << qry_info;
   }
 
-  if (ref_info.sites() != qry_info.sites()) {
-    LOG_ERR << "The reference and query alignment files do not seem to have the same alignment width! ("
-            << ref_info.sites() << " vs. " << qry_info.sites() << "). Are the query sequences not aligned?"
-            << std::endl;
-    exit_epa(EXIT_FAILURE);
-  }
+  auto check_width = [&](const size_t ref_sites) {
+    if (ref_sites != qry_info.sites()) {
+      LOG_ERR << "The reference and query alignment files do not seem to have the same alignment width! ("
+              << ref_sites << " vs. " << qry_info.sites() << "). Are the query sequences not aligned?"
+              << std::endl;
+      exit_epa(EXIT_FAILURE);
+    }
+  };
 
-  MSA_Info::or_mask(ref_info, qry_info);
+  if (not reference_file.empty() and not query_file.empty()) {
+    check_width(ref_info.sites());
+    MSA_Info::or_mask(ref_info, qry_info);
+  }
 
   MSA ref_msa;
   if (reference_file.size()) {
@@ -532,6 +738,63 @@ int main(int argc, char** argv)
     tree = Tree(tree_file, ref_msa, model, options);
   }
 
+  if (options.load_binary_mode and tree.binary().is_snapshot()) {
+    // queries have to be masked exactly like the reference was
+    auto gap_mask = tree.binary().load_gap_mask();
+    if (gap_mask.size() == 0) {
+      options.premasking = false;
+    } else {
+      if (not query_file.empty() and gap_mask.size() != qry_info.sites()) {
+        LOG_ERR << "The query alignment does not have the same width as the reference snapshot! ("
+                << qry_info.sites() << " vs. " << gap_mask.size() << ")" << std::endl;
+        exit_epa(EXIT_FAILURE);
+      }
+      qry_info = MSA_Info(query_file, qry_info.sequences(), gap_mask, gap_mask.size());
+    }
+  } else if (options.load_binary_mode and not query_file.empty()) {
+    // a plain binary file stores no mask: its sites are all columns of the queries, none may be masked
+    check_width(tree.partition()->sites);
+    qry_info = MSA_Info(query_file, qry_info.sequences(), MSA_Info::mask_type(qry_info.sites(), false), qry_info.sites());
+  }
+
+  if (options.dump_snapshot_mode) {
+    LOG_INFO << "Writing reference snapshot";
+    auto lookups = build_lookup_store(tree, options);
+    std::string dump_file(work_dir + "epa_snapshot");
+    dump_snapshot(tree,
+                  *lookups,
+                  options.premasking ? ref_info.gap_mask() : MSA_Info::mask_type(),
+                  dump_file);
+    LOG_INFO << "Snapshot was written to: " << dump_file;
+    exit_epa();
+  }
+
+  if (not options.shm_publish.empty()) {
+    auto lookups = build_lookup_store(tree, options);
+    publish_to_shared(tree, *lookups, options.shm_publish);
+    exit_epa();
+  }
+
+  if (not options.server_socket.empty() and not options.dump_binary_mode) {
+    // queries are masked like the reference: by the mask stored in a snapshot, or that of the reference MSA
+    MSA_Info::mask_type gap_mask;
+    if (options.premasking) {
+      if (options.load_binary_mode and tree.binary().is_snapshot()) {
+        gap_mask = tree.binary().load_gap_mask();
+      } else if (not reference_file.empty()) {
+        gap_mask = ref_info.gap_mask();
+      } else {
+        LOG_WARN << "The binary file does not store the mask its reference was built with, "
+                    "serving queries unmasked. To mask them like the reference, prepare it via --dump-snapshot.";
+      }
+    }
+    Placer placer(tree, gap_mask, options);
+    Placement_Server server(placer, invocation);
+    server.serve(options.server_socket);
+    MPI_FINALIZE();
+    return EXIT_SUCCESS;
+  }
+
   if (not options.dump_binary_mode) {
     if (query_file.empty()) {
       throw std::runtime_error{"Must supply query file! Combined MSA files not currently supported, please"
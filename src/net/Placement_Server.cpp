@@ -0,0 +1,416 @@
+#include "net/Placement_Server.hpp"
+
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "genesis/sequence/formats/fasta_input_iterator.hpp"
+#include "genesis/utils/io/input_source.hpp"
+
+#include "io/jplace_util.hpp"
+#include "util/logging.hpp"
+
+// how long the batching thread waits for further requests before placing a batch that
+// is smaller than the chunk size
+static constexpr auto BATCH_WAIT = std::chrono::milliseconds(20);
+
+// listening socket of the currently serving instance, for the signal handler
+static std::atomic<int> signal_fd{-1};
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int)
+{
+  stop_requested = 1;
+  const int fd = signal_fd.load();
+  if (fd >= 0) {
+    // wakes up the blocking accept
+    ::shutdown(fd, SHUT_RDWR);
+  }
+}
+
+static void send_all(const int fd, const std::string& data)
+{
+#ifdef MSG_NOSIGNAL
+  const int flags = MSG_NOSIGNAL;
+#else
+  const int flags = 0;
+#endif
+  size_t sent = 0;
+  while (sent < data.size()) {
+    const auto ret = ::send(fd, data.data() + sent, data.size() - sent, flags);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error{std::string("Sending to client failed: ") + std::strerror(errno)};
+    }
+    sent += ret;
+  }
+}
+
+static std::string escape_json(const std::string& str)
+{
+  std::string result;
+  for (const auto c : str) {
+    if (c == '"' or c == '\\') {
+      result += '\\';
+    }
+    result += (c == '\n') ? ' ' : c;
+  }
+  return result;
+}
+
+static sockaddr_un make_address(const std::string& socket_path)
+{
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error{std::string("Socket path is too long: ") + socket_path};
+  }
+  std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+  return address;
+}
+
+/**
+  Removes a socket file left behind by a previous server, refusing if a server
+  is still listening on it.
+*/
+static void remove_stale_socket(const std::string& socket_path)
+{
+  struct stat info;
+  if (::stat(socket_path.c_str(), &info) != 0) {
+    return;
+  }
+  if (not S_ISSOCK(info.st_mode)) {
+    throw std::runtime_error{socket_path + " exists and is not a socket."};
+  }
+
+  const auto address = make_address(socket_path);
+  const int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  const bool in_use = probe >= 0
+    and ::connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+  if (probe >= 0) {
+    ::close(probe);
+  }
+  if (in_use) {
+    throw std::runtime_error{std::string("Another server is already listening on ") + socket_path};
+  }
+  ::unlink(socket_path.c_str());
+}
+
+Placement_Server::Placement_Server( Placer& placer,
+                                    const std::string& invocation,
+                                    const size_t max_request_size)
+  : placer_(placer)
+  , invocation_(invocation)
+  , max_request_size_(max_request_size)
+{ }
+
+Placement_Server::~Placement_Server()
+{
+  stop();
+}
+
+void Placement_Server::stop()
+{
+  stopping_ = true;
+  const int fd = listen_fd_.load();
+  if (fd >= 0) {
+    ::shutdown(fd, SHUT_RDWR);
+  }
+}
+
+/**
+  Listens on the given socket path until stop() is called or the process receives
+  SIGINT/SIGTERM. Requests that are in progress at that point are completed.
+*/
+void Placement_Server::serve(const std::string& socket_path)
+{
+  const auto address = make_address(socket_path);
+  remove_stale_socket(socket_path);
+
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    throw std::runtime_error{std::string("Cannot create socket: ") + std::strerror(errno)};
+  }
+  if (::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+      or ::listen(fd, SOMAXCONN) != 0) {
+    const auto error = std::string(std::strerror(errno));
+    ::close(fd);
+    throw std::runtime_error{std::string("Cannot listen on ") + socket_path + ": " + error};
+  }
+  listen_fd_ = fd;
+
+  signal_fd = fd;
+  stop_requested = 0;
+  auto prev_int = std::signal(SIGINT, handle_stop_signal);
+  auto prev_term = std::signal(SIGTERM, handle_stop_signal);
+  // a client hanging up early must not kill the server
+  auto prev_pipe = std::signal(SIGPIPE, SIG_IGN);
+
+  std::thread batcher(&Placement_Server::batch_loop_, this);
+
+  LOG_INFO << "Listening for placement requests on: " << socket_path;
+
+  while (not stopping_ and not stop_requested) {
+    const int client_fd = ::accept(fd, nullptr, nullptr);
+    if (client_fd < 0) {
+      if (errno == EINTR or errno == ECONNABORTED) {
+        continue;
+      }
+      if (not stopping_ and not stop_requested) {
+        LOG_ERR << "Accepting a connection failed: " << std::strerror(errno);
+      }
+      break;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++num_clients_;
+    }
+    std::thread(&Placement_Server::handle_client_, this, client_fd).detach();
+  }
+  stopping_ = true;
+
+  LOG_INFO << "Shutting down the placement server.";
+
+  // let the connected clients finish, then the batching thread
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    clients_cv_.wait(lock, [this]{ return num_clients_ == 0; });
+  }
+  queue_cv_.notify_all();
+  batcher.join();
+
+  signal_fd = -1;
+  listen_fd_ = -1;
+  ::close(fd);
+  ::unlink(socket_path.c_str());
+
+  std::signal(SIGINT, prev_int);
+  std::signal(SIGTERM, prev_term);
+  std::signal(SIGPIPE, prev_pipe);
+}
+
+void Placement_Server::handle_client_(const int fd)
+{
+  // read the request until the client shuts down its writing end. Beyond the maximum size,
+  // the rest is still read, but dropped, such that the client gets to read the error
+  std::string request;
+  bool too_large = false;
+  std::vector<char> buffer(1 << 16);
+  ssize_t ret = 0;
+  while ((ret = ::read(fd, buffer.data(), buffer.size())) != 0) {
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (request.size() + ret > max_request_size_) {
+      too_large = true;
+      request.clear();
+      request.shrink_to_fit();
+    }
+    if (not too_large) {
+      request.append(buffer.data(), ret);
+    }
+  }
+
+  try {
+    std::string response;
+    try {
+      if (ret < 0) {
+        throw std::runtime_error{std::string("Receiving the request failed: ") + std::strerror(errno)};
+      }
+      if (too_large) {
+        throw std::runtime_error{"Request is larger than the maximum of "
+                                 + std::to_string(max_request_size_) + " bytes."};
+      }
+      response = respond_(request);
+    } catch (const std::exception& e) {
+      send_all(fd, std::string("{\"error\": \"") + escape_json(e.what()) + "\"}" + NEWL);
+      throw;
+    }
+    send_all(fd, response);
+  } catch (const std::exception& e) {
+    LOG_ERR << "Placement request failed: " << e.what();
+  }
+
+  ::close(fd);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  --num_clients_;
+  clients_cv_.notify_all();
+}
+
+/**
+  Places the request and returns the complete jplace document.
+*/
+std::string Placement_Server::respond_(const std::string& request)
+{
+  auto msa = parse_request_(request);
+  auto results = enqueue_(msa);
+
+  std::ostringstream os;
+  os.precision(placer_.options().precision);
+  os.setf(std::ios::fixed, std::ios::floatfield);
+
+  init_jplace_string(placer_.newick(), os);
+
+  bool first = true;
+  for (auto& result : results) {
+    auto sample = result.get();
+    for (const auto& pquery : sample) {
+      if (not first) {
+        os << "," << NEWL;
+      }
+      pquery_to_jplace_string(pquery, os, placer_.mapper(), placer_.options().abundances);
+      first = false;
+    }
+  }
+
+  if (not first) {
+    os << NEWL;
+  }
+  finalize_jplace_string(invocation_, os);
+
+  return os.str();
+}
+
+/**
+  Reads the FASTA formatted request and masks it the same way as the reference.
+*/
+MSA Placement_Server::parse_request_(const std::string& request) const
+{
+  genesis::sequence::FastaReader reader_settings;
+  reader_settings.site_casing( genesis::sequence::FastaReader::SiteCasing::kToUpper );
+  auto iter = genesis::sequence::FastaInputIterator( genesis::utils::from_string( request ),
+                                                     reader_settings );
+
+  MSA msa;
+  while (iter) {
+    msa.append(iter->label(), iter->sites());
+    ++iter;
+  }
+
+  if (msa.size() == 0) {
+    throw std::runtime_error{"Request did not contain any sequences."};
+  }
+
+  return placer_.prepare(msa.begin(), msa.end());
+}
+
+/**
+  Splits the request into jobs of at most chunk size and queues them for placement.
+  Returns the futures of the jobs results, in order of the request.
+*/
+std::vector<std::future<Sample<Placement>>> Placement_Server::enqueue_(MSA& msa)
+{
+  const size_t chunk_size = placer_.options().chunk_size;
+
+  std::vector<job_ptr> jobs;
+  for (auto it = msa.begin(); it != msa.end(); ) {
+    const auto end = (msa.end() - it > static_cast<long>(chunk_size)) ? it + chunk_size : msa.end();
+    auto job = std::make_shared<Job>();
+    job->msa.num_sites(msa.num_sites());
+    job->msa.move_sequences(it, end);
+    jobs.push_back(std::move(job));
+    it = end;
+  }
+
+  std::vector<std::future<Sample<Placement>>> results;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& job : jobs) {
+      results.push_back(job->result.get_future());
+      queued_sequences_ += job->msa.size();
+      queue_.push_back(std::move(job));
+    }
+  }
+  queue_cv_.notify_all();
+
+  return results;
+}
+
+void Placement_Server::batch_loop_()
+{
+  const size_t chunk_size = placer_.options().chunk_size;
+
+  while (true) {
+    std::vector<job_ptr> batch;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_cv_.wait(lock, [this]{ return not queue_.empty() or (stopping_ and num_clients_ == 0); });
+      if (queue_.empty()) {
+        return;
+      }
+
+      // give concurrent clients a moment to fill up the batch
+      queue_cv_.wait_for(lock, BATCH_WAIT, [this, chunk_size]{
+        return queued_sequences_ >= chunk_size or stopping_;
+      });
+
+      size_t batch_size = 0;
+      while (not queue_.empty()
+             and (batch.empty() or batch_size + queue_.front()->msa.size() <= chunk_size)) {
+        batch_size += queue_.front()->msa.size();
+        batch.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+      queued_sequences_ -= batch_size;
+    }
+
+    place_batch_(batch);
+  }
+}
+
+/**
+  Places the jobs of the batch as one chunk, then hands each job its part of the result.
+*/
+void Placement_Server::place_batch_(std::vector<job_ptr>& batch)
+{
+  // first sequence id of every job within the chunk
+  std::vector<size_t> job_begin;
+  MSA chunk(batch.front()->msa.num_sites());
+  for (auto& job : batch) {
+    job_begin.push_back(chunk.size());
+    chunk.move_sequences(job->msa.begin(), job->msa.end());
+  }
+
+  std::vector<Sample<Placement>> parts(batch.size());
+  try {
+    auto sample = placer_.place(chunk);
+
+    for (auto& pquery : sample) {
+      const auto seq_id = pquery.sequence_id();
+      const size_t job_id = std::upper_bound(std::begin(job_begin), std::end(job_begin), seq_id)
+                          - std::begin(job_begin) - 1;
+      pquery.sequence_id(seq_id - job_begin[job_id]);
+      parts[job_id].push_back(std::move(pquery));
+    }
+  } catch (...) {
+    for (auto& job : batch) {
+      job->result.set_exception(std::current_exception());
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < batch.size(); ++i) {
+    batch[i]->result.set_value(std::move(parts[i]));
+  }
+
+  LOG_DBG << "Placed batch of " << chunk.size() << " sequences from "
+          << batch.size() << " requests.";
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+
+#include "core/Placer.hpp"
+#include "seq/MSA.hpp"
+#include "sample/Sample.hpp"
+#include "util/constants.hpp"
+
+/**
+ * Resident placement server: keeps the reference in memory (see Placer) and places
+ * query batches received over a Unix domain socket.
+ *
+ * Protocol: a client connects, writes aligned query sequences in FASTA format and then
+ * shuts down its writing end of the connection. The server answers with a jplace document
+ * and closes the connection. If the request is malformed, larger than the maximum request
+ * size, or its placement fails, the answer is a JSON object with a single "error" member
+ * instead. The answer is only sent once complete, so it is never a truncated document.
+ *
+ * Every client is served by its own thread, while the actual placement happens on a single
+ * batching thread: requests larger than the chunk size are split, and small requests of
+ * concurrent clients are merged into one chunk, so that the placement kernels stay busy.
+ */
+class Placement_Server
+{
+public:
+  Placement_Server( Placer& placer,
+                    const std::string& invocation,
+                    const size_t max_request_size = DEFAULT_MAX_REQUEST_SIZE);
+  Placement_Server()  = delete;
+  ~Placement_Server();
+
+  Placement_Server(Placement_Server const& other) = delete;
+  Placement_Server(Placement_Server&& other)      = delete;
+
+  Placement_Server& operator= (Placement_Server const& other) = delete;
+  Placement_Server& operator= (Placement_Server && other)     = delete;
+
+  void serve(const std::string& socket_path);
+  void stop();
+
+private:
+  // part of a client request, placed as part of one batch
+  struct Job
+  {
+    MSA msa;
+    std::promise<Sample<Placement>> result;
+  };
+  using job_ptr = std::shared_ptr<Job>;
+
+  void handle_client_(const int fd);
+  std::string respond_(const std::string& request);
+  MSA parse_request_(const std::string& request) const;
+  std::vector<std::future<Sample<Placement>>> enqueue_(MSA& msa);
+  void batch_loop_();
+  void place_batch_(std::vector<job_ptr>& batch);
+
+  Placer& placer_;
+  std::string invocation_;
+  size_t max_request_size_;
+
+  // pending jobs, guarded by mutex_
+  std::deque<job_ptr> queue_;
+  size_t queued_sequences_ = 0;
+  std::mutex mutex_;
+  std::condition_variable queue_cv_;
+
+  // connected clients, guarded by mutex_
+  size_t num_clients_ = 0;
+  std::condition_variable clients_cv_;
+
+  std::atomic<bool> stopping_{false};
+  std::atomic<int> listen_fd_{-1};
+};
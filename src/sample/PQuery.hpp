@@ -1,9 +1,11 @@
 #pragma once
 
 #include <vector>
+#include <string>
 #include <type_traits>
 
 #include <cereal/types/vector.hpp>
+#include <cereal/types/string.hpp>
 
 #include "seq/Sequence.hpp"
 #include "sample/Placement.hpp"
@@ -34,9 +36,11 @@ public:
     }
   }
   PQuery (const seqid_type seq_id,
-          const std::string& header)
+          const std::string& header,
+          const size_t abundance = 1)
     : sequence_id_(seq_id)
     , header_(header)
+    , abundance_(abundance)
   { }
   PQuery (const seqid_type seq_id)
     : sequence_id_(seq_id) 
@@ -61,6 +65,15 @@ public:
   inline seqid_type sequence_id() const { return sequence_id_; }
   inline void sequence_id(const seqid_type seq_id) { sequence_id_ = seq_id; }
   const std::string& header() const { return header_; }
+  size_t abundance() const { return abundance_; }
+  // headers of identical query sequences that were placed as this one, and their abundances
+  const std::vector<std::string>& duplicate_headers() const { return duplicate_headers_; }
+  const std::vector<size_t>& duplicate_abundances() const { return duplicate_abundances_; }
+  void add_duplicate_header(const std::string& header, const size_t abundance = 1)
+  {
+    duplicate_headers_.push_back(header);
+    duplicate_abundances_.push_back(abundance);
+  }
   size_t size() const { return placements_.size(); }
 
   // manipulators
@@ -97,9 +110,15 @@ public:
 
   // serialization
   template<class Archive>
-  void serialize(Archive& ar) { ar( sequence_id_, header_, placements_ ); }
+  void serialize(Archive& ar)
+  {
+    ar( sequence_id_, header_, abundance_, duplicate_headers_, duplicate_abundances_, placements_ );
+  }
 private:
   seqid_type sequence_id_ = 0;
   std::string header_;
+  size_t abundance_ = 1;
+  std::vector<std::string> duplicate_headers_;
+  std::vector<size_t> duplicate_abundances_;
   std::vector<value_type> placements_;
 };
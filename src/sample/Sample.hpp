@@ -89,10 +89,11 @@ public:
   }
 
   size_t add_pquery(const size_t seq_id,
-                    const std::string& label)
+                    const std::string& label,
+                    const size_t abundance = 1)
   {
       // Create a new pquery and return its id in the vector.
-      pquerys_.emplace_back(seq_id, label);
+      pquerys_.emplace_back(seq_id, label, abundance);
       return pquerys_.size() - 1;
   }
 
@@ -0,0 +1,111 @@
+#include "seq/Duplicate_Filter.hpp"
+
+/**
+  Reduces the chunk to the sequences not seen before. Headers of duplicates within
+  the chunk are merged into the first occurrence.
+*/
+void Duplicate_Filter::filter(MSA& chunk)
+{
+  chunk_hashes_.clear();
+  chunk_positions_.clear();
+  earlier_.clear();
+
+  std::unordered_map<hash_type, size_t, sequence_hash_hasher> in_chunk;
+
+  // the unique sequences are moved to the front of the chunk, keeping their storage
+  const auto unique = chunk.begin();
+  size_t num_unique = 0;
+  size_t position = 0;
+  for (auto& seq : chunk) {
+    const auto hash = hash_sequence(seq.sequence());
+
+    const auto placed = index_.find(hash);
+    const auto previous = in_chunk.find(hash);
+    if (placed != index_.end()) {
+      earlier_.emplace_back(seq.header(), seq.abundance(), position, placed->second - num_forgotten_);
+      ++num_duplicates_;
+    } else if (previous != in_chunk.end()) {
+      unique[previous->second].merge(seq);
+      ++num_duplicates_;
+    } else {
+      in_chunk[hash] = num_unique;
+      chunk_hashes_.push_back(hash);
+      chunk_positions_.push_back(position);
+      if (num_unique != position) {
+        unique[num_unique] = std::move(seq);
+      }
+      ++num_unique;
+    }
+    ++position;
+  }
+
+  chunk.erase(unique + num_unique, chunk.end());
+}
+
+/**
+  Completes the result of placing a filtered chunk (with a sequence id offset of 0):
+  restores the original sequence ids, adds the merged headers, adds pquerys for the
+  duplicates of earlier chunks and remembers the new results for the following chunks.
+*/
+void Duplicate_Filter::expand(Sample<Placement>& sample, const MSA& chunk, const size_t seq_id_offset)
+{
+  // copied before remembering the new results, which may forget earlier ones
+  std::vector<PQuery<Placement>> copies;
+  for (const auto& duplicate : earlier_) {
+    const auto& placements = placed_[std::get<3>(duplicate)].second;
+    PQuery<Placement> pquery(seq_id_offset + std::get<2>(duplicate),
+                             std::get<0>(duplicate),
+                             std::get<1>(duplicate));
+    pquery.append(placements.begin(), placements.end());
+    copies.push_back(std::move(pquery));
+  }
+  earlier_.clear();
+
+  for (auto& pquery : sample) {
+    const auto local_id = pquery.sequence_id();
+    const auto& merged_headers = chunk[local_id].merged_headers();
+    const auto& merged_abundances = chunk[local_id].merged_abundances();
+    for (size_t i = 0; i < merged_headers.size(); ++i) {
+      pquery.add_duplicate_header(merged_headers[i], merged_abundances[i]);
+    }
+
+    remember_(chunk_hashes_[local_id], pquery.data());
+
+    pquery.sequence_id(seq_id_offset + chunk_positions_[local_id]);
+  }
+
+  for (auto& pquery : copies) {
+    sample.push_back(std::move(pquery));
+  }
+}
+
+// rough per entry cost of the containers, on top of the placements themselves
+static constexpr size_t ENTRY_OVERHEAD = 2 * (sizeof(sequence_hash_type) + 4 * sizeof(void*));
+
+static size_t entry_size(const std::vector<Placement>& placements)
+{
+  return ENTRY_OVERHEAD + placements.capacity() * sizeof(Placement);
+}
+
+/**
+  Keeps the placements of a newly placed sequence for its later duplicates. If this exceeds
+  the memory limit, forgets the earliest entries until it does not.
+*/
+void Duplicate_Filter::remember_(const hash_type& hash, std::vector<Placement> placements)
+{
+  memory_ += entry_size(placements);
+  index_[hash] = num_forgotten_ + placed_.size();
+  placed_.emplace_back(hash, std::move(placements));
+  ++num_unique_;
+
+  while (memory_limit_ and memory_ > memory_limit_ and placed_.size() > 1) {
+    auto& front = placed_.front();
+    const auto entry = index_.find(front.first);
+    if (entry != index_.end() and entry->second == num_forgotten_) {
+      index_.erase(entry);
+    }
+    memory_ -= entry_size(front.second);
+    placed_.pop_front();
+    ++num_forgotten_;
+  }
+}
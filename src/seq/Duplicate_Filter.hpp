@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <utility>
+#include <tuple>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+#include "seq/MSA.hpp"
+#include "seq/sequence_hash.hpp"
+#include "sample/Sample.hpp"
+
+/**
+ * Ensures identical (after masking) query sequences are placed only once, across all
+ * chunks of a run. Sequences are identified by their hash, such that no sequence
+ * data has to be kept beyond its chunk. The placements of every unique sequence are
+ * kept however, to hand them to later duplicates.
+ *
+ * With a memory limit, the placements remembered longest are forgotten once the limit is
+ * exceeded: later duplicates of those sequences are then simply placed again.
+ *
+ * Usage per chunk: filter() before placement, expand() on the placement result. Duplicates
+ * within a chunk are reported as additional names of the pquery, while duplicates of a
+ * sequence placed in an earlier chunk get their own pquery holding a copy of its placements.
+ */
+class Duplicate_Filter
+{
+public:
+  using hash_type = sequence_hash_type;
+
+  explicit Duplicate_Filter(const size_t memory_limit = 0)
+    : memory_limit_(memory_limit)
+  { }
+  ~Duplicate_Filter() = default;
+
+  Duplicate_Filter(Duplicate_Filter const& other) = delete;
+  Duplicate_Filter(Duplicate_Filter&& other)      = default;
+
+  Duplicate_Filter& operator= (Duplicate_Filter const& other) = delete;
+  Duplicate_Filter& operator= (Duplicate_Filter && other)     = default;
+
+  void filter(MSA& chunk);
+  void expand(Sample<Placement>& sample, const MSA& chunk, const size_t seq_id_offset);
+
+  // member access
+  size_t num_duplicates() const { return num_duplicates_; }
+  size_t num_unique() const { return num_unique_; }
+  size_t num_forgotten() const { return num_forgotten_; }
+  size_t memory() const { return memory_; }
+
+private:
+  void remember_(const hash_type& hash, std::vector<Placement> placements);
+
+  // sequence hash to the placements of the sequence, if placed in an earlier chunk.
+  // Values of index_ count from the first entry ever added to placed_, the first
+  // num_forgotten_ of which are no longer held
+  std::unordered_map<hash_type, size_t, sequence_hash_hasher> index_;
+  std::deque<std::pair<hash_type, std::vector<Placement>>> placed_;
+
+  size_t memory_limit_ = 0;  // in bytes, 0 meaning unlimited
+  size_t memory_ = 0;        // approximate size of index_ and placed_ in bytes
+
+  // bookkeeping of the current chunk, per remaining sequence
+  std::vector<hash_type> chunk_hashes_;
+  std::vector<size_t> chunk_positions_;
+  // duplicates of sequences from earlier chunks: header, abundance, position in the chunk,
+  // entry in placed_
+  std::vector<std::tuple<std::string, size_t, size_t, size_t>> earlier_;
+
+  size_t num_duplicates_ = 0;
+  size_t num_unique_ = 0;
+  size_t num_forgotten_ = 0;
+};
@@ -1,22 +1,169 @@
 #include "seq/MSA.hpp"
 
 #include <stdexcept>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+MSA::MSA(MSA const& other)
+  : num_sites_(other.num_sites_)
+  , sequence_list_(other.sequence_list_)
+  , sites_(other.sites_)
+  , headers_(other.headers_)
+{
+  rebase_(&Sequence::sequence_, other.sites_.data(), sites_.data());
+  rebase_(&Sequence::header_, other.headers_.data(), headers_.data());
+}
+
+MSA& MSA::operator= (MSA const& other)
+{
+  if (this != &other) {
+    MSA copy(other);
+    swap(*this, copy);
+  }
+  return *this;
+}
 
 void MSA::move_sequences(MSA::iterator begin, MSA::iterator end)
 {
-  std::move(begin, end, std::back_inserter(sequence_list_));
+  for (auto it = begin; it != end; ++it) {
+    append(it->header(), it->sequence());
+    auto& s = sequence_list_.back();
+    s.abundance_ = it->abundance_;
+    s.merged_headers_ = std::move(it->merged_headers_);
+    s.merged_abundances_ = std::move(it->merged_abundances_);
+  }
+}
+
+void MSA::append(const Char_Span header, const Char_Span sequence)
+{
+  // the storage may move while appending, so data of this MSA is copied out first
+  if (holds_(header) or holds_(sequence)) {
+    append(header.str(), sequence.str());
+    return;
+  }
+
+  if (sequence.length() != num_sites_) {
+    if (num_sites_ or size()) {
+      throw std::runtime_error{std::string("Tried to insert sequence to MSA of unequal length: ")
+                                + header.str()};
+    }
+    num_sites(sequence.length());
+  }
+
+  auto row = add_sites_(1);
+  std::copy(sequence.begin(), sequence.end(), row);
+  sequence_list_.push_back(Sequence(add_header_(header), Char_Span(row, num_sites_)));
+}
+
+/**
+  Empties the MSA, keeping the storage of its sites and headers for the next chunk
+  (see Fasta_Chunk_Reader::read).
+*/
+void MSA::clear()
+{
+  sequence_list_.clear();
+  sites_.clear();
+  headers_.clear();
+}
+
+void MSA::reserve(const size_t size)
+{
+  sequence_list_.reserve(size);
+  reserve_(sites_, &Sequence::sequence_, size * stride_());
+}
+
+void MSA::add_rows(const size_t number)
+{
+  sequence_list_.reserve(size() + number);
+  auto row = add_sites_(number);
+  for (size_t i = 0; i < number; ++i, row += stride_()) {
+    sequence_list_.push_back(Sequence(add_header_(""), Char_Span(row, num_sites_)));
+  }
+}
+
+void MSA::header(const size_t i, const Char_Span header)
+{
+  if (holds_(header)) {
+    this->header(i, header.str());
+    return;
+  }
+  sequence_list_[i].header_ = add_header_(header);
 }
 
-void MSA::append(const std::string& header, const std::string& sequence)
+void MSA::num_sites(const size_t sites)
 {
-  if(num_sites_ && sequence.length() != num_sites_) {
-    throw std::runtime_error{std::string("Tried to insert sequence to MSA of unequal length: ") + header};
+  if (sites == num_sites_) {
+    return;
   }
+  if (size()) {
+    throw std::runtime_error{"Cannot change the number of sites of a non-empty MSA"};
+  }
+  // no views into the storage remain, so rows of the old width need not be kept
+  sites_.clear();
+  headers_.clear();
+  num_sites_ = sites;
+}
 
-  sequence_list_.emplace_back(header, sequence);
+bool MSA::holds_(const Char_Span span) const
+{
+  auto const within = [&span](std::vector<char> const& buffer) {
+    std::less_equal<char const*> le;
+    return buffer.size()
+      and le(buffer.data(), span.data())
+      and le(span.data(), buffer.data() + buffer.size());
+  };
+  return within(sites_) or within(headers_);
+}
 
-  if (!num_sites_) {
-    num_sites_ = sequence.length();
+/**
+  Appends the given number of rows to the sites, NUL initialized, and returns the first.
+*/
+char * MSA::add_sites_(const size_t number)
+{
+  auto const offset = sites_.size();
+  auto const needed = offset + number * stride_();
+  if (needed > sites_.capacity()) {
+    reserve_(sites_, &Sequence::sequence_, std::max(needed, 2 * sites_.capacity()));
+  }
+  sites_.resize(needed);
+  return sites_.data() + offset;
+}
+
+Char_Span MSA::add_header_(const Char_Span header)
+{
+  auto const offset = headers_.size();
+  auto const needed = offset + header.size() + 1;
+  if (needed > headers_.capacity()) {
+    reserve_(headers_, &Sequence::header_, std::max(needed, 2 * headers_.capacity()));
+  }
+  headers_.insert(headers_.end(), header.begin(), header.end());
+  headers_.push_back('\0');
+  return Char_Span(headers_.data() + offset, header.size());
+}
+
+/**
+  Grows the buffer to the given capacity, pointing the views of all sequences into the new one.
+*/
+void MSA::reserve_(std::vector<char>& buffer,
+                   Char_Span Sequence::* view,
+                   const size_t capacity)
+{
+  if (capacity <= buffer.capacity()) {
+    return;
+  }
+  std::vector<char> grown;
+  grown.reserve(capacity);
+  grown.assign(buffer.begin(), buffer.end());
+  rebase_(view, buffer.data(), grown.data());
+  buffer.swap(grown);
+}
+
+void MSA::rebase_(Char_Span Sequence::* view, char const * const from, char const * const to)
+{
+  for (auto& s : sequence_list_) {
+    auto& span = s.*view;
+    span = Char_Span(to + (span.data() - from), span.size());
   }
 }
 
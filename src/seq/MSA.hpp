@@ -1,10 +1,24 @@
 #pragma once
 
 #include <vector>
+#include <string>
 #include <utility>
 
 #include "seq/Sequence.hpp"
+#include "util/Char_Span.hpp"
 
+/**
+ * Aligned sequences, stored contiguously: the sites of all sequences in one buffer of fixed
+ * stride, and their headers in one arena. The Sequence objects are views into these.
+ *
+ * Every row of sites is followed by a NUL, so that it may be handed to pll as a string.
+ * Clearing keeps the storage, such that an MSA refilled for every chunk only allocates while
+ * the chunks grow. Erasing sequences only drops their views, their storage is reclaimed by the
+ * next clear.
+ *
+ * When the storage grows, the MSA updates the views it holds. Copies of them taken before
+ * become invalid then, as do the views of sequences erased from it.
+ */
 class MSA
 {
 public:
@@ -16,15 +30,30 @@ public:
   MSA() : num_sites_(0) {};
   ~MSA() = default;
 
+  MSA(MSA const& other);
+  MSA(MSA&& other) = default;
+
+  MSA& operator= (MSA const& other);
+  MSA& operator= (MSA && other) = default;
+
   void move_sequences(iterator begin, iterator end);
-  void append(const std::string& header, const std::string& sequence);
+  void append(const Char_Span header, const Char_Span sequence);
   void erase(iterator begin, iterator end) {sequence_list_.erase(begin, end);}
-  void clear() {sequence_list_.clear();}
+  void clear();
+  void reserve(const size_t size);
+
+  // for filling the MSA in parallel: appends sequences with empty headers and unset sites,
+  // which are then written via row() and header()
+  void add_rows(const size_t number);
+  char * row(const size_t i) {return const_cast<char *>(sequence_list_[i].sequence_.data());}
+  void header(const size_t i, const Char_Span header);
 
   static void swap(MSA& a, MSA& b)
   {
     std::swap(a.num_sites_, b.num_sites_);
     std::swap(a.sequence_list_, b.sequence_list_);
+    std::swap(a.sites_, b.sites_);
+    std::swap(a.headers_, b.headers_);
   }
 
   // getters
@@ -33,7 +62,7 @@ public:
   const Sequence& operator[](const size_t i) const {return sequence_list_[i];}
 
   // setters
-  void num_sites(const size_t sites) {num_sites_ = sites;}
+  void num_sites(const size_t sites);
 
   //Iterator Compatability
   iterator begin() { return sequence_list_.begin(); }
@@ -44,8 +73,18 @@ public:
   const_iterator cend() const { return sequence_list_.cend(); }
 
 private:
+  // sites of a row, plus its terminating NUL
+  size_t stride_() const {return num_sites_ + 1;}
+  bool holds_(const Char_Span span) const;
+  char * add_sites_(const size_t number);
+  Char_Span add_header_(const Char_Span header);
+  void reserve_(std::vector<char>& buffer, Char_Span Sequence::* view, const size_t capacity);
+  void rebase_(Char_Span Sequence::* view, char const * const from, char const * const to);
+
   size_t num_sites_;
   container_type sequence_list_;
+  std::vector<char> sites_;
+  std::vector<char> headers_;
 };
 
 namespace std {
@@ -1,14 +1,149 @@
 #include "seq/MSA_Info.hpp"
 
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
 #include "io/Binary_Fasta.hpp"
+#include "io/file_io.hpp"
+#include "io/Input_Source.hpp"
+#include "io/Fasta_Chunk_Reader.hpp"
+#include "net/mpihead.hpp"
+#include "util/logging.hpp"
+
+static constexpr char SIDECAR_MAGIC[] = "EPA-NG_INFO";
+static constexpr unsigned int SIDECAR_VERSION = 2;
+
+static bool load_sidecar(const std::string& file_path, MSA_Info& result)
+{
+  long long size = 0;
+  long long mtime = 0;
+  if (not file_stamp(file_path, size, mtime)) {
+    return false;
+  }
+
+  std::ifstream sidecar(info_sidecar_path(file_path));
+  if (not sidecar.is_open()) {
+    return false;
+  }
+
+  std::string magic;
+  unsigned int version = 0;
+  long long stored_size = 0;
+  long long stored_mtime = 0;
+  size_t sequences = 0;
+  size_t sites = 0;
+  std::string mask_string;
+  sidecar >> magic >> version >> stored_size >> stored_mtime >> sequences >> sites >> mask_string;
 
-MSA_Info make_msa_info(const std::string& file_path)
+  if (sidecar.fail() or magic != SIDECAR_MAGIC or version != SIDECAR_VERSION) {
+    LOG_DBG << "Ignoring unreadable info sidecar of " << file_path;
+    return false;
+  }
+  if (stored_size != size or stored_mtime != mtime) {
+    LOG_DBG << "Ignoring outdated info sidecar of " << file_path;
+    return false;
+  }
+
+  MSA_Info::mask_type mask;
+  std::stringstream mask_stream(mask_string);
+  mask_stream >> mask;
+  if (mask.size() != sites) {
+    LOG_DBG << "Ignoring inconsistent info sidecar of " << file_path;
+    return false;
+  }
+
+  result = MSA_Info(file_path, sequences, mask, sites);
+  return true;
+}
+
+static void save_sidecar(const std::string& file_path, const MSA_Info& info)
+{
+  long long size = 0;
+  long long mtime = 0;
+  if (not file_stamp(file_path, size, mtime)) {
+    return;
+  }
+
+  const auto sidecar_path = info_sidecar_path(file_path);
+  const auto tmp_path = sidecar_path + ".tmp";
+  {
+    std::ofstream sidecar(tmp_path, std::ofstream::trunc);
+    sidecar << SIDECAR_MAGIC << " " << SIDECAR_VERSION << "\n";
+    sidecar << size << " " << mtime << " " << info.sequences() << " " << info.sites() << "\n";
+    sidecar << info.gap_mask() << "\n";
+    sidecar.flush();
+    if (sidecar.fail()) {
+      LOG_WARN << "Could not write the info sidecar of " << file_path << " to " << sidecar_path;
+      std::remove(tmp_path.c_str());
+      return;
+    }
+  }
+
+  if (std::rename(tmp_path.c_str(), sidecar_path.c_str()) != 0) {
+    LOG_WARN << "Could not write the info sidecar of " << file_path << " to " << sidecar_path;
+    std::remove(tmp_path.c_str());
+  }
+}
+
+/**
+  Counterpart of the scanning MSA_Info constructor for compressed files, which are read
+  through Input_Source.
+*/
+static MSA_Info scan_compressed(const std::string& file_path)
+{
+  static constexpr size_t SCAN_CHUNK_SIZE = 10000;
+
+  Fasta_Chunk_Reader reader(file_path);
+  MSA chunk;
+  size_t sequences = 0;
+  size_t sites = 0;
+  MSA_Info::mask_type gap_mask;
+
+  while (reader.read(chunk, SCAN_CHUNK_SIZE, MSA_Info::mask_type(), sites)) {
+    if (not sites) {
+      sites = chunk.num_sites();
+      gap_mask = MSA_Info::mask_type(sites, true);
+    }
+    for (const auto& seq : chunk) {
+      gap_mask &= genesis::sequence::gap_sites(genesis::sequence::Sequence("", seq.sequence()));
+    }
+    sequences += chunk.size();
+  }
+
+  return MSA_Info(file_path, sequences, gap_mask, sites);
+}
+
+std::string info_sidecar_path(const std::string& file_path)
+{
+  return file_path + ".epa_info";
+}
+
+MSA_Info make_msa_info(const std::string& file_path, const bool use_sidecar)
 {
   MSA_Info info;
   try {
     info = Binary_Fasta::get_info(file_path);
   } catch(const std::exception&) {
-    info = MSA_Info(file_path);
+    // the header of a bfast file already holds all info, so only FASTA needs the sidecar
+    if (use_sidecar and load_sidecar(file_path, info)) {
+      LOG_DBG << "Using the info sidecar of " << file_path;
+      return info;
+    }
+
+    if (Input_Source::detect(file_path) == Input_Source::Format::kPlain) {
+      info = MSA_Info(file_path);
+    } else {
+      info = scan_compressed(file_path);
+    }
+
+    if (use_sidecar) {
+      int local_rank = 0;
+      MPI_COMM_RANK(MPI_COMM_WORLD, &local_rank);
+      if (local_rank == 0) {
+        save_sidecar(file_path, info);
+      }
+    }
   }
   return info;
-}
\ No newline at end of file
+}
@@ -6,6 +6,10 @@
 #include "genesis/sequence/formats/fasta_input_iterator.hpp"
 
 #include <string>
+#include <vector>
+#include <utility>
+
+#include "util/Char_Span.hpp"
 
 /**
  * Class encompassing info about a MSA File.
@@ -103,12 +107,11 @@ private:
 
 };
 
-inline std::string subset_sequence( const std::string& seq,
-                                    const MSA_Info::mask_type& mask)
+// subsets into the given row, which must hold the unmasked sites
+inline void subset_sequence( const Char_Span seq,
+                             const MSA_Info::mask_type& mask,
+                             char * const result)
 {
-  const size_t nongap_count = mask.size() - mask.count();
-  std::string result(nongap_count, '$');
-
   if (seq.length() != mask.size()) {
     throw std::runtime_error{"In subset_sequence: mask and seq incompatible"};
   }
@@ -120,11 +123,63 @@ inline std::string subset_sequence( const std::string& seq,
     }
   }
 
-  assert(nongap_count == k);
+  assert(mask.size() - mask.count() == k);
+}
+
+// subsets into the given string, reusing its storage
+inline void subset_sequence( const Char_Span seq,
+                             const MSA_Info::mask_type& mask,
+                             std::string& result)
+{
+  const size_t nongap_count = mask.size() - mask.count();
+  result.assign(nongap_count, '$');
+  subset_sequence(seq, mask, &result[0]);
+}
 
+inline std::string subset_sequence( const Char_Span seq,
+                                    const MSA_Info::mask_type& mask)
+{
+  std::string result;
+  subset_sequence(seq, mask, result);
   return result;
 }
 
+/**
+ * Per site, whether the mask keeps it (1) or drops it (0), in a form that is fast to look up
+ * while reading sequences, such that masking can be done on the fly.
+ */
+inline std::vector<unsigned char> site_filter(const MSA_Info::mask_type& mask)
+{
+  std::vector<unsigned char> filter(mask.size());
+  for (size_t i = 0; i < mask.size(); ++i) {
+    filter[i] = not mask[i];
+  }
+  return filter;
+}
+
+/**
+ * The runs of sites kept by the mask, as [begin, end) pairs. Gap columns tend to cluster,
+ * such that masking by runs beats masking site by site.
+ */
+inline std::vector<std::pair<size_t, size_t>> kept_site_ranges(const MSA_Info::mask_type& mask)
+{
+  std::vector<std::pair<size_t, size_t>> ranges;
+  size_t i = 0;
+  while (i < mask.size()) {
+    while (i < mask.size() and mask[i]) {
+      ++i;
+    }
+    const auto begin = i;
+    while (i < mask.size() and not mask[i]) {
+      ++i;
+    }
+    if (begin < i) {
+      ranges.emplace_back(begin, i);
+    }
+  }
+  return ranges;
+}
+
 inline std::ostream& operator << (std::ostream& out, MSA_Info const& rhs)
 {
   out << "Path: " << rhs.path();
@@ -137,4 +192,10 @@ inline std::ostream& operator << (std::ostream& out, MSA_Info const& rhs)
   return out;
 }
 
-MSA_Info make_msa_info(const std::string& file_path);
+/**
+ * Info about a bfast or FASTA file. Getting that of a FASTA file means reading it completely,
+ * which may be avoided in later runs by storing it in a sidecar file next to it (see
+ * info_sidecar_path), that is used as long as the size and modification time of the file match.
+ */
+MSA_Info make_msa_info(const std::string& file_path, const bool use_sidecar = false);
+std::string info_sidecar_path(const std::string& file_path);
@@ -1,11 +1,12 @@
 #include "seq/MSA_Stream.hpp"
 
 #include <chrono>
+#include <algorithm>
 
 #include "util/logging.hpp"
 #include "net/epa_mpi_util.hpp"
 
-static void read_chunk( MSA_Stream::file_type& iter,
+static void read_chunk( MSA_Stream::file_type& reader,
                         const MSA_Info& info,
                         const bool premasking,
                         const size_t number,
@@ -13,30 +14,15 @@ static void read_chunk( MSA_Stream::file_type& iter,
                         const size_t max_read,
                         size_t& num_read)
 {
-  prefetch_buffer.clear();
+  static const MSA_Info::mask_type no_mask;
 
-  auto length = info.sites();
-  size_t number_left = std::min(number, max_read - num_read);
+  const size_t number_left = std::min(number, max_read - num_read);
 
-  while (number_left > 0 and iter)
-  {
-    const auto sequence_length = iter->length();
-    if ( length and (length != sequence_length) ) {
-      throw std::runtime_error{"MSA file does not contain equal size sequences"};
-    }
-
-    if (!length) length = sequence_length;
-
-    prefetch_buffer.append( iter->label(),
-                            (premasking
-                              ? subset_sequence(iter->sites(), info.gap_mask())
-                              : iter->sites())
-                          );
-
-    length = sequence_length;
-    number_left--;
-    ++iter;
-  }
+  // parses the sequences in parallel unless reading ahead, see Fasta_Chunk_Reader
+  reader.read( prefetch_buffer,
+               number_left,
+               premasking ? info.gap_mask() : no_mask,
+               info.sites() );
 
   num_read += prefetch_buffer.size();
 }
@@ -44,18 +30,19 @@ static void read_chunk( MSA_Stream::file_type& iter,
 MSA_Stream::MSA_Stream( const std::string& msa_file,
                         const MSA_Info& info,
                         const bool premasking,
-                        const bool split)
+                        const bool split,
+                        const size_t read_ahead)
   : info_(info)
+  , reader_(msa_file)
   , premasking_(premasking)
 {
-  genesis::sequence::FastaReader reader_settings;
-  // ensure sequences are uniformly upper case
-  reader_settings.site_casing( genesis::sequence::FastaReader::SiteCasing::kToUpper );
-  iter_ = genesis::sequence::FastaInputIterator( genesis::utils::from_file( msa_file ), reader_settings );
-
-  if (!iter_) {
-    throw std::runtime_error{std::string("Cannot open file: ") + msa_file};
-  }
+#ifdef __PREFETCH
+  read_ahead_ = std::max(read_ahead, size_t(1));
+  // the reading thread runs alongside the placement, which uses all threads already
+  reader_.parallel(false);
+#else
+  static_cast<void>(read_ahead);
+#endif
 
   // if we are under MPI, skip to this ranks assigned part of the input file
 
@@ -64,7 +51,7 @@ MSA_Stream::MSA_Stream( const std::string& msa_file,
     // get info about to which sequence to skip to and how much this rank should read
     std::tie(local_seq_offset_, max_read_) = local_seq_package( info.sequences() );
 
-    skip_to_sequence( local_seq_offset_ );
+    reader_.skip(local_seq_offset_);
   }
   #else
   static_cast<void>(split);
@@ -72,36 +59,94 @@ MSA_Stream::MSA_Stream( const std::string& msa_file,
 
 }
 
+#ifdef __PREFETCH
+/**
+  Body of the reading thread: reads chunks until the end of the input, staying at most
+  read_ahead_ chunks ahead of the consumer.
+*/
+void MSA_Stream::prefetch_()
+{
+  try {
+    while (true) {
+      container_type chunk;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]{ return stop_ or ready_.size() < read_ahead_; });
+        if (stop_) {
+          return;
+        }
+        if (not free_.empty()) {
+          chunk = std::move(free_.back());
+          free_.pop_back();
+        }
+      }
+
+      read_chunk(reader_, info_, premasking_, chunk_size_, chunk, max_read_, num_read_);
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (chunk.size() == 0) {
+        worker_done_ = true;
+        cond_.notify_all();
+        return;
+      }
+      ready_.push_back(std::move(chunk));
+      cond_.notify_all();
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    error_ = std::current_exception();
+    worker_done_ = true;
+    cond_.notify_all();
+  }
+}
+#endif
+
 size_t MSA_Stream::read_next( MSA_Stream::container_type& result,
                               const size_t number)
 {
+#ifdef __PREFETCH
   if (first_) {//...this is the first chunk
-    // then read the first chunk and kick off the next asynchronously
-    read_chunk(iter_, info_, premasking_, number, prefetch_chunk_, max_read_, num_read_);
+    // then start reading ahead asynchronously
+    chunk_size_ = number;
+    worker_ = std::thread(&MSA_Stream::prefetch_, this);
     first_ = false;
   }
-#ifdef __PREFETCH
-  // join prefetching thread to ensure new chunk exists
-  if (prefetcher_.valid()) {
-    prefetcher_.wait();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  stats_.queued += ready_.size();
+
+  // wait for the reading thread to deliver the next chunk
+  if (ready_.empty() and not worker_done_) {
+    ++stats_.stalls;
+    const auto start = std::chrono::steady_clock::now();
+    cond_.wait(lock, [this]{ return worker_done_ or not ready_.empty(); });
+    stats_.stall_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
   }
-#endif
-  // perform pointer swap to data
-  std::swap(result, prefetch_chunk_);
 
-  // start request next chunk from prefetcher (async)
-#ifdef __PREFETCH
-  prefetcher_ = std::async( std::launch::async,
-                            read_chunk,
-                            std::ref(iter_),
-                            std::ref(info_),
-                            premasking_,
-                            number,
-                            std::ref(prefetch_chunk_),
-                            max_read_,
-                            std::ref(num_read_));
+  // the previous chunk of the consumer is read into again
+  if (result.size() and free_.size() < read_ahead_) {
+    free_.push_back(std::move(result));
+  }
+
+  if (ready_.empty()) {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    result = container_type();
+    return 0;
+  }
+
+  result = std::move(ready_.front());
+  ready_.pop_front();
+  ++stats_.chunks;
+  cond_.notify_all();
 #else
-  read_chunk(iter_, info_, premasking_, number, prefetch_chunk_, max_read_, num_read_);
+  first_ = false;
+  // the storage of the previous chunk is reused
+  read_chunk(reader_, info_, premasking_, number, result, max_read_, num_read_);
+  if (result.size()) {
+    ++stats_.chunks;
+  }
 #endif
   // return size of current buffer
   return result.size();
@@ -111,13 +156,29 @@ MSA_Stream::~MSA_Stream()
 {
 #ifdef __PREFETCH
   // avoid dangling threads
-  if (prefetcher_.valid()) {
-    prefetcher_.wait();
+  if (worker_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    worker_.join();
   }
 #endif
 }
 
+msa_reader::Stats MSA_Stream::stats() const
+{
+#ifdef __PREFETCH
+  std::lock_guard<std::mutex> lock(mutex_);
+#endif
+  return stats_;
+}
 
+/**
+  Skips to the n-th sequence of this streams part of the file, counting the skipped
+  sequences as read.
+*/
 void MSA_Stream::skip_to_sequence(const size_t n)
 {
   // this function is too dirty, disallow usage after first read
@@ -125,14 +186,7 @@ void MSA_Stream::skip_to_sequence(const size_t n)
     throw std::runtime_error{"Skipping currently not allowed after first read!"};
   }
 
- #ifdef __PREFETCH
-  // join prefetching thread to ensure new chunk exists
-  if (prefetcher_.valid()) {
-    prefetcher_.wait();
-  }
-  #endif
-
-  if (n >= num_sequences()) {
+  if (local_seq_offset_ + n > num_sequences()) {
     throw std::runtime_error{"Trying to skip out of bounds!"};
   }
 
@@ -140,8 +194,7 @@ void MSA_Stream::skip_to_sequence(const size_t n)
     throw std::runtime_error{"Trying to skip behind!"};
   }
 
-  size_t offset = n - num_read_;
-
-  std::advance(iter_, offset);
+  const size_t offset = std::min(n, max_read_) - num_read_;
 
+  num_read_ += reader_.skip(offset);
 }
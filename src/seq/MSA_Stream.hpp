@@ -7,49 +7,73 @@
 #include <limits>
 
 #ifdef __PREFETCH
-#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #endif
 
 #include "seq/MSA.hpp"
 #include "seq/MSA_Info.hpp"
 #include "io/msa_reader_interface.hpp"
+#include "io/Fasta_Chunk_Reader.hpp"
+#include "util/constants.hpp"
 
-#include "genesis/sequence/formats/fasta_input_iterator.hpp"
-
+/**
+ * Reader of FASTA query files.
+ *
+ * With __PREFETCH, chunks are read on a dedicated thread that stays up to read_ahead chunks
+ * ahead of the consumer, such that bursts of slow reads are hidden behind the placement.
+ * The chunk size is that of the first call to read_next. Chunks handed back by the consumer
+ * (by passing them to the next read_next) are recycled, reusing the storage of the sequences.
+ */
 class MSA_Stream : public msa_reader
 {
 public:
   using container_type  = MSA;
-  using file_type       = genesis::sequence::FastaInputIterator;
+  using file_type       = Fasta_Chunk_Reader;
 
   MSA_Stream (const std::string& msa_file,
               const MSA_Info& info,
               const bool premasking = true,
-              const bool split = false);
+              const bool split = false,
+              const size_t read_ahead = DEFAULT_READ_AHEAD);
   MSA_Stream() = default;
   ~MSA_Stream();
 
   MSA_Stream(MSA_Stream const& other) = delete;
-  MSA_Stream(MSA_Stream&& other) = default;
+  MSA_Stream(MSA_Stream&& other) = delete;
 
   MSA_Stream& operator= (MSA_Stream const& other) = delete;
-  MSA_Stream& operator= (MSA_Stream && other) = default;
+  MSA_Stream& operator= (MSA_Stream && other) = delete;
 
   size_t read_next(container_type& result, const size_t number) override;
   size_t num_sequences() const override { return info_.sequences(); }
   size_t local_seq_offset() const override { return local_seq_offset_; }
-
-private:
-  void skip_to_sequence(const size_t);
+  void skip_to_sequence(const size_t n) override;
+  Stats stats() const override;
 
 private:
   MSA_Info info_;
-  file_type iter_;
-  // container_type active_chunk_;
-  container_type prefetch_chunk_;
+  file_type reader_;
 #ifdef __PREFETCH
-  std::future<void> prefetcher_;
+  void prefetch_();
+
+  size_t read_ahead_ = DEFAULT_READ_AHEAD;
+  size_t chunk_size_ = 0;
+  std::thread worker_;
+  mutable std::mutex mutex_;
+  std::condition_variable cond_;
+  // chunks read ahead, in order
+  std::deque<container_type> ready_;
+  // chunks handed back, to be read into again
+  std::vector<container_type> free_;
+  bool worker_done_ = false;
+  bool stop_ = false;
+  std::exception_ptr error_;
 #endif
+  Stats stats_;
   bool premasking_ = true;
   size_t num_read_ = 0;
   size_t max_read_ = std::numeric_limits<size_t>::max();
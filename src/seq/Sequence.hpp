@@ -2,35 +2,65 @@
 
 #include <string>
 #include <vector>
+#include <utility>
+#include <cstddef>
 
+#include "util/Char_Span.hpp"
+
+/**
+ * A sequence of an MSA: views of its header and sites within the storage of the MSA,
+ * along with its own annotations. Copies are cheap; they are valid as long as the storage
+ * of the MSA does not change (see MSA).
+ */
 class Sequence
 {
 public:
   Sequence()  = default;
   ~Sequence() = default;
-  Sequence(std::string header, std::string sequence) 
-    : sequence_(sequence) 
-  {
-    header_.push_back(header);
-  }
   Sequence(const Sequence& s) = default;
   Sequence(Sequence&& s)      = default;
 
   // operator overloads
   Sequence& operator = (const Sequence& s)  = default;
   Sequence& operator = (Sequence&& s)       = default;
-  bool operator==(const Sequence& other) {return sequence_.compare(other.sequence()) == 0;}
-  bool operator==(const Sequence& other) const {return sequence_.compare(other.sequence()) == 0;}  
+  bool operator==(const Sequence& other) const {return sequence_ == other.sequence();}
   // TODO doesn't merge in the full list (very tailored to the collapse func)
-  void merge(const Sequence& other) {header_.push_back(other.header());}
+  void merge(const Sequence& other)
+  {
+    merged_headers_.push_back(other.header());
+    merged_abundances_.push_back(other.abundance());
+  }
 
   // member access
-  const std::string& header() const {return header_.front();}
-  const std::vector<std::string>& header_list() const {return header_;}
-  const std::string& sequence() const {return sequence_;}
+  Char_Span header() const {return header_;}
+  // multiplicity of a dereplicated sequence (see seq/abundance.hpp)
+  size_t abundance() const {return abundance_;}
+  void abundance(const size_t abundance) {abundance_ = abundance;}
+  // headers merged into this sequence, without its own, and their abundances
+  const std::vector<std::string>& merged_headers() const {return merged_headers_;}
+  const std::vector<size_t>& merged_abundances() const {return merged_abundances_;}
+  std::vector<std::string> header_list() const
+  {
+    std::vector<std::string> result{header_};
+    result.insert(result.end(), merged_headers_.begin(), merged_headers_.end());
+    return result;
+  }
+  Char_Span sequence() const {return sequence_;}
 
 private:
-  std::vector<std::string> header_;
-  std::string sequence_;
+  // only an MSA places sequences into its storage
+  friend class MSA;
+
+  Sequence(const Char_Span header, const Char_Span sequence)
+    : header_(header)
+    , sequence_(sequence)
+  { }
+
+  Char_Span header_;
+  Char_Span sequence_;
+  // the merged headers stay empty (without allocating) for all but duplicates
+  std::vector<std::string> merged_headers_;
+  std::vector<size_t> merged_abundances_;
+  size_t abundance_ = 1;
 
 };
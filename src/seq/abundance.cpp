@@ -0,0 +1,50 @@
+#include "seq/abundance.hpp"
+
+#include <stdexcept>
+#include <cctype>
+
+static constexpr char SIZE_FIELD[] = ";size=";
+
+size_t split_abundance(const std::string& header, std::string& name)
+{
+  const auto field_begin = header.find(SIZE_FIELD);
+  if (field_begin == std::string::npos) {
+    name = header;
+    return 1;
+  }
+
+  const auto value_begin = field_begin + sizeof(SIZE_FIELD) - 1;
+  auto value_end = value_begin;
+  while (value_end < header.size() and std::isdigit(static_cast<unsigned char>(header[value_end]))) {
+    ++value_end;
+  }
+
+  if (value_end == value_begin or (value_end < header.size() and header[value_end] != ';')) {
+    throw std::runtime_error{std::string("Invalid abundance annotation in sequence header: ") + header};
+  }
+
+  const auto abundance = std::stoull(header.substr(value_begin, value_end - value_begin));
+  if (abundance == 0) {
+    throw std::runtime_error{std::string("Abundance of zero in sequence header: ") + header};
+  }
+
+  // drop the field, and a trailing separator left behind
+  name = header.substr(0, field_begin) + header.substr(value_end);
+  if (not name.empty() and name.back() == ';') {
+    name.pop_back();
+  }
+
+  return abundance;
+}
+
+void split_abundances(MSA& msa)
+{
+  std::string name;
+  for (size_t i = 0; i < msa.size(); ++i) {
+    const auto abundance = split_abundance(msa[i].header(), name);
+    if (name.size() != msa[i].header().size()) {
+      msa.header(i, name);
+      (msa.begin() + i)->abundance(abundance);
+    }
+  }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+#include "seq/MSA.hpp"
+
+/**
+ * Abundance annotations of dereplicated query sequences, as written by usearch/vsearch:
+ * `>seqA;size=1234`, where further `;key=value` fields may follow the name.
+ *
+ * Splits the size field off the header: sets the name to the remainder and returns the
+ * multiplicity, which is 1 for headers without annotation.
+ */
+size_t split_abundance(const std::string& header, std::string& name);
+
+/**
+ * Splits the abundance annotations off all headers of the MSA, storing them with the
+ * sequences (see Sequence::abundance). Meant to be called right after reading, such that
+ * invalid annotations are reported before any result is written. Headers without
+ * annotation are left as they are, which makes repeated calls harmless.
+ */
+void split_abundances(MSA& msa);
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+#include "util/Char_Span.hpp"
+
+/**
+ * 128 bit hash of a (masked) sequence: two independent 64 bit hashes, making
+ * collisions negligible even for billions of sequences.
+ *
+ * The hashes are persisted (see Placement_Cache), so both are fully specified
+ * functions of the bytes of the sequence, identical across platforms and builds:
+ * XXH64 (seed 0) and FNV-1a.
+ */
+using sequence_hash_type = std::pair<uint64_t, uint64_t>;
+
+namespace xxh64 {
+  constexpr uint64_t P1 = 11400714785074694791ull;
+  constexpr uint64_t P2 = 14029467366897019727ull;
+  constexpr uint64_t P3 = 1609587929392839161ull;
+  constexpr uint64_t P4 = 9650029242287828579ull;
+  constexpr uint64_t P5 = 2870177450012600261ull;
+
+  inline uint64_t rotl(const uint64_t x, const int r)
+  {
+    return (x << r) | (x >> (64 - r));
+  }
+
+  // little endian, independent of the host
+  inline uint64_t read(unsigned char const * const p, const size_t bytes)
+  {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+      value |= static_cast<uint64_t>(p[i]) << (8 * i);
+    }
+    return value;
+  }
+
+  inline uint64_t round(uint64_t acc, const uint64_t input)
+  {
+    acc += input * P2;
+    acc = rotl(acc, 31);
+    return acc * P1;
+  }
+
+  inline uint64_t merge_round(uint64_t acc, const uint64_t val)
+  {
+    acc ^= round(0, val);
+    return acc * P1 + P4;
+  }
+}
+
+inline uint64_t hash_xxh64(const Char_Span data)
+{
+  using namespace xxh64;
+  auto p = reinterpret_cast<unsigned char const *>(data.data());
+  auto const end = p + data.size();
+  uint64_t h;
+
+  if (data.size() >= 32) {
+    uint64_t v1 = P1 + P2;
+    uint64_t v2 = P2;
+    uint64_t v3 = 0;
+    uint64_t v4 = -P1;
+    for (; end - p >= 32; p += 32) {
+      v1 = round(v1, read(p, 8));
+      v2 = round(v2, read(p + 8, 8));
+      v3 = round(v3, read(p + 16, 8));
+      v4 = round(v4, read(p + 24, 8));
+    }
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge_round(h, v1);
+    h = merge_round(h, v2);
+    h = merge_round(h, v3);
+    h = merge_round(h, v4);
+  } else {
+    h = P5;
+  }
+
+  h += data.size();
+
+  for (; end - p >= 8; p += 8) {
+    h ^= round(0, read(p, 8));
+    h = rotl(h, 27) * P1 + P4;
+  }
+  if (end - p >= 4) {
+    h ^= read(p, 4) * P1;
+    h = rotl(h, 23) * P2 + P3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= *p * P5;
+    h = rotl(h, 11) * P1;
+  }
+
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  h ^= h >> 32;
+  return h;
+}
+
+inline uint64_t hash_fnv1a(const Char_Span data)
+{
+  uint64_t fnv = 14695981039346656037ull;
+  for (const auto c : data) {
+    fnv ^= static_cast<unsigned char>(c);
+    fnv *= 1099511628211ull;
+  }
+  return fnv;
+}
+
+inline sequence_hash_type hash_sequence(const Char_Span sequence)
+{
+  return std::make_pair(hash_xxh64(sequence), hash_fnv1a(sequence));
+}
+
+// for use of the hash as key of an unordered container
+struct sequence_hash_hasher
+{
+  size_t operator()(const sequence_hash_type& hash) const { return hash.first ^ hash.second; }
+};
@@ -0,0 +1,57 @@
+#include "tree/CLV_Prefetcher.hpp"
+
+#include <utility>
+
+CLV_Prefetcher::CLV_Prefetcher(Tree& tree)
+  : tree_(tree)
+{ }
+
+CLV_Prefetcher::~CLV_Prefetcher()
+{
+  cancel();
+}
+
+/**
+  Stops the currently running prefetch (if any) and waits for it to return.
+*/
+void CLV_Prefetcher::cancel()
+{
+#ifdef __PREFETCH
+  if (worker_.valid()) {
+    cancel_ = true;
+    worker_.wait();
+    cancel_ = false;
+  }
+#endif
+}
+
+/**
+  Replaces the current prefetch schedule: has the pages of the CLVs and scalers on both ends
+  of every given branch read in the background (see Tree::prefetch_clv), in the given order,
+  which should be the order in which they will be used.
+*/
+void CLV_Prefetcher::schedule(std::vector<pll_unode_t *> branches)
+{
+  if (not tree_.options().load_binary_mode) {
+    return;
+  }
+
+  cancel();
+
+#ifdef __PREFETCH
+  worker_ = std::async( std::launch::async,
+    [this](std::vector<pll_unode_t *> branches) {
+      for (auto const node : branches) {
+        if (cancel_) {
+          return;
+        }
+        // same pair of nodes as Tiny_Tree asks for
+        tree_.prefetch_clv(node);
+        tree_.prefetch_clv(node->back);
+      }
+    },
+    std::move(branches));
+#else
+  (void) branches;
+#endif
+}
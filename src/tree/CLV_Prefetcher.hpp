@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+
+#ifdef __PREFETCH
+#include <future>
+#endif
+
+#include "core/pll/pllhead.hpp"
+#include "tree/Tree.hpp"
+
+/**
+ * Has the OS read the CLVs needed for a sequence of upcoming branches ahead of their
+ * use, on a background thread. Only meaningful when the reference tree lazily loads
+ * its CLVs from a binary file.
+ *
+ * Without __PREFETCH, scheduling is a no-op and all loading happens on demand.
+ */
+class CLV_Prefetcher
+{
+public:
+  explicit CLV_Prefetcher(Tree& tree);
+  CLV_Prefetcher()  = delete;
+  ~CLV_Prefetcher();
+
+  CLV_Prefetcher(CLV_Prefetcher const& other) = delete;
+  CLV_Prefetcher(CLV_Prefetcher&& other)      = delete;
+
+  CLV_Prefetcher& operator= (CLV_Prefetcher const& other) = delete;
+  CLV_Prefetcher& operator= (CLV_Prefetcher && other)     = delete;
+
+  void schedule(std::vector<pll_unode_t *> branches);
+  void cancel();
+
+private:
+  Tree& tree_;
+  std::atomic<bool> cancel_{false};
+#ifdef __PREFETCH
+  std::future<void> worker_;
+#endif
+};
@@ -90,6 +90,9 @@ Tiny_Tree::Tiny_Tree( pll_unode_t * edge_node,
     old_proximal = old_distal->back;
   }
 
+  proximal_pin_ = CLV_Pin(reference_tree, old_proximal);
+  distal_pin_   = CLV_Pin(reference_tree, old_distal);
+
   tree_ = std::unique_ptr<pll_utree_t, utree_deleter>(
       	                    make_tiny_tree_structure( old_proximal,
                                                       old_distal,
@@ -179,7 +182,7 @@ Placement Tiny_Tree::place(const Sequence &s)
   if (premasking_) {
     range = get_valid_range(s.sequence());
     if (not range) {
-      throw std::runtime_error{std::string()+"Sequence with header '" + s.header()
+      throw std::runtime_error{std::string()+"Sequence with header '" + s.header().str()
         + "' does not appear to have any non-gap sites!"};
     }
   }
@@ -241,7 +244,7 @@ Placement Tiny_Tree::place(const Sequence &s)
   if (logl == -std::numeric_limits<double>::infinity()) {
     throw std::runtime_error{
       std::string("-INF logl at branch ") + std::to_string( branch_id_ ) +
-      " with sequence " + s.header()
+      " with sequence " + s.header().str()
     };
   }
 
@@ -63,4 +63,8 @@ private:
 
   std::shared_ptr<Lookup_Store> lookup_;
 
+  // keep the referenced CLVs in memory for the lifetime of this object
+  CLV_Pin proximal_pin_;
+  CLV_Pin distal_pin_;
+
 };
@@ -3,7 +3,14 @@
 #include <stdexcept>
 #include <iostream>
 #include <cstdio>
+#include <cassert>
 #include <numeric>
+#include <algorithm>
+#include <utility>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
 
 #include "core/pll/epa_pll_util.hpp"
 #include "io/file_io.hpp"
@@ -58,10 +65,34 @@ Tree::Tree( const std::string &tree_file,
   LOG_INFO << model_;
   LOG_DBG << "Tree length: " << sum_branch_lengths(tree_.get());
 
-  precompute_clvs(tree_.get(), partition_.get(), nums_);
+  if (options_.shm_attach.empty()) {
+    if (options_.opt_model or options_.opt_branches) {
+#ifdef __OMP
+      omp_set_num_threads(options_.num_threads ? options_.num_threads : omp_get_max_threads());
+#endif
+      LOG_INFO << "Optimizing the reference tree";
+      optimize(model_, tree_.get(), partition_.get(), nums_, options_.opt_branches, options_.opt_model);
+      if (options_.opt_model) {
+        LOG_INFO << "Optimized model parameters:";
+        LOG_INFO << model_;
+      }
+    }
+    // the optimization leaves the CLVs at whichever parameters it tried last
+    precompute_clvs(tree_.get(), partition_.get(), nums_);
+  } else {
+    LOG_INFO << "Attaching to shared reference: " << options_.shm_attach;
+    shared_ = std::make_shared<Shared_Store>(options_.shm_attach);
+    shared_->validate(partition_.get());
+    precompute_pmatrices(tree_.get(), partition_.get(), nums_);
+    shared_->assign(partition_.get());
+  }
 
   auto logl = this->ref_tree_logl();
 
+  if (shared_) {
+    shared_->validate(logl);
+  }
+
   if ( logl == -std::numeric_limits<double>::infinity() ) {
     throw std::runtime_error{"Tree Log-Likelihood -INF!"};
   }
@@ -85,7 +116,12 @@ Tree::Tree( const std::string& bin_file,
   partition_ = partition_ptr(binary_.load_partition(), pll_partition_destroy);
   nums_ = Tree_Numbers(partition_->tips);
   tree_ = utree_ptr(binary_.load_utree(partition_->tips), utree_destroy);
+  if (binary_.is_snapshot()) {
+    binary_.load_mapper(mapper_);
+  }
   locks_ = Mutex_List(partition_->tips + partition_->clv_buffers);
+  prefetched_ = std::vector<char>(partition_->tips + partition_->clv_buffers, false);
+  residency_ = std::make_unique<Residency>(partition_->tips + partition_->clv_buffers);
 
   raxml::assign(model_, partition_.get());
   LOG_DBG << model_;
@@ -94,12 +130,124 @@ Tree::Tree( const std::string& bin_file,
         << std::to_string(this->ref_tree_logl());
 }
 
+Tree::~Tree()
+{
+  release_borrowed_();
+}
+
+Tree& Tree::operator=(Tree&& other)
+{
+  if (this != &other) {
+    // the old partition may still point into a shared segment or mapped file
+    release_borrowed_();
+    partition_  = std::move(other.partition_);
+    tree_       = std::move(other.tree_);
+    nums_       = std::move(other.nums_);
+    ref_msa_    = std::move(other.ref_msa_);
+    model_      = std::move(other.model_);
+    options_    = std::move(other.options_);
+    binary_     = std::move(other.binary_);
+    mapper_     = std::move(other.mapper_);
+    shared_     = std::move(other.shared_);
+    locks_      = std::move(other.locks_);
+    prefetched_ = std::move(other.prefetched_);
+    stats_      = std::move(other.stats_);
+    residency_  = std::move(other.residency_);
+  }
+  return *this;
+}
+
+/**
+  Hands buffers borrowed from a shared store or a mapped binary file back, such that
+  pll_partition_destroy does not attempt to free them.
+*/
+void Tree::release_borrowed_()
+{
+  if (not partition_) {
+    return;
+  }
+  if (shared_) {
+    shared_->release(partition_.get());
+  }
+  binary_.release(partition_.get());
+}
+
 /**
   Returns a pointer either to the CLV or tipchar buffer, depending on the index.
   If they are not currently in memory, fetches them from file.
   Ensures that associated scalers are allocated and ready on return.
 */
 void* Tree::get_clv(const pll_unode_t* node)
+{
+  return load_clv_(node, false);
+}
+
+/**
+  Has the OS read the pages of the CLV/tipchars and scaler of the node from the binary file
+  in the background, ahead of their use via get_clv. Does not load them itself, so this
+  neither blocks nor counts towards the memory limit. Meant to be called from a background
+  thread (see CLV_Prefetcher).
+*/
+void Tree::prefetch_clv(const pll_unode_t* node)
+{
+  if (not options_.load_binary_mode) {
+    return;
+  }
+
+  const auto i = node->clv_index;
+  if (i >= partition_->tips + partition_->clv_buffers) {
+    throw std::runtime_error{"Node index out of bounds"};
+  }
+
+  Scoped_Mutex lock_by_clv_id(locks_[i]);
+
+  if (prefetched_[i]) {
+    return;
+  }
+
+  const bool use_tipchars = partition_->attributes & PLL_ATTRIB_PATTERN_TIP;
+  const bool resident = (use_tipchars and i < partition_->tips)
+                      ? partition_->tipchars[i] != nullptr
+                      : partition_->clv[i] != nullptr;
+
+  bool advised = false;
+  if (not resident) {
+    advised |= binary_.prefetch_clv(i);
+  }
+
+  const auto scaler = node->scaler_index;
+  if (scaler != PLL_SCALE_BUFFER_NONE
+      and partition_->scale_buffer[scaler] == nullptr) {
+    advised |= binary_.prefetch_scaler(partition_.get(), scaler);
+  }
+
+  if (advised) {
+    prefetched_[i] = true;
+    ++stats_->prefetched;
+  }
+}
+
+/**
+  Like get_clv, but additionally protects the CLV and scaler from eviction until
+  unpin_clv is called for the same node (see CLV_Pin).
+*/
+void* Tree::pin_clv(const pll_unode_t* node)
+{
+  return load_clv_(node, true);
+}
+
+void Tree::unpin_clv(const pll_unode_t* node)
+{
+  if (not residency_) {
+    return;
+  }
+  const auto i = node->clv_index;
+  Scoped_Mutex lock_by_clv_id(locks_[i]);
+  assert(residency_->pins[i]);
+  --residency_->pins[i];
+}
+
+void* Tree::load_clv_(const pll_unode_t* node, const bool pin)
 {
   const auto i = node->clv_index;
 
@@ -113,6 +261,8 @@ void* Tree::get_clv(const pll_unode_t* node)
     throw std::runtime_error{"Node index out of bounds"};
   }
 
+  bool loaded = false;
+  size_t loaded_bytes = 0;
   void* clv_ptr = nullptr;
   if (use_tipchars and i < partition_->tips) {
     clv_ptr = partition_->tipchars[i];
@@ -121,6 +271,8 @@ void* Tree::get_clv(const pll_unode_t* node)
         and clv_ptr == nullptr) {
       binary_.load_tipchars(partition_.get(), i);
       clv_ptr = partition_->tipchars[i];
+      loaded = true;
+      loaded_bytes += partition_->sites * sizeof(unsigned char);
     }
   } else {
     clv_ptr = partition_->clv[i];
@@ -129,6 +281,8 @@ void* Tree::get_clv(const pll_unode_t* node)
         and clv_ptr == nullptr) {
       binary_.load_clv(partition_.get(), i);
       clv_ptr = partition_->clv[i];
+      loaded = true;
+      loaded_bytes += pll_get_clv_size(partition_.get(), i) * sizeof(double);
     }
   }
 
@@ -137,18 +291,112 @@ void* Tree::get_clv(const pll_unode_t* node)
       and scaler != PLL_SCALE_BUFFER_NONE
       and partition_->scale_buffer[scaler] == nullptr) {
     binary_.load_scaler(partition_.get(), scaler);
+    loaded = true;
+    const size_t scaler_sites = (partition_->attributes & PLL_ATTRIB_RATE_SCALERS)
+                              ? partition_->sites * partition_->rate_cats
+                              : partition_->sites;
+    loaded_bytes += scaler_sites * sizeof(unsigned int);
+    residency_->scalers[i] = scaler;
+  }
+
+  if (options_.load_binary_mode) {
+    if (loaded) {
+      if (prefetched_[i]) {
+        prefetched_[i] = false;
+        ++stats_->prefetch_hits;
+      } else {
+        ++stats_->stalls;
+      }
+    }
+
+    residency_->last_use[i] = ++residency_->clock;
+    if (pin) {
+      ++residency_->pins[i];
+    }
+
+    if (loaded_bytes) {
+      residency_->bytes[i] += loaded_bytes;
+      const auto resident = (stats_->resident_bytes += loaded_bytes);
+      // not exact under contention, but good enough for a statistic
+      if (resident > stats_->peak_resident_bytes) {
+        stats_->peak_resident_bytes = resident;
+      }
+      evict_(i);
+    }
   }
 
   return clv_ptr;
 }
 
+/**
+  If over the memory limit, evicts the least recently used CLVs (and their scalers) that are
+  not pinned, until the resident size is below 90% of the limit. Never blocks: CLVs currently
+  locked by another thread are skipped, as is a call while another thread is already evicting.
+  Must be called while holding the lock of the CLV with index keep.
+*/
+void Tree::evict_(const unsigned int keep)
+{
+  const size_t limit = options_.clv_memory_limit;
+  if (not limit or stats_->resident_bytes <= limit) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> evict_lock(residency_->evict_mutex, std::try_to_lock);
+  if (not evict_lock) {
+    return;
+  }
+
+  std::vector<std::pair<size_t, unsigned int>> candidates;
+  for (size_t j = 0; j < residency_->bytes.size(); ++j) {
+    if (j != keep and residency_->bytes[j]) {
+      candidates.emplace_back(residency_->last_use[j], j);
+    }
+  }
+  std::sort(std::begin(candidates), std::end(candidates));
+
+  const size_t target = limit - limit / 10;
+  for (auto const& candidate : candidates) {
+    if (stats_->resident_bytes <= target) {
+      break;
+    }
+    const auto j = candidate.second;
+    std::unique_lock<std::mutex> lock_by_clv_id(locks_[j], std::try_to_lock);
+    if (not lock_by_clv_id or residency_->pins[j] or not residency_->bytes[j]) {
+      continue;
+    }
+    evict_locked_(j);
+  }
+}
+
+void Tree::evict_locked_(const unsigned int clv_index)
+{
+  const bool use_tipchars = partition_->attributes & PLL_ATTRIB_PATTERN_TIP;
+
+  if (use_tipchars and clv_index < partition_->tips) {
+    binary_.evict_tipchars(partition_.get(), clv_index);
+  } else {
+    binary_.evict_clv(partition_.get(), clv_index);
+  }
+
+  const auto scaler = residency_->scalers[clv_index];
+  if (scaler != PLL_SCALE_BUFFER_NONE) {
+    binary_.evict_scaler(partition_.get(), scaler);
+    residency_->scalers[clv_index] = PLL_SCALE_BUFFER_NONE;
+  }
+
+  stats_->resident_bytes -= residency_->bytes[clv_index];
+  residency_->bytes[clv_index] = 0;
+  prefetched_[clv_index] = false;
+  ++stats_->evictions;
+}
+
 double Tree::ref_tree_logl()
 {
   std::vector<unsigned int> param_indices(partition_->rate_cats, 0);
   const auto root = get_root(tree_.get());
-  // ensure clvs are there
-  this->get_clv(root);
-  this->get_clv(root->back);
+  // ensure clvs are there (and stay there)
+  CLV_Pin root_pin(*this, root);
+  CLV_Pin back_pin(*this, root->back);
 
   auto logl = pll_compute_edge_loglikelihood(partition_.get(),
                                         root->clv_index,
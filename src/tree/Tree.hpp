@@ -3,12 +3,14 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <atomic>
 
 #include "seq/MSA.hpp"
 #include "core/raxml/Model.hpp"
 #include "tree/Tree_Numbers.hpp"
 #include "util/Options.hpp"
 #include "io/Binary.hpp"
+#include "io/Shared_Store.hpp"
 #include "core/pll/pllhead.hpp"
 #include "core/pll/pll_util.hpp"
 #include "core/pll/rtree_mapper.hpp"
@@ -22,6 +24,17 @@ public:
   using partition_ptr = std::unique_ptr<pll_partition_t, partition_deleter>;
   using utree_ptr     = std::unique_ptr<pll_utree_t, utree_deleter>;
 
+  // counters regarding the lazy loading of CLVs in binary mode
+  struct CLV_Stats
+  {
+    std::atomic<size_t> prefetched{0};    // read ahead of use via prefetch_clv (madvise)
+    std::atomic<size_t> prefetch_hits{0}; // load of a CLV whose pages were read ahead
+    std::atomic<size_t> stalls{0};        // load of a CLV that was not read ahead
+    std::atomic<size_t> resident_bytes{0};
+    std::atomic<size_t> peak_resident_bytes{0};
+    std::atomic<size_t> evictions{0};
+  };
+
   Tree( const std::string& tree_file,
         const MSA& msa,
         raxml::Model& model,
@@ -30,13 +43,13 @@ public:
         raxml::Model &model,
         const Options& options);
   Tree()  = default;
-  ~Tree() = default;
+  ~Tree();
 
   Tree(Tree const& other) = delete;
   Tree(Tree&& other)      = default;
 
   Tree& operator= (Tree const& other) = delete;
-  Tree& operator= (Tree && other)     = default;
+  Tree& operator= (Tree && other);
 
   // member access
   Tree_Numbers& nums() { return nums_; }
@@ -45,12 +58,41 @@ public:
   auto partition() { return partition_.get(); }
   auto tree() { return tree_.get(); }
   rtree_mapper& mapper() { return mapper_; }
+  std::shared_ptr<Shared_Store> shared_store() { return shared_; }
+  Binary& binary() { return binary_; }
 
   void * get_clv(const pll_unode_t*);
+  void prefetch_clv(const pll_unode_t*);
+  void * pin_clv(const pll_unode_t*);
+  void unpin_clv(const pll_unode_t*);
+  CLV_Stats const& clv_stats() const { return *stats_; }
 
   double ref_tree_logl();
 
 private:
+  void release_borrowed_();
+  void * load_clv_(const pll_unode_t*, const bool pin);
+  void evict_(const unsigned int keep);
+  void evict_locked_(const unsigned int clv_index);
+
+  // bookkeeping for the memory limit on lazily loaded CLVs (see Options::clv_memory_limit)
+  struct Residency
+  {
+    explicit Residency(const size_t num_clvs)
+      : last_use(num_clvs)
+      , bytes(num_clvs)
+      , pins(num_clvs, 0)
+      , scalers(num_clvs, PLL_SCALE_BUFFER_NONE)
+    { }
+
+    std::vector<std::atomic<size_t>> last_use;  // logical time of the last access
+    std::vector<std::atomic<size_t>> bytes;     // resident bytes, including the scaler
+    std::vector<unsigned int> pins;             // guarded by locks_
+    std::vector<unsigned int> scalers;          // scaler loaded alongside, guarded by locks_
+    std::atomic<size_t> clock{0};
+    std::mutex evict_mutex;
+  };
+
   // pll structures
 
   partition_ptr partition_{nullptr, pll_partition_destroy};
@@ -65,8 +107,58 @@ private:
   Options options_;
   Binary binary_;
   rtree_mapper mapper_;
+  // CLVs borrowed from a shared memory segment, if attached
+  std::shared_ptr<Shared_Store> shared_;
 
   // thread safety
   Mutex_List locks_;
 
+  // per clv flag: was read ahead by prefetch_clv, but not yet loaded. Guarded by locks_
+  std::vector<char> prefetched_;
+  std::unique_ptr<CLV_Stats> stats_ = std::make_unique<CLV_Stats>();
+  std::unique_ptr<Residency> residency_;
+
+};
+
+/**
+ * Keeps a lazily loaded reference CLV (and its scaler) from being evicted for as long as
+ * the object lives. Obtain the CLV via get_pointer instead of Tree::get_clv.
+ */
+class CLV_Pin
+{
+public:
+  CLV_Pin(Tree& tree, const pll_unode_t* node)
+    : tree_(&tree)
+    , node_(node)
+    , ptr_(tree.pin_clv(node))
+  { }
+  CLV_Pin() = default;
+  ~CLV_Pin()
+  {
+    if (tree_) {
+      tree_->unpin_clv(node_);
+    }
+  }
+
+  CLV_Pin(CLV_Pin const& other) = delete;
+  CLV_Pin(CLV_Pin&& other)
+  {
+    *this = std::move(other);
+  }
+
+  CLV_Pin& operator= (CLV_Pin const& other) = delete;
+  CLV_Pin& operator= (CLV_Pin && other)
+  {
+    std::swap(tree_, other.tree_);
+    std::swap(node_, other.node_);
+    std::swap(ptr_, other.ptr_);
+    return *this;
+  }
+
+  void * get_pointer() const { return ptr_; }
+
+private:
+  Tree * tree_ = nullptr;
+  pll_unode_t const * node_ = nullptr;
+  void * ptr_ = nullptr;
 };
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <ostream>
+
+/**
+ * Read-only view of characters stored elsewhere, such as the header or the sites of a
+ * sequence within the storage of its MSA.
+ *
+ * Views of std::strings, string literals and of MSA storage are NUL terminated, such that
+ * c_str() may be handed to C interfaces. Converts to std::string where one is needed,
+ * which copies.
+ */
+class Char_Span
+{
+public:
+  using const_iterator = char const *;
+
+  Char_Span() = default;
+  Char_Span(char const * const data, const size_t size)
+    : data_(data)
+    , size_(size)
+  { }
+  Char_Span(char const * const str)
+    : data_(str)
+    , size_(std::strlen(str))
+  { }
+  Char_Span(const std::string& str)
+    : data_(str.c_str())
+    , size_(str.size())
+  { }
+  ~Char_Span() = default;
+
+  // member access
+  char const * data() const { return data_; }
+  char const * c_str() const { return data_; }
+  size_t size() const { return size_; }
+  size_t length() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  char operator[](const size_t i) const { return data_[i]; }
+
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+
+  std::string str() const { return std::string(data_, size_); }
+  operator std::string() const { return str(); }
+
+  int compare(const Char_Span other) const
+  {
+    const auto common = std::min(size_, other.size_);
+    const int result = common ? std::memcmp(data_, other.data_, common) : 0;
+    if (result != 0 or size_ == other.size_) {
+      return result;
+    }
+    return size_ < other.size_ ? -1 : 1;
+  }
+
+private:
+  char const * data_ = "";
+  size_t size_ = 0;
+};
+
+inline bool operator==(const Char_Span lhs, const Char_Span rhs)
+{
+  return lhs.size() == rhs.size() and lhs.compare(rhs) == 0;
+}
+
+inline bool operator!=(const Char_Span lhs, const Char_Span rhs)
+{
+  return not (lhs == rhs);
+}
+
+inline std::ostream& operator<<(std::ostream& out, const Char_Span span)
+{
+  return out.write(span.data(), span.size());
+}
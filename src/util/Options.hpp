@@ -2,6 +2,9 @@
 
 #include <limits>
 #include <string>
+#include <cstddef>
+
+#include "util/constants.hpp"
 
 class Options {
 
@@ -12,6 +15,12 @@ public:
     kAuto
   };
 
+  enum class ClvPrecision {
+    kDouble,
+    kFloat,
+    kScaled16
+  };
+
   Options()  = default;
   ~Options() = default;
 
@@ -27,14 +36,27 @@ public:
   double prescoring_threshold   = 0.99999;
   bool ranged                   = false;
   bool dump_binary_mode         = false;
+  bool dump_snapshot_mode       = false;
   bool load_binary_mode         = false;
   unsigned int chunk_size       = 5000;
+  unsigned int read_ahead       = DEFAULT_READ_AHEAD;
+  size_t clv_memory_limit       = 0; // in bytes, 0 meaning unlimited. Only used in load_binary_mode
   unsigned int num_threads      = 0;
   bool repeats                  = false;
   bool premasking               = true;
   bool baseball                 = false;
   std::string tmp_dir;
+  std::string shm_publish;
+  std::string shm_attach;
+  std::string server_socket;
+  std::string cache_dir;
   unsigned int precision        = 10;
   NumericalScaling scaling      = NumericalScaling::kAuto;
+  ClvPrecision binary_precision = ClvPrecision::kDouble;
   bool preserve_rooting         = true;
+  bool checkpointing            = false;
+  bool dedup                    = false;
+  size_t dedup_memory_limit     = 0; // in bytes, 0 meaning unlimited
+  bool abundances               = false;
+  bool info_sidecar             = false;
 };
@@ -3,6 +3,8 @@
 #include <string>
 #include <cassert>
 
+#include "util/Char_Span.hpp"
+
 class Range {
 public:
   Range (const unsigned int begin, const unsigned int span)
@@ -34,7 +36,7 @@ inline std::ostream& operator << (std::ostream& out, Range const& rhs)
  *  0  1  2  3  4  5  6  7  8  9 10
  *  Output: (3,6)
  */
-inline Range get_valid_range(const std::string& sequence)
+inline Range get_valid_range(const Char_Span sequence)
 {
   size_t lower = 0;
   size_t upper = sequence.length();
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 // constexpr unsigned int STATES = 4;
 // constexpr unsigned int RATE_CATS = 4;
 
@@ -11,3 +13,9 @@
 
 #define DEFAULT_BRANCH_LENGTH -log(0.9)
 // constexpr double DEFAULT_BRANCH_LENGTH = 0.9;
+
+// query chunks read ahead of the placement (see MSA_Stream, Binary_Fasta_Reader)
+constexpr unsigned int DEFAULT_READ_AHEAD = 2;
+
+// largest request the placement server accepts, in bytes (see Placement_Server)
+constexpr size_t DEFAULT_MAX_REQUEST_SIZE = 1ul << 28;
@@ -1,11 +1,25 @@
 #include "genesis/genesis.hpp"
 
 #include "util/logging.hpp"
+#include "io/Input_Source.hpp"
+#include "io/Fasta_Chunk_Reader.hpp"
 
 static genesis::sequence::SequenceSet read_any_seqfile( std::string const& file )
 {
   genesis::sequence::SequenceSet out_set;
 
+  // compressed files can only be FASTA
+  if (Input_Source::detect(file) != Input_Source::Format::kPlain) {
+    Fasta_Chunk_Reader reader(file);
+    MSA chunk;
+    while (reader.read(chunk, 10000, MSA_Info::mask_type())) {
+      for (const auto& seq : chunk) {
+        out_set.add(genesis::sequence::Sequence(seq.header().str(), seq.sequence().str()));
+      }
+    }
+    return out_set;
+  }
+
   try {
     genesis::sequence::FastaReader().read( genesis::utils::from_file( file ), out_set );
   } catch( std::exception& e ) {
@@ -1,11 +1,18 @@
 #include "Epatest.hpp"
 
 #include <vector>
+#include <map>
+#include <cstring>
+#include <cmath>
 
 #include "tree/Tree.hpp"
 #include "io/Binary.hpp"
 #include "io/file_io.hpp"
 #include "io/msa_reader.hpp"
+#include "io/clv_encoding.hpp"
+#include "tree/Tiny_Tree.hpp"
+#include "core/Lookup_Store.hpp"
+#include "core/place.hpp"
 #include "util/Options.hpp"
 #include "core/raxml/Model.hpp"
 
@@ -257,3 +264,250 @@ TEST(Binary, read)
 {
   all_combinations(read_);
 }
+
+// reads the dump exclusively through the pll-modules readers, to ensure the blocks
+// written at precomputed offsets follow their random access format
+static void pllmod_round_trip_(Options options)
+{
+  // setup
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), options.premasking);
+  raxml::Model model;
+  Tree original_tree(env->tree_file, msa, model, options);
+  dump_to_binary(original_tree, env->binary_file);
+
+  auto part = original_tree.partition();
+  const auto num_tips = part->tips;
+  const bool use_tipchars = part->attributes & PLL_ATTRIB_PATTERN_TIP;
+
+  // test
+  pll_binary_header_t header;
+  auto fptr = pllmod_binary_open(env->binary_file.c_str(), &header);
+  ASSERT_TRUE(fptr != nullptr);
+  Binary::file_ptr_type file_guard(fptr, safe_fclose);
+
+  EXPECT_EQ(header.access_type, PLLMOD_BIN_ACCESS_RANDOM);
+  EXPECT_EQ(header.n_blocks, header.max_blocks);
+
+  unsigned int n_blocks = 0;
+  auto block_map = pllmod_binary_get_map(fptr, &n_blocks);
+  ASSERT_TRUE(block_map != nullptr);
+  EXPECT_EQ(n_blocks, header.n_blocks);
+
+  std::map<int, long> offsets;
+  for (size_t i = 0; i < n_blocks; ++i) {
+    offsets[block_map[i].block_id] = block_map[i].block_offset;
+  }
+  free(block_map);
+
+  const size_t num_clv_ids = num_tips + part->clv_buffers;
+  for (int id = 0; id < static_cast<int>(num_clv_ids + part->scale_buffers); ++id) {
+    ASSERT_EQ(offsets.count(id), 1u);
+  }
+
+  unsigned int attributes = PLLMOD_BIN_ATTRIB_PARTITION_LOAD_SKELETON;
+  auto read_part = pllmod_binary_partition_load(fptr, 0, nullptr, &attributes, offsets.at(-1));
+  ASSERT_TRUE(read_part != nullptr);
+  if (read_part->attributes & PLL_ATTRIB_SITE_REPEATS) {
+    ASSERT_EQ(pllmod_binary_repeats_load(fptr, 0, read_part, &attributes, offsets.at(-3)), PLL_SUCCESS);
+  }
+
+  for (size_t clv_index = 0; clv_index < num_clv_ids; ++clv_index) {
+    if (use_tipchars and clv_index < num_tips) {
+      size_t size = 0;
+      unsigned int type = 0;
+      auto tipchars = static_cast<unsigned char*>(pllmod_binary_custom_load(
+        fptr, 0, &size, &type, &attributes, offsets.at(clv_index)));
+      ASSERT_TRUE(tipchars != nullptr);
+      ASSERT_EQ(size, part->sites * sizeof(unsigned char));
+      EXPECT_EQ(0, std::memcmp(tipchars, part->tipchars[clv_index], size));
+      free(tipchars);
+      continue;
+    }
+
+    const size_t clv_size = pll_get_clv_size(part, clv_index);
+    if (not read_part->clv[clv_index]) {
+      read_part->clv[clv_index] = static_cast<double*>(
+        pll_aligned_alloc(clv_size * sizeof(double), read_part->alignment));
+    }
+    ASSERT_EQ(pllmod_binary_clv_load(fptr, 0, read_part, clv_index, &attributes, offsets.at(clv_index)),
+              PLL_SUCCESS);
+    for (size_t i = 0; i < clv_size; ++i) {
+      EXPECT_DOUBLE_EQ(part->clv[clv_index][i], read_part->clv[clv_index][i]);
+    }
+  }
+
+  for (size_t scaler_index = 0; scaler_index < part->scale_buffers; ++scaler_index) {
+    size_t size = 0;
+    unsigned int type = 0;
+    auto scaler = static_cast<unsigned int*>(pllmod_binary_custom_load(
+      fptr, 0, &size, &type, &attributes, offsets.at(num_clv_ids + scaler_index)));
+    ASSERT_TRUE(scaler != nullptr);
+    if (part->scale_buffer[scaler_index]) {
+      EXPECT_EQ(0, std::memcmp(scaler, part->scale_buffer[scaler_index], size));
+    }
+    free(scaler);
+  }
+
+  pll_partition_destroy(read_part);
+}
+
+TEST(Binary, pllmod_round_trip)
+{
+  all_combinations(pllmod_round_trip_);
+}
+
+static void reduced_precision_(const Options::ClvPrecision precision)
+{
+  // setup
+  Options options;
+  options.binary_precision = precision;
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), options.premasking);
+  auto queries = build_MSA_from_file(env->query_file, MSA_Info(env->query_file), options.premasking);
+  raxml::Model model;
+
+  Tree original_tree(env->tree_file, msa, model, options);
+  dump_to_binary(original_tree, env->binary_file);
+  Tree read_tree(env->binary_file, model, options);
+
+  // the per-value error bound does not carry over to log-likelihoods, so this tolerance
+  // per site is empirical, not derived from clv_precision_epsilon
+  const auto sites = original_tree.partition()->sites;
+  const double bound = sites * (precision == Options::ClvPrecision::kFloat ? 1e-6 : 2e-4);
+
+  EXPECT_NEAR(original_tree.ref_tree_logl(), read_tree.ref_tree_logl(), bound);
+
+  // the error measured at dump time is exactly what a reader of the file sees
+  double ref_delta = -1.0;
+  const auto logl_delta = reduced_precision_logl_error(original_tree, precision, ref_delta);
+  EXPECT_GE(ref_delta, 0.0);
+  EXPECT_LE(ref_delta, logl_delta);
+  EXPECT_LE(logl_delta, bound);
+  EXPECT_NEAR(std::fabs(original_tree.ref_tree_logl() - read_tree.ref_tree_logl()), ref_delta, 1e-9);
+
+  const auto num_branches = original_tree.nums().branches;
+  std::vector<pll_unode_t *> original_branches(num_branches);
+  std::vector<pll_unode_t *> read_branches(num_branches);
+  utree_query_branches(original_tree.tree(), &original_branches[0]);
+  utree_query_branches(read_tree.tree(), &read_branches[0]);
+
+  auto original_lookups = std::make_shared<Lookup_Store>(num_branches, original_tree.partition()->states);
+  auto read_lookups = std::make_shared<Lookup_Store>(num_branches, read_tree.partition()->states);
+
+  for (size_t branch_id = 0; branch_id < num_branches; ++branch_id) {
+    Tiny_Tree original_branch(original_branches[branch_id], branch_id, original_tree, false, options, original_lookups);
+    Tiny_Tree read_branch(read_branches[branch_id], branch_id, read_tree, false, options, read_lookups);
+
+    for (auto const& query : queries) {
+      EXPECT_NEAR(original_branch.place(query).likelihood(), read_branch.place(query).likelihood(), bound);
+    }
+  }
+}
+
+static void zero_copy_(Options options)
+{
+  // setup
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), options.premasking);
+  raxml::Model model;
+  Tree original_tree(env->tree_file, msa, model, options);
+  dump_to_binary(original_tree, env->binary_file);
+
+  // test: a fresh dump is laid out such that all CLVs and scalers load straight from the mapping
+  Binary bin(env->binary_file);
+  auto part = bin.load_partition();
+  ASSERT_TRUE(part != nullptr);
+
+  const size_t num_tips = part->tips;
+  const size_t first_clv = (part->attributes & PLL_ATTRIB_PATTERN_TIP) ? num_tips : 0;
+  for (size_t clv_index = first_clv; clv_index < num_tips + part->clv_buffers; ++clv_index) {
+    bin.load_clv(part, clv_index);
+    EXPECT_TRUE(bin.is_mapped(part->clv[clv_index]));
+  }
+  for (size_t scaler_index = 0; scaler_index < part->scale_buffers; ++scaler_index) {
+    bin.load_scaler(part, scaler_index);
+    EXPECT_TRUE(bin.is_mapped(part->scale_buffer[scaler_index]));
+  }
+
+  bin.release(part);
+  pll_partition_destroy(part);
+}
+
+TEST(Binary, zero_copy)
+{
+  all_combinations(zero_copy_);
+}
+
+TEST(Binary, reduced_precision)
+{
+  reduced_precision_(Options::ClvPrecision::kFloat);
+  reduced_precision_(Options::ClvPrecision::kScaled16);
+}
+
+TEST(Binary, snapshot)
+{
+  // setup
+  Options options;
+  MSA_Info ref_info(env->reference_file);
+  auto msa = build_MSA_from_file(env->reference_file, ref_info, options.premasking);
+  raxml::Model model;
+
+  Tree original_tree(env->tree_file, msa, model, options);
+  auto original_lookups = build_lookup_store(original_tree, options);
+  dump_snapshot(original_tree, *original_lookups, ref_info.gap_mask(), env->binary_file);
+
+  Tree read_tree(env->binary_file, model, options);
+
+  // tests
+  ASSERT_TRUE(read_tree.binary().is_snapshot());
+  EXPECT_DOUBLE_EQ(original_tree.ref_tree_logl(), read_tree.ref_tree_logl());
+  EXPECT_EQ(original_tree.mapper().map(), read_tree.mapper().map());
+  EXPECT_EQ(original_tree.mapper().root_label(), read_tree.mapper().root_label());
+  EXPECT_TRUE(read_tree.binary().load_gap_mask() == ref_info.gap_mask());
+
+  const auto num_branches = original_tree.nums().branches;
+  Lookup_Store read_lookups(num_branches, read_tree.partition()->states);
+  read_tree.binary().load_lookups(read_lookups);
+
+  const size_t size = read_tree.partition()->sites * read_lookups.char_map_size();
+  for (size_t branch_id = 0; branch_id < num_branches; ++branch_id) {
+    ASSERT_TRUE(read_lookups.has_branch(branch_id));
+    auto original = original_lookups->branch_data(branch_id);
+    auto read = read_lookups.branch_data(branch_id);
+    for (size_t i = 0; i < size; ++i) {
+      EXPECT_DOUBLE_EQ(original[i], read[i]);
+    }
+  }
+
+  // a plain binary file is not a snapshot
+  dump_to_binary(original_tree, env->binary_file);
+  Tree plain_tree(env->binary_file, model, options);
+  EXPECT_FALSE(plain_tree.binary().is_snapshot());
+}
+
+TEST(Binary, clv_encoding)
+{
+  // values spanning many orders of magnitude per site, as on deep trees
+  const size_t span = 8;
+  std::vector<double> clv;
+  for (size_t site = 0; site < 16; ++site) {
+    for (size_t i = 0; i < span; ++i) {
+      clv.push_back(std::ldexp(0.1 + i * 0.1, -static_cast<int>(site * 60)));
+    }
+  }
+
+  for (auto precision : {Options::ClvPrecision::kFloat, Options::ClvPrecision::kScaled16}) {
+    double max_error = 0.0;
+    auto block = encode_clv(clv.data(), clv.size(), span, precision, max_error);
+    EXPECT_LE(max_error, clv_precision_epsilon(precision));
+
+    std::vector<double> decoded(clv.size());
+    decode_clv(block.data(), block.size(), decoded.data(), decoded.size());
+
+    for (size_t site = 0; site < clv.size() / span; ++site) {
+      const auto site_max = clv[site * span + span - 1];
+      for (size_t i = 0; i < span; ++i) {
+        EXPECT_NEAR(clv[site * span + i], decoded[site * span + i],
+                    clv_precision_epsilon(precision) * site_max);
+      }
+    }
+  }
+}
@@ -6,6 +6,8 @@
 
 #include "genesis/utils/core/options.hpp"
 
+#include <fstream>
+
 static void compare_msas(const MSA& lhs, const MSA& rhs)
 {
   ASSERT_EQ(lhs.size(), rhs.size());
@@ -32,6 +34,26 @@ TEST(Binary_Fasta, 4bit_store_and_load)
   compare_msas(msa, read_msa);
 }
 
+TEST(Binary_Fasta, 4bit_version_1)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->combined_file);
+  const std::string binfile_name(orig_file + ".bin");
+
+  auto msa = build_MSA_from_file(orig_file, MSA_Info(env->combined_file));
+
+  // files of the former version remain readable
+  Binary_Fasta::save(msa, binfile_name, 1);
+  EXPECT_EQ(1u, Binary_Fasta_Map(binfile_name).version());
+
+  auto read_msa = Binary_Fasta::load(binfile_name, false);
+
+  compare_msas(msa, read_msa);
+
+  EXPECT_ANY_THROW(Binary_Fasta::save(msa, binfile_name, BFAST_VERSION + 1));
+}
+
 TEST(Binary_Fasta, reader)
 {
   genesis::utils::Options::get().allow_file_overwriting(true);
@@ -66,3 +88,90 @@ TEST(Binary_Fasta, reader)
 
   }
 }
+
+TEST(Binary_Fasta, map)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->combined_file);
+  const std::string binfile_name(orig_file + ".bin");
+
+  MSA_Info info(env->combined_file);
+
+  auto msa = build_MSA_from_file(orig_file, info);
+
+  Binary_Fasta::save(msa, binfile_name);
+
+  Binary_Fasta_Map map(binfile_name);
+
+  ASSERT_EQ(msa.size(), map.size());
+
+  ASSERT_EQ(BFAST_VERSION, map.version());
+
+  TwoBit code;
+  // access out of order, straight from the mapping
+  for (size_t i = map.size(); i-- > 0; ) {
+    const auto record = map.record(i);
+    EXPECT_EQ(msa[i].header(), record.label_string());
+    EXPECT_EQ(msa[i].sequence(), code.from_twobit(record.packed, record.packed_size, record.sites));
+  }
+
+  EXPECT_ANY_THROW(map.record(map.size()));
+
+  // skipping only moves the read position
+  Binary_Fasta_Reader reader(binfile_name, info);
+  const size_t skip = msa.size() / 2;
+  reader.skip_to_sequence(skip);
+
+  MSA read_msa;
+  ASSERT_EQ(msa.size() - skip, reader.read_next(read_msa, msa.size()));
+  for (size_t k = 0; k < read_msa.size(); ++k) {
+    EXPECT_EQ(msa[skip + k].header(), read_msa[k].header());
+    EXPECT_EQ(msa[skip + k].sequence(), read_msa[k].sequence());
+  }
+  EXPECT_EQ(0u, reader.read_next(read_msa, msa.size()));
+}
+
+TEST(Binary_Fasta, amino_acids)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->data_dir + "AA_query.fasta");
+
+  MSA_Info info(orig_file);
+  auto msa = build_MSA_from_file(orig_file, info);
+
+  // the data type is detected from the sequences
+  const auto binfile_name = Binary_Fasta::fasta_to_bfast(orig_file, env->out_dir);
+  ASSERT_EQ(BFAST_AA_VERSION, Binary_Fasta_Map(binfile_name).version());
+
+  const auto bin_info = Binary_Fasta::get_info(binfile_name);
+  EXPECT_EQ(info.sequences(), bin_info.sequences());
+
+  Binary_Fasta_Reader reader(binfile_name, bin_info);
+  MSA read_msa;
+  reader.read_next(read_msa, msa.size());
+
+  compare_msas(msa, read_msa);
+}
+
+TEST(Binary_Fasta, amino_acids_after_nucleotides)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  // the first sequence alone looks like nucleotides
+  const std::string orig_file(env->out_dir + "mixed_query.fasta");
+  std::ofstream(orig_file) << ">a\nACGT-A\n>b\nMKL-WE\n>c\nAC--TA\n";
+
+  MSA_Info info(orig_file);
+  auto msa = build_MSA_from_file(orig_file, info);
+
+  const auto binfile_name = Binary_Fasta::fasta_to_bfast(orig_file, env->out_dir);
+  ASSERT_EQ(BFAST_AA_VERSION, Binary_Fasta_Map(binfile_name).version());
+  compare_msas(msa, Binary_Fasta::load(binfile_name));
+
+  const std::string saved_name(env->out_dir + "mixed_saved.bfast");
+  Binary_Fasta::save(msa, saved_name);
+  ASSERT_EQ(BFAST_AA_VERSION, Binary_Fasta_Map(saved_name).version());
+  compare_msas(msa, Binary_Fasta::load(saved_name));
+}
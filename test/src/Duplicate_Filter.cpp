@@ -0,0 +1,118 @@
+#include "Epatest.hpp"
+
+#include "seq/Duplicate_Filter.hpp"
+#include "seq/MSA.hpp"
+#include "sample/Sample.hpp"
+#include "sample/Placement.hpp"
+
+#include <string>
+
+using namespace std;
+
+// stand-in for the placement: one placement per sequence, on the branch of its first character
+static Sample<Placement> fake_place(const MSA& chunk)
+{
+  Sample<Placement> sample;
+  for (size_t i = 0; i < chunk.size(); ++i) {
+    sample.add_pquery(i, chunk[i].header());
+    sample.back().emplace_back(chunk[i].sequence()[0], -1.0, 0.1, 0.1);
+  }
+  return sample;
+}
+
+TEST(Duplicate_Filter, filter_and_expand)
+{
+  // setup
+  Duplicate_Filter duplicates;
+
+  MSA first_chunk;
+  first_chunk.append("a", "ACGT");
+  first_chunk.append("b", "CCGT");
+  first_chunk.append("c", "ACGT");
+  first_chunk.append("d", "ACGT");
+
+  MSA second_chunk;
+  second_chunk.append("e", "GCGT");
+  second_chunk.append("f", "CCGT");
+  second_chunk.append("g", "GCGT");
+
+  // tests
+  duplicates.filter(first_chunk);
+  ASSERT_EQ(first_chunk.size(), 2u);
+
+  auto sample = fake_place(first_chunk);
+  duplicates.expand(sample, first_chunk, 0);
+
+  ASSERT_EQ(sample.size(), 2u);
+  EXPECT_EQ(sample[0].header(), "a");
+  EXPECT_EQ(sample[0].sequence_id(), 0u);
+  ASSERT_EQ(sample[0].duplicate_headers().size(), 2u);
+  EXPECT_EQ(sample[0].duplicate_headers()[0], "c");
+  EXPECT_EQ(sample[0].duplicate_headers()[1], "d");
+  EXPECT_EQ(sample[1].header(), "b");
+  EXPECT_EQ(sample[1].sequence_id(), 1u);
+  EXPECT_TRUE(sample[1].duplicate_headers().empty());
+
+  duplicates.filter(second_chunk);
+  ASSERT_EQ(second_chunk.size(), 1u);
+
+  sample = fake_place(second_chunk);
+  duplicates.expand(sample, second_chunk, 4);
+
+  ASSERT_EQ(sample.size(), 2u);
+  EXPECT_EQ(sample[0].header(), "e");
+  EXPECT_EQ(sample[0].sequence_id(), 4u);
+  ASSERT_EQ(sample[0].duplicate_headers().size(), 1u);
+  EXPECT_EQ(sample[0].duplicate_headers()[0], "g");
+
+  // duplicate of a sequence placed in the first chunk
+  EXPECT_EQ(sample[1].header(), "f");
+  EXPECT_EQ(sample[1].sequence_id(), 5u);
+  ASSERT_EQ(sample[1].size(), 1u);
+  EXPECT_EQ(sample[1][0].branch_id(), static_cast<size_t>('C'));
+
+  EXPECT_EQ(duplicates.num_unique(), 3u);
+  EXPECT_EQ(duplicates.num_duplicates(), 4u);
+
+  // teardown
+}
+
+TEST(Duplicate_Filter, memory_limit)
+{
+  // setup: a limit so small that only the latest placed sequence is remembered
+  Duplicate_Filter duplicates(1);
+
+  MSA first_chunk;
+  first_chunk.append("a", "ACGT");
+  first_chunk.append("b", "CCGT");
+
+  MSA second_chunk;
+  second_chunk.append("c", "ACGT");
+  second_chunk.append("d", "CCGT");
+
+  // tests
+  duplicates.filter(first_chunk);
+  auto sample = fake_place(first_chunk);
+  duplicates.expand(sample, first_chunk, 0);
+  EXPECT_EQ(duplicates.num_forgotten(), 1u);
+
+  // "c" was forgotten and has to be placed again, "d" is a duplicate of "b"
+  duplicates.filter(second_chunk);
+  ASSERT_EQ(second_chunk.size(), 1u);
+  EXPECT_EQ(second_chunk[0].header(), "c");
+
+  sample = fake_place(second_chunk);
+  duplicates.expand(sample, second_chunk, 2);
+
+  ASSERT_EQ(sample.size(), 2u);
+  EXPECT_EQ(sample[0].header(), "c");
+  EXPECT_EQ(sample[0].sequence_id(), 2u);
+  EXPECT_EQ(sample[1].header(), "d");
+  EXPECT_EQ(sample[1].sequence_id(), 3u);
+  ASSERT_EQ(sample[1].size(), 1u);
+  EXPECT_EQ(sample[1][0].branch_id(), static_cast<size_t>('C'));
+
+  EXPECT_EQ(duplicates.num_unique(), 3u);
+  EXPECT_EQ(duplicates.num_duplicates(), 1u);
+  EXPECT_EQ(duplicates.num_forgotten(), 2u);
+}
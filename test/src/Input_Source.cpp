@@ -0,0 +1,83 @@
+#include "Epatest.hpp"
+
+#include "io/Input_Source.hpp"
+#include "io/file_io.hpp"
+#include "seq/MSA_Stream.hpp"
+#include "seq/MSA_Info.hpp"
+#include "seq/MSA.hpp"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#ifdef __ZLIB
+#include <zlib.h>
+#endif
+
+using namespace std;
+
+TEST(Input_Source, plain)
+{
+  // setup
+  stringstream content;
+  content << ifstream(env->query_file).rdbuf();
+
+  // tests
+  EXPECT_EQ(Input_Source::detect(env->query_file), Input_Source::Format::kPlain);
+
+  Input_Source source(env->query_file, 100);
+  string read(content.str().size() + 10, ' ');
+  const auto num_read = source.read(&read[0], read.size());
+  read.resize(num_read);
+  EXPECT_EQ(read, content.str());
+  EXPECT_EQ(source.read(&read[0], read.size()), 0u);
+}
+
+#ifdef __ZLIB
+TEST(Input_Source, gzip)
+{
+  // setup
+  stringstream content;
+  content << ifstream(env->query_file).rdbuf();
+  const auto text = content.str();
+
+  // two gzip members, like bgzf produces them
+  const string gz_file = env->out_dir + "query.fasta.gz";
+  for (const auto mode : {"wb", "ab"}) {
+    auto file = gzopen(gz_file.c_str(), mode);
+    ASSERT_TRUE(file);
+    const auto half = text.size() / 2;
+    const auto part = (mode[0] == 'w') ? text.substr(0, half) : text.substr(half);
+    gzwrite(file, part.data(), part.size());
+    gzclose(file);
+  }
+
+  // tests
+  EXPECT_EQ(Input_Source::detect(gz_file), Input_Source::Format::kGzip);
+
+  Input_Source source(gz_file, 100);
+  string read(text.size() + 10, ' ');
+  read.resize(source.read(&read[0], read.size()));
+  EXPECT_EQ(read, text);
+
+  // query info and streaming work on the compressed file directly
+  auto info = make_msa_info(env->query_file);
+  auto gz_info = make_msa_info(gz_file);
+  EXPECT_EQ(gz_info.sequences(), info.sequences());
+  EXPECT_EQ(gz_info.sites(), info.sites());
+  EXPECT_TRUE(gz_info.gap_mask() == info.gap_mask());
+
+  MSA plain_msa;
+  MSA gz_msa;
+  MSA_Stream plain_stream(env->query_file, info, true);
+  MSA_Stream gz_stream(gz_file, gz_info, true);
+  while (plain_stream.read_next(plain_msa, 3)) {
+    ASSERT_EQ(gz_stream.read_next(gz_msa, 3), plain_msa.size());
+    for (size_t i = 0; i < plain_msa.size(); ++i) {
+      EXPECT_EQ(gz_msa[i].header(), plain_msa[i].header());
+      EXPECT_EQ(gz_msa[i].sequence(), plain_msa[i].sequence());
+    }
+  }
+  EXPECT_EQ(gz_stream.read_next(gz_msa, 3), 0u);
+}
+#endif
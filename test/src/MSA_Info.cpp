@@ -0,0 +1,76 @@
+#include "Epatest.hpp"
+
+#include "seq/MSA_Info.hpp"
+
+#include <string>
+#include <fstream>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+TEST(MSA_Info, sidecar)
+{
+  // setup
+  const string file_name = env->out_dir + "sidecar.fasta";
+  const string sidecar = info_sidecar_path(file_name);
+  ofstream(file_name) << ">a\nAC-T\n>b\nAG-T\n>c\nA--T\n";
+  remove(sidecar.c_str());
+
+  // tests
+  auto scanned = make_msa_info(file_name, true);
+  EXPECT_EQ(scanned.sequences(), 3u);
+  EXPECT_EQ(scanned.sites(), 4u);
+  EXPECT_EQ(scanned.gap_count(), 1u);
+  ASSERT_TRUE(ifstream(sidecar).good());
+
+  auto loaded = make_msa_info(file_name, true);
+  EXPECT_EQ(loaded.sequences(), scanned.sequences());
+  EXPECT_EQ(loaded.sites(), scanned.sites());
+  EXPECT_TRUE(loaded.gap_mask() == scanned.gap_mask());
+
+  // the sidecar is used instead of reading the file: alter its sequence count
+  string magic, version, size, mtime, sequences, sites, mask;
+  ifstream(sidecar) >> magic >> version >> size >> mtime >> sequences >> sites >> mask;
+  ofstream(sidecar) << magic << " " << version << "\n"
+                    << size << " " << mtime << " 42 " << sites << "\n"
+                    << mask << "\n";
+  EXPECT_EQ(make_msa_info(file_name, true).sequences(), 42u);
+
+  // but not without being asked to
+  EXPECT_EQ(make_msa_info(file_name).sequences(), 3u);
+
+  // teardown
+  remove(sidecar.c_str());
+}
+
+TEST(MSA_Info, sidecar_subsecond_change)
+{
+  // setup
+  const string file_name = env->out_dir + "sidecar_change.fasta";
+  const string sidecar = info_sidecar_path(file_name);
+  remove(sidecar.c_str());
+
+  // sets the modification time of the file to the given nanoseconds past a fixed second
+  auto touch = [&file_name](const long nanoseconds) {
+    struct timespec times[2];
+    times[0].tv_sec = times[1].tv_sec = 1500000000;
+    times[0].tv_nsec = times[1].tv_nsec = nanoseconds;
+    ASSERT_EQ(utimensat(AT_FDCWD, file_name.c_str(), times, 0), 0);
+  };
+
+  // tests
+  ofstream(file_name) << ">a\nAC-T\n>b\nAG-T\n";
+  touch(1);
+  EXPECT_EQ(make_msa_info(file_name, true).gap_count(), 1u);
+
+  // same size, same second
+  ofstream(file_name) << ">a\nACGT\n>b\nAGGT\n";
+  touch(2);
+  EXPECT_EQ(make_msa_info(file_name, true).gap_count(), 0u);
+
+  // teardown
+  remove(sidecar.c_str());
+}
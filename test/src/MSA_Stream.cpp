@@ -4,8 +4,10 @@
 #include "seq/MSA.hpp"
 #include "seq/MSA_Info.hpp"
 #include "io/file_io.hpp"
+#include "io/Fasta_Chunk_Reader.hpp"
 
 #include <string>
+#include <fstream>
 
 using namespace std;
 
@@ -45,4 +47,158 @@ TEST(MSA_Stream, reading_masked)
     EXPECT_EQ(complete_msa[i], read_msa[i % chunk_size]);
   }
   MSA_Stream dummy;
-}
\ No newline at end of file
+}
+
+TEST(MSA_Stream, read_ahead)
+{
+  MSA_Info info(env->combined_file);
+  MSA complete_msa = build_MSA_from_file(env->combined_file, info, false);
+  const size_t chunk_size = 2;
+  MSA read_msa;
+  MSA_Stream streamed_msa(env->combined_file, info, false, false, 3);
+
+  size_t i = 0;
+  size_t num_read = 0;
+  // the chunks are passed back in, to be recycled
+  while ((num_read = streamed_msa.read_next(read_msa, chunk_size)) != 0) {
+    ASSERT_EQ(num_read, read_msa.size());
+    for (size_t k = 0; k < num_read; ++k) {
+      EXPECT_EQ(complete_msa[i + k], read_msa[k]);
+      EXPECT_EQ(complete_msa[i + k].header(), read_msa[k].header());
+    }
+    i += num_read;
+  }
+  EXPECT_EQ(complete_msa.size(), i);
+  EXPECT_EQ(0u, streamed_msa.read_next(read_msa, chunk_size));
+
+  const auto stats = streamed_msa.stats();
+  EXPECT_EQ((complete_msa.size() + chunk_size - 1) / chunk_size, stats.chunks);
+  EXPECT_LE(stats.stalls, stats.chunks + 2);
+}
+
+TEST(MSA_Stream, skip_to_sequence)
+{
+  MSA_Info info(env->combined_file);
+  MSA complete_msa = build_MSA_from_file(env->combined_file, info, false);
+  const size_t skip = 4;
+  MSA read_msa;
+  MSA_Stream streamed_msa(env->combined_file, info, false);
+
+  streamed_msa.skip_to_sequence(skip);
+  auto num_read = streamed_msa.read_next(read_msa, complete_msa.size());
+
+  ASSERT_EQ(num_read, complete_msa.size() - skip);
+  for (size_t i = 0; i < read_msa.size(); i++)
+  {
+    EXPECT_EQ(complete_msa[i + skip], read_msa[i]);
+  }
+
+  EXPECT_THROW(streamed_msa.skip_to_sequence(complete_msa.size()), std::runtime_error);
+}
+
+TEST(MSA_Stream, fasta_chunk_reader)
+{
+  MSA_Info info(env->combined_file);
+  MSA complete_msa = build_MSA_from_file(env->combined_file, info, false);
+  const size_t chunk_size = 5;
+  MSA read_msa;
+  // tiny blocks, such that records span several of them
+  Fasta_Chunk_Reader reader(env->combined_file, 64);
+
+  size_t num_read = 0;
+  while (reader.read(read_msa, chunk_size, MSA_Info::mask_type())) {
+    for (size_t i = 0; i < read_msa.size(); ++i) {
+      EXPECT_EQ(complete_msa[num_read + i].header(), read_msa[i].header());
+      EXPECT_EQ(complete_msa[num_read + i], read_msa[i]);
+    }
+    num_read += read_msa.size();
+  }
+  EXPECT_EQ(num_read, complete_msa.size());
+}
+
+TEST(MSA_Stream, fasta_chunk_reader_format)
+{
+  const string file_name = env->out_dir + "chunk_reader.fasta";
+  ofstream(file_name) << "\n>a x\r\nac-g\r\nTT\r\n>b\nACGTAA\n\n>c\nAC\nGTNN";
+
+  Fasta_Chunk_Reader reader(file_name, 4);
+  MSA read_msa;
+
+  ASSERT_EQ(reader.read(read_msa, 10, MSA_Info::mask_type()), 3u);
+  EXPECT_EQ(read_msa.num_sites(), 6u);
+  EXPECT_EQ(read_msa[0].header(), "a x");
+  EXPECT_EQ(read_msa[0].sequence(), "AC-GTT");
+  EXPECT_EQ(read_msa[1].header(), "b");
+  EXPECT_EQ(read_msa[1].sequence(), "ACGTAA");
+  EXPECT_EQ(read_msa[2].header(), "c");
+  EXPECT_EQ(read_msa[2].sequence(), "ACGTNN");
+
+  EXPECT_EQ(reader.read(read_msa, 10, MSA_Info::mask_type()), 0u);
+
+  Fasta_Chunk_Reader skipping(file_name, 4);
+  EXPECT_EQ(skipping.skip(2), 2u);
+  ASSERT_EQ(skipping.read(read_msa, 10, MSA_Info::mask_type(), 6), 1u);
+  EXPECT_EQ(read_msa[0].header(), "c");
+}
+
+TEST(MSA_Stream, fasta_chunk_reader_long_records)
+{
+  const string file_name = env->out_dir + "chunk_reader_long.fasta";
+  const string line(60, 'a');
+  {
+    ofstream file(file_name);
+    for (const auto header : {"a", "b", "c"}) {
+      file << ">" << header << "\n";
+      for (size_t i = 0; i < 100; ++i) {
+        file << line << "\n";
+      }
+    }
+  }
+
+  // every record spans hundreds of blocks, and the second one starts right after the end of one
+  Fasta_Chunk_Reader reader(file_name, 17);
+  reader.parallel(false);
+  MSA read_msa;
+
+  ASSERT_EQ(reader.read(read_msa, 2, MSA_Info::mask_type()), 2u);
+  EXPECT_EQ(read_msa[0].header(), "a");
+  EXPECT_EQ(read_msa[0].sequence(), string(6000, 'A'));
+  EXPECT_EQ(read_msa[1].header(), "b");
+  ASSERT_EQ(reader.read(read_msa, 2, MSA_Info::mask_type()), 1u);
+  EXPECT_EQ(read_msa[0].header(), "c");
+  EXPECT_EQ(read_msa[0].sequence(), string(6000, 'A'));
+}
+
+TEST(MSA_Stream, chunk_storage)
+{
+  const string file_name = env->out_dir + "chunk_storage.fasta";
+  ofstream(file_name) << ">a\nACGTA\n>b\nCCGTA\n>c\nGCGTA\n>d\nTCGTA\n";
+
+  Fasta_Chunk_Reader reader(file_name);
+  MSA read_msa;
+
+  // the rows are laid out one after the other, each followed by a NUL
+  ASSERT_EQ(reader.read(read_msa, 3, MSA_Info::mask_type()), 3u);
+  const auto first_row = read_msa[0].sequence().data();
+  for (size_t i = 0; i < read_msa.size(); ++i) {
+    EXPECT_EQ(read_msa[i].sequence().data(), first_row + i * (read_msa.num_sites() + 1));
+    EXPECT_EQ(read_msa[i].sequence().c_str()[read_msa.num_sites()], '\0');
+  }
+
+  // the next chunk is read into the same storage
+  ASSERT_EQ(reader.read(read_msa, 3, MSA_Info::mask_type()), 1u);
+  EXPECT_EQ(read_msa[0].header(), "d");
+  EXPECT_EQ(read_msa[0].sequence(), "TCGTA");
+  EXPECT_EQ(read_msa[0].sequence().data(), first_row);
+
+  // the views held by the MSA stay valid as its storage grows
+  MSA grown;
+  for (size_t i = 0; i < 1000; ++i) {
+    grown.append(to_string(i), "ACGTA");
+  }
+  grown.append(grown[7].header(), grown[8].sequence());
+  EXPECT_EQ(grown[0].header(), "0");
+  EXPECT_EQ(grown[999].header(), "999");
+  EXPECT_EQ(grown[999].sequence(), "ACGTA");
+  EXPECT_EQ(grown[1000].header(), "7");
+}
@@ -0,0 +1,120 @@
+#include "Epatest.hpp"
+
+#include "io/Placement_Cache.hpp"
+#include "seq/MSA.hpp"
+#include "seq/sequence_hash.hpp"
+#include "sample/Sample.hpp"
+#include "sample/Placement.hpp"
+
+#include <string>
+#include <cstdio>
+
+#include "genesis/utils/core/fs.hpp"
+
+using namespace std;
+
+// stand-in for the placement: one placement per sequence, on the branch of its first character
+static Sample<Placement> fake_place(const MSA& chunk)
+{
+  Sample<Placement> sample;
+  for (size_t i = 0; i < chunk.size(); ++i) {
+    sample.add_pquery(i, chunk[i].header());
+    sample.back().emplace_back(chunk[i].sequence()[0], -1.0, 0.1, 0.2);
+    sample.back().back().lwr(0.5);
+  }
+  return sample;
+}
+
+TEST(Placement_Cache, filter_and_expand)
+{
+  // setup
+  const string cache_dir = env->out_dir + "placement_cache/";
+  genesis::utils::dir_create(cache_dir);
+  for (const auto& file : genesis::utils::dir_list_files(cache_dir)) {
+    std::remove((cache_dir + file).c_str());
+  }
+
+  MSA first_chunk;
+  first_chunk.append("a", "ACGT");
+  first_chunk.append("b", "CCGT");
+
+  MSA second_chunk;
+  second_chunk.append("c", "GCGT");
+  second_chunk.append("d", "CCGT");
+
+  // tests
+  {
+    Placement_Cache cache(cache_dir, "reference one");
+    EXPECT_EQ(cache.size(), 0u);
+
+    cache.filter(first_chunk);
+    ASSERT_EQ(first_chunk.size(), 2u);
+
+    auto sample = fake_place(first_chunk);
+    cache.expand(sample, 0);
+    ASSERT_EQ(sample.size(), 2u);
+    EXPECT_EQ(cache.size(), 2u);
+
+    cache.filter(second_chunk);
+    ASSERT_EQ(second_chunk.size(), 1u);
+    EXPECT_EQ(second_chunk[0].header(), "c");
+
+    sample = fake_place(second_chunk);
+    cache.expand(sample, 2);
+    ASSERT_EQ(sample.size(), 2u);
+    EXPECT_EQ(sample[0].header(), "c");
+    EXPECT_EQ(sample[0].sequence_id(), 2u);
+    EXPECT_EQ(sample[1].header(), "d");
+    EXPECT_EQ(sample[1].sequence_id(), 3u);
+    ASSERT_EQ(sample[1].size(), 1u);
+    EXPECT_EQ(sample[1][0].branch_id(), static_cast<size_t>('C'));
+
+    EXPECT_EQ(cache.hits(), 1u);
+    EXPECT_EQ(cache.misses(), 3u);
+  }
+
+  // results persist across runs with the same context
+  {
+    Placement_Cache cache(cache_dir, "reference one");
+    EXPECT_EQ(cache.size(), 3u);
+
+    MSA chunk;
+    chunk.append("e", "ACGT");
+    chunk.append("f", "TTTT");
+    cache.filter(chunk);
+    ASSERT_EQ(chunk.size(), 1u);
+
+    auto sample = fake_place(chunk);
+    cache.expand(sample, 0);
+    ASSERT_EQ(sample.size(), 2u);
+    EXPECT_EQ(sample[0].header(), "f");
+    EXPECT_EQ(sample[0].sequence_id(), 1u);
+    EXPECT_EQ(sample[1].header(), "e");
+    EXPECT_EQ(sample[1].sequence_id(), 0u);
+    ASSERT_EQ(sample[1].size(), 1u);
+    EXPECT_EQ(sample[1][0].branch_id(), static_cast<size_t>('A'));
+    EXPECT_DOUBLE_EQ(sample[1][0].likelihood(), -1.0);
+    EXPECT_DOUBLE_EQ(sample[1][0].lwr(), 0.5);
+    EXPECT_DOUBLE_EQ(sample[1][0].pendant_length(), 0.1);
+    EXPECT_DOUBLE_EQ(sample[1][0].distal_length(), 0.2);
+  }
+
+  // but not for a different one
+  {
+    Placement_Cache cache(cache_dir, "reference two");
+    EXPECT_EQ(cache.size(), 0u);
+  }
+
+  // teardown
+}
+
+TEST(Placement_Cache, stable_hash)
+{
+  // the hashes are persisted, so they must never change: reference values of XXH64 and FNV-1a
+  EXPECT_EQ(hash_sequence(""), sequence_hash_type(0xef46db3751d8e999ull, 0xcbf29ce484222325ull));
+  EXPECT_EQ(hash_sequence("a"), sequence_hash_type(0xd24ec4f1a98c6e5bull, 0xaf63dc4c8601ec8cull));
+  EXPECT_EQ(hash_sequence("abc"), sequence_hash_type(0x44bc2cf5ad770999ull, 0xe71fa2190541574bull));
+  // longer than one stripe of XXH64
+  EXPECT_EQ(hash_sequence("0123456789abcdef0123456789abcdef0123456789"),
+            sequence_hash_type(0xa76190c3acf08a1cull, 0x0384eb2f557f1be2ull));
+}
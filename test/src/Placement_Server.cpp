@@ -0,0 +1,151 @@
+#include "Epatest.hpp"
+
+#include "net/Placement_Server.hpp"
+#include "core/Placer.hpp"
+#include "io/file_io.hpp"
+#include "tree/Tree.hpp"
+#include "seq/MSA.hpp"
+#include "seq/MSA_Info.hpp"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+static string request(const string& socket_path, const string& data)
+{
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+  int fd = -1;
+  // the server may still be starting up
+  for (size_t tries = 0; tries < 100; ++tries) {
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+    this_thread::sleep_for(chrono::milliseconds(50));
+  }
+  if (fd < 0) {
+    return "";
+  }
+
+  size_t sent = 0;
+  while (sent < data.size()) {
+    auto ret = send(fd, data.data() + sent, data.size() - sent, 0);
+    if (ret <= 0) {
+      break;
+    }
+    sent += ret;
+  }
+  shutdown(fd, SHUT_WR);
+
+  string response;
+  char buffer[4096];
+  ssize_t ret;
+  while ((ret = read(fd, buffer, sizeof(buffer))) > 0) {
+    response.append(buffer, ret);
+  }
+  close(fd);
+
+  return response;
+}
+
+static size_t count(const string& str, const string& pattern)
+{
+  size_t num = 0;
+  for (auto pos = str.find(pattern); pos != string::npos; pos = str.find(pattern, pos + 1)) {
+    ++num;
+  }
+  return num;
+}
+
+TEST(Placement_Server, serve)
+{
+  // setup
+  auto options = env->options;
+  options.chunk_size = 3;
+  MSA_Info ref_info(env->reference_file);
+  auto ref_msa = build_MSA_from_file(env->reference_file, ref_info, options.premasking);
+  Tree tree(env->tree_file, ref_msa, env->model, options);
+
+  ifstream query_stream(env->query_file);
+  stringstream queries;
+  queries << query_stream.rdbuf();
+  const auto num_queries = MSA_Info(env->query_file).sequences();
+
+  const string socket_path = env->out_dir + "epa_test.sock";
+
+  Placer placer(tree, ref_info.gap_mask(), options);
+  Placement_Server server(placer, "epa-ng --serve");
+  thread server_thread([&]{ server.serve(socket_path); });
+
+  // tests
+  // concurrent requests larger than the chunk size
+  string response_a;
+  string response_b;
+  thread client_a([&]{ response_a = request(socket_path, queries.str()); });
+  thread client_b([&]{ response_b = request(socket_path, queries.str()); });
+  client_a.join();
+  client_b.join();
+
+  for (auto const& response : {response_a, response_b}) {
+    EXPECT_NE(response.find("\"placements\""), string::npos);
+    EXPECT_NE(response.find("\"version\": 3"), string::npos);
+    EXPECT_EQ(count(response, "\"n\": ["), num_queries);
+  }
+
+  auto error_response = request(socket_path, ">bad\nACGT\n");
+  EXPECT_NE(error_response.find("\"error\""), string::npos);
+
+  // teardown
+  server.stop();
+  server_thread.join();
+}
+
+TEST(Placement_Server, request_size_limit)
+{
+  // setup
+  auto options = env->options;
+  MSA_Info ref_info(env->reference_file);
+  auto ref_msa = build_MSA_from_file(env->reference_file, ref_info, options.premasking);
+  Tree tree(env->tree_file, ref_msa, env->model, options);
+
+  ifstream query_stream(env->query_file);
+  stringstream queries;
+  queries << query_stream.rdbuf();
+
+  const string socket_path = env->out_dir + "epa_test_limit.sock";
+
+  Placer placer(tree, ref_info.gap_mask(), options);
+  Placement_Server server(placer, "epa-ng --serve", queries.str().size() - 1);
+  thread server_thread([&]{ server.serve(socket_path); });
+
+  // tests
+  auto response = request(socket_path, queries.str());
+  EXPECT_NE(response.find("\"error\""), string::npos);
+  EXPECT_NE(response.find("larger than the maximum"), string::npos);
+  EXPECT_EQ(response.find("\"placements\""), string::npos);
+
+  // the server is still serving requests within the limit
+  auto first_query = queries.str().substr(0, queries.str().find('>', 1));
+  response = request(socket_path, first_query);
+  EXPECT_NE(response.find("\"placements\""), string::npos);
+  EXPECT_EQ(count(response, "\"n\": ["), 1u);
+
+  // teardown
+  server.stop();
+  server_thread.join();
+}
@@ -0,0 +1,90 @@
+#include "Epatest.hpp"
+
+#include "core/Placer.hpp"
+#include "io/file_io.hpp"
+#include "seq/MSA.hpp"
+#include "seq/MSA_Info.hpp"
+#include "sample/Sample.hpp"
+
+#include <thread>
+
+using namespace std;
+
+static void compare_samples(const Sample<Placement>& lhs, const Sample<Placement>& rhs)
+{
+  ASSERT_EQ(lhs.size(), rhs.size());
+  for (size_t i = 0; i < lhs.size(); ++i) {
+    auto const& lhs_pq = lhs.at(i);
+    auto const& rhs_pq = rhs.at(i);
+    EXPECT_EQ(lhs_pq.sequence_id(), rhs_pq.sequence_id());
+    EXPECT_EQ(lhs_pq.header(), rhs_pq.header());
+    ASSERT_EQ(lhs_pq.size(), rhs_pq.size());
+    for (size_t j = 0; j < lhs_pq.size(); ++j) {
+      EXPECT_EQ(lhs_pq.at(j).branch_id(), rhs_pq.at(j).branch_id());
+      EXPECT_DOUBLE_EQ(lhs_pq.at(j).likelihood(), rhs_pq.at(j).likelihood());
+    }
+  }
+}
+
+TEST(Placer, place)
+{
+  // setup
+  auto options = env->options;
+  Placer placer(env->tree_file, env->reference_file, env->model, options);
+
+  // queries at the full alignment width, and pre-masked
+  MSA_Info query_info(env->query_file);
+  auto queries = build_MSA_from_file(env->query_file, query_info, false);
+  auto masked_queries = placer.prepare(queries.begin(), queries.end());
+
+  // tests
+  auto sample = placer.place(queries);
+
+  ASSERT_EQ(sample.size(), queries.size());
+  EXPECT_EQ(sample.newick(), placer.newick());
+  for (size_t i = 0; i < sample.size(); ++i) {
+    auto const& pq = sample.at(i);
+    EXPECT_EQ(pq.sequence_id(), i);
+    EXPECT_EQ(pq.header(), queries[i].header());
+    EXPECT_GT(pq.size(), 0u);
+    double lwr_sum = 0.0;
+    for (auto const& p : pq) {
+      lwr_sum += p.lwr();
+    }
+    EXPECT_LE(lwr_sum, 1.0 + 1e-9);
+  }
+
+  compare_samples(sample, placer.place(masked_queries));
+
+  // reuse from multiple threads
+  Sample<Placement> sample_a;
+  Sample<Placement> sample_b;
+  thread thread_a([&]{ sample_a = placer.place(queries); });
+  thread thread_b([&]{ sample_b = placer.place(queries.begin(), queries.end()); });
+  thread_a.join();
+  thread_b.join();
+
+  compare_samples(sample, sample_a);
+  compare_samples(sample, sample_b);
+
+  // a subrange keeps its own sequence ids
+  auto part = placer.place(queries.begin() + 1, queries.begin() + 3);
+  ASSERT_EQ(part.size(), 2u);
+  EXPECT_EQ(part.at(0).sequence_id(), 0u);
+  EXPECT_EQ(part.at(1).header(), queries[2].header());
+
+  // teardown
+}
+
+TEST(Placer, prepare_rejects_unaligned)
+{
+  // setup
+  Placer placer(env->tree_file, env->reference_file, env->model, env->options);
+  MSA queries;
+  queries.append("unaligned", "ACGT");
+
+  // tests
+  EXPECT_THROW(placer.place(queries), std::runtime_error);
+
+  // teardown
+}
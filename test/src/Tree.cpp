@@ -6,12 +6,18 @@
 #include "seq/MSA.hpp"
 #include "seq/MSA_Info.hpp"
 #include "core/place.hpp"
+#include "io/Shared_Store.hpp"
+#include "io/Memory_Map.hpp"
+#include "io/Checkpoint.hpp"
 
 #include "genesis/utils/core/options.hpp"
 
 #include <string>
 #include <vector>
 #include <limits>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
 
 using namespace std;
 
@@ -53,6 +59,102 @@ TEST(Tree, process_from_binary)
   // teardown
 }
 
+static string read_file(const string& file_path)
+{
+  ifstream file(file_path);
+  stringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+
+TEST(Tree, checkpoint_resume)
+{
+  // setup
+  MSA_Info qry_info(env->query_file);
+  MSA_Info ref_info(env->reference_file);
+  MSA_Info::or_mask(qry_info, ref_info);
+
+  auto options = env->options;
+  options.chunk_size = 2;
+  options.checkpointing = true;
+  // for a deterministic order of the pqueries within a chunk
+  options.num_threads = 1;
+
+  auto msa = build_MSA_from_file(env->reference_file, ref_info, options.premasking);
+  Tree tree(env->tree_file, msa, env->model, options);
+
+  const auto checkpoint_file = env->out_dir + "epa_checkpoint";
+  const auto result_file = env->out_dir + "epa_result.jplace";
+  std::remove(checkpoint_file.c_str());
+
+  string invocation("./this --is -a test");
+
+  // tests
+  simple_mpi(tree, env->query_file, qry_info, env->out_dir, options, invocation);
+  const auto complete = read_file(result_file);
+
+  // a completed run leaves no checkpoint behind, so a later run starts over
+  Checkpoint checkpoint(checkpoint_file);
+  EXPECT_FALSE(checkpoint.load());
+  simple_mpi(tree, env->query_file, qry_info, env->out_dir, options, invocation);
+  EXPECT_EQ(complete, read_file(result_file));
+
+  // resuming after the first chunk (two pqueries, then a newline) reproduces the rest of the output
+  const auto first_chunk_end = complete.find("}", complete.find("\"n\"", complete.find("\"n\"") + 1));
+  checkpoint.chunk_size = options.chunk_size;
+  checkpoint.num_sequences = qry_info.sequences();
+  checkpoint.identify(env->query_file, tree, options);
+  checkpoint.chunks_done = 1;
+  checkpoint.bytes_written = first_chunk_end + 2;
+  checkpoint.save();
+  simple_mpi(tree, env->query_file, qry_info, env->out_dir, options, invocation);
+  EXPECT_EQ(complete, read_file(result_file));
+  EXPECT_FALSE(checkpoint.load());
+
+  // a checkpoint of a different run is rejected: other chunking, settings or query file
+  checkpoint.save();
+  auto other_options = options;
+  other_options.chunk_size = 3;
+  EXPECT_THROW(simple_mpi(tree, env->query_file, qry_info, env->out_dir, other_options, invocation),
+               std::runtime_error);
+
+  other_options = options;
+  other_options.prescoring = not options.prescoring;
+  EXPECT_THROW(simple_mpi(tree, env->query_file, qry_info, env->out_dir, other_options, invocation),
+               std::runtime_error);
+
+  const auto query_copy = env->out_dir + "epa_checkpoint_queries.fasta";
+  {
+    ofstream copy(query_copy);
+    copy << read_file(env->query_file);
+  }
+  EXPECT_THROW(simple_mpi(tree, query_copy, qry_info, env->out_dir, options, invocation),
+               std::runtime_error);
+  std::remove(query_copy.c_str());
+
+  // teardown
+  std::remove(checkpoint_file.c_str());
+}
+
+TEST(Tree, optimize_reference)
+{
+  // setup
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), true);
+  auto options = env->options;
+  raxml::Model model;
+  Tree plain_tree(env->tree_file, msa, model, options);
+
+  options.opt_model = true;
+  Tree model_tree(env->tree_file, msa, model, options);
+
+  options.opt_branches = true;
+  Tree full_tree(env->tree_file, msa, model, options);
+
+  // tests
+  EXPECT_GT(model_tree.ref_tree_logl(), plain_tree.ref_tree_logl());
+  EXPECT_GT(full_tree.ref_tree_logl(), plain_tree.ref_tree_logl());
+}
+
 TEST(Tree, combined_input_file)
 {
   auto combined_msa = build_MSA_from_file(env->combined_file, MSA_Info(env->combined_file), true);
@@ -64,3 +166,135 @@ TEST(Tree, rooted_input)
   auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), true);
   auto tree = Tree(env->tree_file_rooted, msa, env->model, env->options);
 }
+
+TEST(Tree, shared_store)
+{
+  // setup
+  MSA_Info qry_info(env->query_file);
+  MSA_Info ref_info(env->reference_file);
+
+  MSA_Info::or_mask(qry_info, ref_info);
+
+  raxml::Model model;
+  Options options;
+  auto msa = build_MSA_from_file(env->reference_file, ref_info, options.premasking);
+  Tree original_tree(env->tree_file, msa, model, options);
+  auto original_lookups = build_lookup_store(original_tree, options);
+
+  const std::string shm_name("epa_test_shared_store");
+  try {
+    Memory_Map::unlink_shared(shm_name);
+  } catch (std::runtime_error&) {
+    // no stale segment from a previous run, all good
+  }
+  publish_to_shared(original_tree, *original_lookups, shm_name);
+
+  // publishing twice under the same name must fail
+  EXPECT_ANY_THROW(publish_to_shared(original_tree, *original_lookups, shm_name));
+
+  options.shm_attach = shm_name;
+  Tree shared_tree(env->tree_file, msa, model, options);
+
+  ASSERT_TRUE(shared_tree.shared_store() != nullptr);
+  EXPECT_DOUBLE_EQ(original_tree.ref_tree_logl(), shared_tree.ref_tree_logl());
+
+  auto partition = shared_tree.partition();
+  for (size_t i = partition->tips; i < partition->tips + partition->clv_buffers; ++i) {
+    EXPECT_EQ(original_tree.partition()->clv[i][0], partition->clv[i][0]);
+  }
+
+  Lookup_Store shared_lookups(original_lookups->num_branches(), partition->states);
+  shared_tree.shared_store()->assign(shared_lookups);
+
+  const auto rows = partition->sites;
+  const auto cols = shared_lookups.char_map_size();
+  for (size_t branch_id = 0; branch_id < shared_lookups.num_branches(); ++branch_id) {
+    ASSERT_TRUE(shared_lookups.has_branch(branch_id));
+    auto expected = original_lookups->branch_data(branch_id);
+    auto actual = shared_lookups.branch_data(branch_id);
+    EXPECT_NE(expected, actual);
+    for (size_t i = 0; i < rows * cols; ++i) {
+      EXPECT_DOUBLE_EQ(expected[i], actual[i]);
+    }
+  }
+
+  // teardown
+  Memory_Map::unlink_shared(shm_name);
+}
+
+TEST(Tree, clv_prefetch_stats)
+{
+  // setup
+  MSA_Info ref_info(env->reference_file);
+
+  raxml::Model model;
+  Options options;
+  auto msa = build_MSA_from_file(env->reference_file, ref_info, options.premasking);
+  Tree original_tree(env->tree_file, msa, model, options);
+  dump_to_binary(original_tree, env->binary_file);
+  Tree read_tree(env->binary_file, model, options);
+
+  const auto num_branches = read_tree.nums().branches;
+  std::vector<pll_unode_t *> branches(num_branches);
+  utree_query_branches(read_tree.tree(), &branches[0]);
+
+  const auto stalls_before = read_tree.clv_stats().stalls.load();
+  const auto resident_before = read_tree.clv_stats().resident_bytes.load();
+
+  for (auto const node : branches) {
+    read_tree.prefetch_clv(node);
+    read_tree.prefetch_clv(node->back);
+  }
+
+  EXPECT_GT(read_tree.clv_stats().prefetched.load(), 0u);
+  // prefetching only advises the OS, it does not load anything itself
+  EXPECT_EQ(resident_before, read_tree.clv_stats().resident_bytes.load());
+
+  for (auto const node : branches) {
+    read_tree.get_clv(node);
+    read_tree.get_clv(node->back);
+  }
+
+  // everything was prefetched, so no further stalls
+  EXPECT_EQ(stalls_before, read_tree.clv_stats().stalls.load());
+  EXPECT_EQ(read_tree.clv_stats().prefetched.load(), read_tree.clv_stats().prefetch_hits.load());
+}
+
+TEST(Tree, clv_memory_limit)
+{
+  // setup
+  MSA_Info ref_info(env->reference_file);
+
+  raxml::Model model;
+  Options options;
+  auto msa = build_MSA_from_file(env->reference_file, ref_info, options.premasking);
+  Tree original_tree(env->tree_file, msa, model, options);
+  dump_to_binary(original_tree, env->binary_file);
+
+  // small enough that only a handful of CLVs fit at once
+  const auto partition = original_tree.partition();
+  options.clv_memory_limit = 4 * pll_get_clv_size(partition, partition->tips) * sizeof(double);
+  Tree read_tree(env->binary_file, model, options);
+
+  const auto num_branches = read_tree.nums().branches;
+  std::vector<pll_unode_t *> branches(num_branches);
+  utree_query_branches(read_tree.tree(), &branches[0]);
+
+  auto inner = branches[0]->next ? branches[0] : branches[0]->back;
+  CLV_Pin pin(read_tree, inner);
+
+  for (auto const node : branches) {
+    read_tree.get_clv(node);
+    read_tree.get_clv(node->back);
+  }
+
+  auto const& stats = read_tree.clv_stats();
+  EXPECT_GT(stats.evictions.load(), 0u);
+  EXPECT_LE(stats.resident_bytes.load(), stats.peak_resident_bytes.load());
+
+  // the pinned CLV must not have been evicted
+  EXPECT_EQ(pin.get_pointer(), read_tree.partition()->clv[inner->clv_index]);
+
+  // evicted CLVs are transparently reloaded, so the likelihood stays the same
+  EXPECT_DOUBLE_EQ(original_tree.ref_tree_logl(), read_tree.ref_tree_logl());
+}
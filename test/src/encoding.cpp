@@ -18,3 +18,89 @@ TEST(encoding, 4bit)
   // printf("%s\n", input.c_str());
   // printf("%s\n", unpacked.c_str());
 }
+
+TEST(encoding, 4bit_ranges)
+{
+  FourBit converter;
+  // long enough for the vectorized decoding
+  std::string input;
+  for (size_t i = 0; i < 5; ++i) {
+    input += "AATGCTTCGTAA---NNNATTCBDAVMKWYR";
+  }
+
+  // keep some runs of sites, starting and ending at odd and even positions
+  const std::vector<std::pair<size_t, size_t>> ranges = { {0, 1}, {3, 8}, {9, 40}, {41, 42}, {50, 155} };
+  std::string expected;
+  for (const auto& range : ranges) {
+    expected += input.substr(range.first, range.second - range.first);
+  }
+
+  auto packed = converter.to_fourbit(input);
+  EXPECT_EQ(input, converter.from_fourbit(packed, input.size()));
+  EXPECT_EQ(expected, converter.from_fourbit(packed, input.size(), ranges, input.size()));
+
+  EXPECT_ANY_THROW(converter.from_fourbit(packed, input.size(), ranges, input.size() - 1));
+}
+
+TEST(encoding, 2bit)
+{
+  TwoBit converter;
+  const std::string input("AATGCTTCGTAA---NNNATTCBDAVMKWYR------acgtn--A");
+
+  auto packed = converter.to_twobit(input);
+  auto unpacked = converter.from_twobit(packed.data(), packed.size(), input.size());
+
+  std::string expected(input);
+  std::transform(expected.begin(), expected.end(), expected.begin(), ::toupper);
+  EXPECT_EQ(expected, unpacked);
+
+  // mostly gaps and bases: runs and 2 bits per base
+  const std::string gappy = std::string(1000, '-') + "ACGTACGTACGT" + std::string(1000, '-');
+  EXPECT_GT(gappy.size() / 20, converter.to_twobit(gappy).size());
+  packed = converter.to_twobit(gappy);
+  EXPECT_EQ(gappy, converter.from_twobit(packed.data(), packed.size(), gappy.size()));
+
+  const std::vector<std::pair<size_t, size_t>> ranges = { {998, 1003}, {1011, 1013} };
+  EXPECT_EQ("--ACGT-", converter.from_twobit(packed.data(), packed.size(), gappy.size(), ranges, gappy.size()));
+
+  EXPECT_ANY_THROW(converter.to_twobit("ACGTX"));
+  EXPECT_ANY_THROW(converter.from_twobit(packed.data(), 4, gappy.size()));
+}
+
+TEST(encoding, 2bit_ranges)
+{
+  TwoBit converter;
+  std::string input;
+  for (size_t i = 0; i < 5; ++i) {
+    input += "AATGCTTCGTAA---NNNATTCBDAVMKWYR------ACGTN--A";
+  }
+
+  // ranges starting and ending within and between gap runs, exceptions and base bytes
+  const std::vector<std::pair<size_t, size_t>> ranges = { {0, 1}, {3, 8}, {9, 40}, {41, 42}, {50, 155}, {170, 225} };
+  std::string expected;
+  for (const auto& range : ranges) {
+    expected += input.substr(range.first, range.second - range.first);
+  }
+
+  const auto packed = converter.to_twobit(input);
+  EXPECT_EQ(expected, converter.from_twobit(packed.data(), packed.size(), input.size(), ranges, input.size()));
+
+  EXPECT_ANY_THROW(converter.from_twobit(packed.data(), packed.size(), input.size(), ranges, input.size() - 1));
+}
+
+TEST(encoding, 1byte)
+{
+  OneByte converter;
+  const std::string input("--MKV-LAAGIVxX*?---LLLWE----");
+
+  auto packed = converter.to_onebyte(input);
+  std::string expected(input);
+  std::transform(expected.begin(), expected.end(), expected.begin(), ::toupper);
+  EXPECT_EQ(expected, converter.from_onebyte(packed.data(), packed.size(), input.size()));
+
+  const std::vector<std::pair<size_t, size_t>> ranges = { {1, 4}, {20, 28} };
+  EXPECT_EQ("-MKLLWE----", converter.from_onebyte(packed.data(), packed.size(), input.size(), ranges, input.size()));
+
+  EXPECT_ANY_THROW(converter.to_onebyte("MK V"));
+  EXPECT_ANY_THROW(converter.from_onebyte(packed.data(), packed.size() - 1, input.size()));
+}
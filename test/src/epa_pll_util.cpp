@@ -14,6 +14,10 @@
 
 #include <string>
 
+#ifdef __OMP
+#include <omp.h>
+#endif
+
 using namespace std;
 
 TEST(epa_pll_util, link_tree_msa)
@@ -153,6 +157,113 @@ TEST(epa_pll_util, precompute_clvs)
   precompute_clvs_test(o);
 }
 
+TEST(epa_pll_util, precompute_clvs_repeats)
+{
+  Options o;
+  o.opt_model = o.opt_branches = false;
+  o.repeats = true;
+  precompute_clvs_test(o);
+}
+
+TEST(epa_pll_util, precompute_clvs_optimized)
+{
+  Options o;
+  o.opt_model = o.opt_branches = true;
+  o.repeats = false;
+  precompute_clvs_test(o);
+}
+
+// computes every directional CLV by a full sequential traversal towards it
+static void sequential_clvs(pll_utree_t * tree, pll_partition_t * part, const Tree_Numbers& nums)
+{
+  vector<pll_unode_t *> travbuffer(nums.nodes);
+  vector<double> branch_lengths(nums.branches);
+  vector<unsigned int> matrix_indices(nums.branches);
+  vector<pll_operation_t> operations(nums.nodes);
+  vector<unsigned int> param_indices(part->rate_cats, 0);
+
+  for (size_t i = tree->tip_count; i < tree->tip_count + tree->inner_count; ++i) {
+    for (auto node : {tree->nodes[i], tree->nodes[i]->next, tree->nodes[i]->next->next}) {
+      unsigned int traversal_size, num_matrices, num_ops;
+      pll_utree_traverse(node,
+                         PLL_TREE_TRAVERSE_POSTORDER,
+                         cb_full_traversal,
+                         &travbuffer[0],
+                         &traversal_size);
+      pll_utree_create_operations(&travbuffer[0],
+                                  traversal_size,
+                                  &branch_lengths[0],
+                                  &matrix_indices[0],
+                                  &operations[0],
+                                  &num_matrices,
+                                  &num_ops);
+      pll_update_prob_matrices(part, &param_indices[0], &matrix_indices[0], &branch_lengths[0], num_matrices);
+      pll_update_partials(part, &operations[0], num_ops);
+    }
+  }
+}
+
+TEST(epa_pll_util, precompute_clvs_threads)
+{
+  // buildup
+  Options o;
+  o.repeats = false;
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), o.premasking);
+  raxml::Model model;
+
+  Tree_Numbers nums;
+  rtree_mapper dummy;
+  auto tree = build_tree_from_file( env->tree_file, nums, dummy );
+  auto part = make_partition( model, nums, msa.num_sites(), o );
+  set_unique_clv_indices(get_root(tree), nums.tip_nodes);
+  link_tree_msa(tree, part, model, msa, nums.tip_nodes);
+
+  Tree_Numbers ref_nums;
+  auto ref_tree = build_tree_from_file( env->tree_file, ref_nums, dummy );
+  auto ref_part = make_partition( model, ref_nums, msa.num_sites(), o );
+  set_unique_clv_indices(get_root(ref_tree), ref_nums.tip_nodes);
+  link_tree_msa(ref_tree, ref_part, model, msa, ref_nums.tip_nodes);
+
+  // the tip-tip lookup table is shared across the partition
+  ASSERT_TRUE(part->attributes & PLL_ATTRIB_PATTERN_TIP);
+
+#ifdef __OMP
+  const auto num_threads = omp_get_max_threads();
+  omp_set_num_threads(4);
+#endif
+  precompute_clvs(tree, part, nums);
+#ifdef __OMP
+  omp_set_num_threads(num_threads);
+#endif
+
+  sequential_clvs(ref_tree, ref_part, ref_nums);
+
+  // tests
+  for (size_t i = part->tips; i < part->tips + part->clv_buffers; ++i) {
+    const auto clv_size = pll_get_clv_size(part, i);
+    ASSERT_EQ(clv_size, pll_get_clv_size(ref_part, i));
+    for (size_t j = 0; j < clv_size; ++j) {
+      ASSERT_DOUBLE_EQ(ref_part->clv[i][j], part->clv[i][j]) << "CLV " << i << ", entry " << j;
+    }
+  }
+  for (size_t i = 0; i < part->scale_buffers; ++i) {
+    if (part->scale_buffer[i]) {
+      ASSERT_NE(ref_part->scale_buffer[i], nullptr);
+      for (size_t j = 0; j < part->sites; ++j) {
+        ASSERT_EQ(ref_part->scale_buffer[i][j], part->scale_buffer[i][j]) << "scaler " << i;
+      }
+    }
+  }
+
+  // teardown
+  utree_free_node_data(get_root(tree));
+  pll_partition_destroy(part);
+  pll_utree_destroy(tree, nullptr);
+  utree_free_node_data(get_root(ref_tree));
+  pll_partition_destroy(ref_part);
+  pll_utree_destroy(ref_tree, nullptr);
+}
+
 TEST(epa_pll_util, split_combined_msa)
 {
   // buildup
@@ -1,5 +1,81 @@
 #include "Epatest.hpp"
 
+#include "io/jplace_util.hpp"
+#include "seq/abundance.hpp"
+#include "sample/PQuery.hpp"
+#include "seq/MSA.hpp"
+
+#include <string>
+#include <sstream>
+#include <stdexcept>
+
+TEST(jplace_util, split_abundance)
+{
+  std::string name;
+
+  EXPECT_EQ(split_abundance("seqA;size=1234", name), 1234u);
+  EXPECT_EQ(name, "seqA");
+
+  EXPECT_EQ(split_abundance("seqB;size=7;", name), 7u);
+  EXPECT_EQ(name, "seqB");
+
+  EXPECT_EQ(split_abundance("seqC;size=3;sample=x", name), 3u);
+  EXPECT_EQ(name, "seqC;sample=x");
+
+  EXPECT_EQ(split_abundance("seqD", name), 1u);
+  EXPECT_EQ(name, "seqD");
+
+  EXPECT_THROW(split_abundance("seqE;size=", name), std::runtime_error);
+  EXPECT_THROW(split_abundance("seqF;size=12x", name), std::runtime_error);
+  EXPECT_THROW(split_abundance("seqG;size=0", name), std::runtime_error);
+}
+
+TEST(jplace_util, split_abundances)
+{
+  // buildup
+  MSA msa;
+  msa.append("seqA;size=3", "ACGT");
+  msa.append("seqB", "ACGT");
+
+  // tests
+  split_abundances(msa);
+  EXPECT_EQ(msa[0].header(), "seqA");
+  EXPECT_EQ(msa[0].abundance(), 3u);
+  EXPECT_EQ(msa[1].header(), "seqB");
+  EXPECT_EQ(msa[1].abundance(), 1u);
+
+  // splitting again leaves the parsed values alone
+  split_abundances(msa);
+  EXPECT_EQ(msa[0].header(), "seqA");
+  EXPECT_EQ(msa[0].abundance(), 3u);
+
+  MSA invalid;
+  invalid.append("seqC;size=x", "ACGT");
+  EXPECT_THROW(split_abundances(invalid), std::runtime_error);
+
+  // teardown
+}
+
+TEST(jplace_util, pquery_to_jplace_string_abundances)
+{
+  // buildup
+  PQuery<Placement> pquery(0, "seqA", 10);
+  pquery.emplace_back(1, -1.0, 0.1, 0.2);
+  pquery.add_duplicate_header("seqB", 5);
+  rtree_mapper mapper;
+
+  // tests
+  std::ostringstream plain;
+  pquery_to_jplace_string(pquery, plain, mapper);
+  EXPECT_NE(plain.str().find("\"n\": [\"seqA\", \"seqB\"]"), std::string::npos);
+
+  std::ostringstream weighted;
+  pquery_to_jplace_string(pquery, weighted, mapper, true);
+  EXPECT_NE(weighted.str().find("\"nm\": [[\"seqA\", 10], [\"seqB\", 5]]"), std::string::npos);
+
+  // teardown
+}
+
 // #include "src/pllhead.hpp"
 // #include "src/file_io.hpp"
 // #include "src/epa_pll_util.hpp"
@@ -1,11 +1,15 @@
 #include "Epatest.hpp"
 
 #include <vector>
+#include <cmath>
 
 #include "core/pll/optimize.hpp"
 #include "core/pll/epa_pll_util.hpp"
+#include "core/pll/pll_util.hpp"
+#include "core/pll/rtree_mapper.hpp"
 #include "io/file_io.hpp"
 #include "util/Options.hpp"
+#include "util/constants.hpp"
 #include "tree/Tree.hpp"
 #include "tree/Tree_Numbers.hpp"
 
@@ -100,4 +104,202 @@
 //     // printf("%f\n", l);
 //   }
 
-// }
\ No newline at end of file
+// }
+
+// recomputes all CLVs towards the root via a full traversal, returns the logl at the root
+static double full_traversal_(pll_partition_t * partition,
+                              pll_unode_t * root,
+                              pll_optimize_options_t& params,
+                              std::vector<pll_unode_t*>& travbuffer)
+{
+  unsigned int traversal_size = 0;
+  unsigned int num_matrices = 0;
+  unsigned int num_ops = 0;
+  pll_utree_traverse( root,
+                      PLL_TREE_TRAVERSE_POSTORDER,
+                      cb_full_traversal,
+                      &travbuffer[0],
+                      &traversal_size);
+  pll_utree_create_operations(&travbuffer[0],
+                              traversal_size,
+                              params.lk_params.branch_lengths,
+                              params.lk_params.matrix_indices,
+                              params.lk_params.operations,
+                              &num_matrices,
+                              &num_ops);
+  pll_update_prob_matrices( partition,
+                            params.lk_params.params_indices,
+                            params.lk_params.matrix_indices,
+                            params.lk_params.branch_lengths,
+                            num_matrices);
+  pll_update_partials(partition, params.lk_params.operations, num_ops);
+
+  params.lk_params.where.unrooted_t.parent_clv_index    = root->clv_index;
+  params.lk_params.where.unrooted_t.parent_scaler_index = root->scaler_index;
+  params.lk_params.where.unrooted_t.child_clv_index     = root->back->clv_index;
+  params.lk_params.where.unrooted_t.child_scaler_index  = root->back->scaler_index;
+  params.lk_params.where.unrooted_t.edge_pmatrix_index  = root->pmatrix_index;
+
+  return pll_compute_edge_loglikelihood(partition,
+                                        root->clv_index,
+                                        root->scaler_index,
+                                        root->back->clv_index,
+                                        root->back->scaler_index,
+                                        root->pmatrix_index,
+                                        params.lk_params.params_indices,
+                                        nullptr);
+}
+
+static double pllmod_branch_lengths_(pll_partition_t * partition,
+                                     pll_unode_t * root,
+                                     pll_optimize_options_t& params,
+                                     std::vector<pll_unode_t*>& travbuffer,
+                                     const int smoothings)
+{
+  full_traversal_(partition, root, params, travbuffer);
+  pllmod_opt_optimize_branch_lengths_iterative( partition,
+                                                root,
+                                                params.lk_params.params_indices,
+                                                PLLMOD_OPT_MIN_BRANCH_LEN,
+                                                PLLMOD_OPT_MAX_BRANCH_LEN,
+                                                OPT_BRANCH_EPSILON,
+                                                smoothings,
+                                                1);
+  return full_traversal_(partition, root, params, travbuffer);
+}
+
+/**
+  The reference the site parallel optimize is held against: the same schedule of parameter
+  and branch length rounds, but run entirely through the pll-modules optimizers on the full
+  partition.
+*/
+static double pllmod_optimize_(raxml::Model& model,
+                               pll_utree_t * const tree,
+                               pll_partition_t * partition,
+                               const Tree_Numbers& nums,
+                               const bool opt_branches,
+                               const bool opt_model)
+{
+  const auto root = get_root(tree);
+
+  if (opt_branches) {
+    set_branch_lengths(tree, DEFAULT_BRANCH_LENGTH);
+  }
+  compute_and_set_empirical_frequencies(partition, model);
+
+  std::vector<int> symmetries = model.submodel(0).rate_sym();
+  std::vector<unsigned int> param_indices(model.num_ratecats(), 0);
+  std::vector<pll_unode_t*> travbuffer(nums.nodes);
+  std::vector<double> branch_lengths(nums.branches);
+  std::vector<unsigned int> matrix_indices(nums.branches);
+  std::vector<pll_operation_t> operations(nums.nodes);
+
+  pll_optimize_options_t params;
+  params.lk_params.partition = partition;
+  params.lk_params.operations = &operations[0];
+  params.lk_params.branch_lengths = &branch_lengths[0];
+  params.lk_params.matrix_indices = &matrix_indices[0];
+  params.lk_params.params_indices = &param_indices[0];
+  params.lk_params.alpha_value = model.alpha();
+  params.lk_params.rooted = 0;
+  params.params_index = 0;
+  params.subst_params_symmetries = &symmetries[0];
+  params.factr = OPT_FACTR;
+  params.pgtol = OPT_PARAM_EPSILON;
+
+  auto cur_logl = full_traversal_(partition, root, params, travbuffer);
+
+  if (opt_branches) {
+    cur_logl = pllmod_branch_lengths_(partition, root, params, travbuffer, 8);
+  }
+
+  const auto rates_size = model.subst_rates(0).size();
+  std::vector<double> min_rates(rates_size, OPT_RATE_MIN);
+  std::vector<double> max_rates(rates_size, OPT_RATE_MAX);
+
+  double logl;
+  do {
+    logl = cur_logl;
+
+    if (opt_model) {
+      params.which_parameters = PLLMOD_OPT_PARAM_SUBST_RATES;
+      pllmod_opt_optimize_multidim(&params, &min_rates[0], &max_rates[0]);
+      cur_logl = full_traversal_(partition, root, params, travbuffer);
+
+      if (opt_branches) {
+        cur_logl = pllmod_branch_lengths_(partition, root, params, travbuffer, 2);
+      }
+
+      params.which_parameters = PLLMOD_OPT_PARAM_ALPHA;
+      pllmod_opt_optimize_onedim(&params, 0.02, 10000.);
+      cur_logl = full_traversal_(partition, root, params, travbuffer);
+    }
+
+    if (opt_branches) {
+      cur_logl = pllmod_branch_lengths_(partition, root, params, travbuffer, 3);
+    }
+  } while (fabs(cur_logl - logl) > OPT_EPSILON);
+
+  return cur_logl;
+}
+
+static double root_logl_(pll_utree_t * const tree, pll_partition_t * partition, const Tree_Numbers& nums)
+{
+  precompute_clvs(tree, partition, nums);
+  const auto root = get_root(tree);
+  std::vector<unsigned int> param_indices(partition->rate_cats, 0);
+  return pll_compute_edge_loglikelihood(partition,
+                                        root->clv_index,
+                                        root->scaler_index,
+                                        root->back->clv_index,
+                                        root->back->scaler_index,
+                                        root->pmatrix_index,
+                                        &param_indices[0],
+                                        nullptr);
+}
+
+static void matches_pllmod_(const bool opt_branches, const bool opt_model)
+{
+  // setup
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), false);
+  Options options;
+
+  Tree_Numbers nums;
+  raxml::Model model;
+  rtree_mapper dummy;
+  auto tree = build_tree_from_file(env->tree_file, nums, dummy);
+  auto part = make_partition(model, nums, msa.num_sites(), options);
+  set_unique_clv_indices(get_root(tree), nums.tip_nodes);
+  link_tree_msa(tree, part, model, msa, nums.tip_nodes);
+
+  Tree_Numbers ref_nums;
+  raxml::Model ref_model;
+  auto ref_tree = build_tree_from_file(env->tree_file, ref_nums, dummy);
+  auto ref_part = make_partition(ref_model, ref_nums, msa.num_sites(), options);
+  set_unique_clv_indices(get_root(ref_tree), ref_nums.tip_nodes);
+  link_tree_msa(ref_tree, ref_part, ref_model, msa, ref_nums.tip_nodes);
+
+  // test
+  optimize(model, tree, part, nums, opt_branches, opt_model);
+  const auto logl = root_logl_(tree, part, nums);
+
+  pllmod_optimize_(ref_model, ref_tree, ref_part, ref_nums, opt_branches, opt_model);
+  const auto ref_logl = root_logl_(ref_tree, ref_part, ref_nums);
+
+  // both stop once a round improves the logl by less than OPT_EPSILON, from different
+  // points on the way to the same optimum
+  EXPECT_NEAR(logl, ref_logl, 2 * OPT_EPSILON);
+
+  // teardown
+  pll_partition_destroy(part);
+  pll_utree_destroy(tree, nullptr);
+  pll_partition_destroy(ref_part);
+  pll_utree_destroy(ref_tree, nullptr);
+}
+
+TEST(optimize, matches_pllmod)
+{
+  matches_pllmod_(true, false);
+  matches_pllmod_(false, true);
+  matches_pllmod_(true, true);
+}